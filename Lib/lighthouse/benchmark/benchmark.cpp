@@ -0,0 +1,1030 @@
+//
+//  benchmark.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include <cereal/archives/binary.hpp>
+
+#include "benchmark.hpp"
+#include "color_histogram.hpp"
+#include "descriptor_arena.hpp"
+#include "exceptions.hpp"
+#include "frame_preprocessor.hpp"
+#include "hamming.hpp"
+#include "lighthouse.hpp"
+#include "serialization.hpp"
+#include "tiled_orb_extractor.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Synthetic DB distractors keep this many descriptors of the real item they're made of, with that many bits flipped in
+// every descriptor. Fewer descriptors keep the largest DBs within memory.
+const uint32_t kDistractorDescriptorCount = 50;
+const uint32_t kDistractorFlippedBitCount = 24;
+// Max number of queries per synthetic DB.
+const uint32_t kBackendQueryCount = 50;
+// Number of bits flipped in every descriptor of the verification benchmark queries.
+const uint32_t kQueryFlippedBitCount = 24;
+// Number of best items of the coarse pass that would be matched in full, as far as prefix recall is concerned.
+const uint32_t kCoarseShortlistSize = 10;
+// Recommended working resolution is the fastest one with recall@1 at most that much below the full resolution one.
+const float kWorkingResolutionRecallTolerance = 0.02;
+
+// Flips `aBitCount` random bits of the descriptor.
+void FlipRandomBits(uint8_t *aDescriptor, uint32_t aDescriptorBytes, uint32_t aBitCount, std::mt19937 &aGenerator) {
+  for (uint32_t flip = 0; flip < aBitCount; ++flip) {
+    const uint32_t bit = aGenerator() % (aDescriptorBytes * 8);
+    aDescriptor[bit / 8] ^= (uint8_t) (1 << (bit % 8));
+  }
+}
+
+// Returns BGRA source images of the DB items along with the items' ids, items without one are skipped.
+std::vector<std::pair<cv::Mat, std::string>> LoadSourceImages(const ImageMatcher &aMatcher,
+    const std::vector<std::string> &aSourceImagePaths) {
+  std::vector<std::pair<cv::Mat, std::string>> sourceImages;
+  const std::vector<ImageDescriptionPtr> descriptions = aMatcher.GetDescriptions();
+  for (const std::string &sourceImagePath : aSourceImagePaths) {
+    for (const ImageDescriptionPtr &description : descriptions) {
+      if (sourceImagePath.find(description->GetId()) == std::string::npos) {
+        continue;
+      }
+
+      const cv::Mat sourceImage = cv::imread(sourceImagePath, cv::IMREAD_UNCHANGED);
+      if (!sourceImage.empty() && sourceImage.channels() == 4) {
+        sourceImages.push_back(std::make_pair(sourceImage, description->GetId()));
+      }
+      break;
+    }
+  }
+
+  return sourceImages;
+}
+
+// Counts `cv::Mat` allocations while it's installed as the default allocator, memory itself comes from the standard
+// allocator. The default allocator is global, so allocations made by other threads meanwhile are counted too.
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+  CountingMatAllocator()
+      : mAllocationCount(0), mAllocatedBytes(0), mPreviousAllocator(cv::Mat::getDefaultAllocator()) {
+    cv::Mat::setDefaultAllocator(this);
+  }
+
+  ~CountingMatAllocator() {
+    cv::Mat::setDefaultAllocator(mPreviousAllocator);
+  }
+
+  cv::UMatData *allocate(int aDims, const int *aSizes, int aType, void *aData, size_t *aStep, int aFlags,
+      cv::UMatUsageFlags aUsageFlags) const override {
+    cv::UMatData *data = cv::Mat::getStdAllocator()->allocate(aDims, aSizes, aType, aData, aStep, aFlags, aUsageFlags);
+    // Mats over user memory don't allocate anything.
+    if (data != nullptr && aData == nullptr) {
+      mAllocationCount++;
+      mAllocatedBytes += data->size;
+    }
+    return data;
+  }
+
+  bool allocate(cv::UMatData *aData, int aAccessFlags, cv::UMatUsageFlags aUsageFlags) const override {
+    return cv::Mat::getStdAllocator()->allocate(aData, aAccessFlags, aUsageFlags);
+  }
+
+  void deallocate(cv::UMatData *aData) const override {
+    cv::Mat::getStdAllocator()->deallocate(aData);
+  }
+
+  uint64_t GetAllocationCount() const {
+    return mAllocationCount;
+  }
+
+  uint64_t GetAllocatedBytes() const {
+    return mAllocatedBytes;
+  }
+
+private:
+  mutable std::atomic<uint64_t> mAllocationCount;
+  mutable std::atomic<uint64_t> mAllocatedBytes;
+  cv::MatAllocator *mPreviousAllocator;
+};
+
+} // namespace
+
+/*static*/ bool Benchmark::Run(const ImageMatcher &aMatcher, const std::vector<std::string> &aSourceImagePaths) {
+  fprintf(stderr, "Benchmark::Run() started.\n");
+
+  const bool isCorrect = CheckHammingKernels(aMatcher);
+  MeasureHammingKernels(aMatcher);
+  MeasureThreadScaling(aMatcher);
+  MeasureTopMatches(aMatcher, kIdentificationCertaintyScore, kIdentificationCertaintyMargin);
+
+  ImageMatchingSettings settings = aMatcher.GetSettings();
+  settings.mShortlistSize = 0;
+  CompareWithExhaustive("multi-index hash", CreateMatcher(aMatcher, settings));
+
+  // Safe histogram bound is always on, so that's what the line above measures. Aggressive mode trades recall for time.
+  for (const uint32_t histogramShortlistSize : {10, 50}) {
+    settings.mHistogramShortlistSize = histogramShortlistSize;
+    CompareWithExhaustive("multi-index hash, histogram shortlist of " + std::to_string(histogramShortlistSize),
+        CreateMatcher(aMatcher, settings));
+  }
+  settings.mHistogramShortlistSize = 0;
+
+  settings.mMatcherBackend = MatcherBackend::LSH;
+  CompareWithExhaustive("LSH", CreateMatcher(aMatcher, settings));
+  settings.mMatcherBackend = aMatcher.GetSettings().mMatcherBackend;
+
+  CompareBackends(aMatcher, {100, 1000, 10000, 100000});
+
+  MeasureTiledExtraction(aMatcher, aSourceImagePaths);
+  MeasureAnytimeIdentification(aMatcher, aSourceImagePaths);
+  MeasureWorkingResolution(aMatcher, aSourceImagePaths);
+  MeasurePrefixRecall(aMatcher);
+  MeasureKeypointStorage(aMatcher);
+  MeasureColorHistogram(aSourceImagePaths);
+  MeasureFramePreprocessing(aSourceImagePaths);
+  MeasureVerification(aMatcher, aSourceImagePaths);
+
+  if (!aMatcher.GetVocabulary()->IsEmpty()) {
+    for (const uint32_t shortlistSize : {5, 10, 20, 50}) {
+      settings.mShortlistSize = shortlistSize;
+      CompareWithExhaustive("vocabulary tree, shortlist of " + std::to_string(shortlistSize),
+          CreateMatcher(aMatcher, settings));
+    }
+  }
+
+  fprintf(stderr, "Benchmark::Run() finished%s.\n", isCorrect ? "" : ", correctness checks FAILED");
+  return isCorrect;
+}
+
+/*static*/ void Benchmark::CompareWithExhaustive(const std::string &aName, const ImageMatcher &aMatcher,
+    uint32_t aStep) {
+  const std::vector<ImageDescriptionPtr> descriptions = aMatcher.GetDescriptions();
+
+  uint32_t queryCount = 0, hitCount = 0;
+  std::chrono::duration<double, std::milli> exhaustiveTime(0), candidateTime(0);
+  for (const ImageDescriptionPtr &description : descriptions) {
+    const ImageDescription query = MakeQuery(*description, aStep);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    const auto expectedMatches = aMatcher.FindMatchesExhaustive(query);
+    auto end = std::chrono::high_resolution_clock::now();
+    exhaustiveTime += end - start;
+
+    start = std::chrono::high_resolution_clock::now();
+    const auto actualMatches = aMatcher.FindMatches(query);
+    end = std::chrono::high_resolution_clock::now();
+    candidateTime += end - start;
+
+    // Recall is measured only for queries that the exhaustive scan can answer.
+    if (expectedMatches.empty()) {
+      continue;
+    }
+
+    queryCount++;
+    if (!actualMatches.empty() && std::get<1>(actualMatches[0])->GetId() == std::get<1>(expectedMatches[0])->GetId()) {
+      hitCount++;
+    }
+  }
+
+  const size_t runCount = std::max<size_t>(descriptions.size(), 1);
+  fprintf(stderr, "Benchmark::CompareWithExhaustive(%s) %lu item(s): recall@1 %f (%u/%u), mean latency %f ms vs %f ms "
+      "exhaustive.\n", aName.c_str(), descriptions.size(), queryCount > 0 ? (float) hitCount / queryCount : 0.0f,
+      hitCount, queryCount, candidateTime.count() / runCount, exhaustiveTime.count() / runCount);
+}
+
+/*static*/ bool Benchmark::CheckHammingKernels(const ImageMatcher &aMatcher) {
+  const std::vector<ImageDescriptionPtr> descriptions = aMatcher.GetDescriptions();
+  const cv::BFMatcher referenceMatcher(cv::NORM_HAMMING);
+
+  bool isCorrect = true;
+  for (const auto &kernel : HammingKernels<DescriptorArena::kDescriptorBytes>::GetSupportedKernels()) {
+    uint32_t comparedCount = 0, distanceMismatchCount = 0, indexMismatchCount = 0, tieCount = 0;
+    for (size_t i = 0; i < descriptions.size(); ++i) {
+      const cv::Mat &query = descriptions[i]->GetDescriptors();
+      const cv::Mat &train = descriptions[(i + 1) % descriptions.size()]->GetDescriptors();
+      if (query.empty() || train.rows < 2) {
+        continue;
+      }
+
+      std::vector<std::vector<cv::DMatch>> expectedMatches;
+      referenceMatcher.knnMatch(query, train, expectedMatches, 2);
+
+      for (int row = 0; row < query.rows; ++row) {
+        HammingTop2 top2;
+        kernel.second(query.ptr<uint8_t>(row), train.ptr<uint8_t>(), train.rows, train.step[0], top2);
+
+        for (uint32_t neighbour = 0; neighbour < 2; ++neighbour) {
+          const cv::DMatch &expected = expectedMatches[row][neighbour];
+          comparedCount++;
+          if ((float) top2.mDistances[neighbour] != expected.distance) {
+            distanceMismatchCount++;
+          } else if ((int) top2.mIndices[neighbour] != expected.trainIdx) {
+            // Same distance to a different descriptor is legitimate only if both are equally close to the query.
+            if (HammingMatcher<DescriptorArena::kDescriptorBytes>::Distance(query.ptr<uint8_t>(row),
+                train.ptr<uint8_t>(expected.trainIdx)) == top2.mDistances[neighbour]) {
+              tieCount++;
+            } else {
+              indexMismatchCount++;
+            }
+          }
+        }
+      }
+    }
+
+    fprintf(stderr, "Benchmark::CheckHammingKernels(%s) %u neighbour(s) compared: %u distance mismatch(es), %u index "
+        "mismatch(es), %u tie(s) resolved differently.\n", kernel.first.c_str(), comparedCount, distanceMismatchCount,
+        indexMismatchCount, tieCount);
+    if (distanceMismatchCount > 0 || indexMismatchCount > 0) {
+      isCorrect = false;
+    }
+  }
+
+  return isCorrect;
+}
+
+/*static*/ void Benchmark::MeasureHammingKernels(const ImageMatcher &aMatcher) {
+  const std::vector<ImageDescriptionPtr> descriptions = aMatcher.GetDescriptions();
+
+  cv::Mat train;
+  for (const ImageDescriptionPtr &description : descriptions) {
+    if (!description->GetDescriptors().empty()) {
+      train.push_back(description->GetDescriptors());
+    }
+  }
+
+  if (train.empty()) {
+    return;
+  }
+
+  const cv::Mat &query = descriptions[0]->GetDescriptors().empty() ? train : descriptions[0]->GetDescriptors();
+  const double comparisonCount = (double) query.rows * train.rows;
+
+  for (const auto &kernel : HammingKernels<DescriptorArena::kDescriptorBytes>::GetSupportedKernels()) {
+    // Accumulate distances so that the compiler can't drop the calls.
+    uint64_t checksum = 0;
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (int row = 0; row < query.rows; ++row) {
+      HammingTop2 top2;
+      kernel.second(query.ptr<uint8_t>(row), train.ptr<uint8_t>(), train.rows, train.step[0], top2);
+      checksum += top2.mDistances[0] + top2.mDistances[1];
+    }
+    const std::chrono::duration<double, std::nano> time = std::chrono::high_resolution_clock::now() - start;
+
+    fprintf(stderr, "Benchmark::MeasureHammingKernels(%s%s) %f ns per descriptor pair (checksum %llu).\n",
+        kernel.first.c_str(), kernel.first == HammingKernels<DescriptorArena::kDescriptorBytes>::GetKernelName() ?
+        ", selected" : "", time.count() / comparisonCount, (unsigned long long) checksum);
+  }
+
+  std::vector<std::vector<cv::DMatch>> matches;
+  const auto start = std::chrono::high_resolution_clock::now();
+  cv::BFMatcher(cv::NORM_HAMMING).knnMatch(query, train, matches, 2);
+  const std::chrono::duration<double, std::nano> time = std::chrono::high_resolution_clock::now() - start;
+
+  fprintf(stderr, "Benchmark::MeasureHammingKernels(BFMatcher) %f ns per descriptor pair.\n",
+      time.count() / comparisonCount);
+}
+
+/*static*/ void Benchmark::MeasureThreadScaling(const ImageMatcher &aMatcher) {
+  std::vector<ImageDescription> queries;
+  for (const ImageDescriptionPtr &description : aMatcher.GetDescriptions()) {
+    queries.push_back(MakeQuery(*description, 2));
+  }
+
+  if (queries.empty()) {
+    return;
+  }
+
+  const uint32_t coreCount = std::max(std::thread::hardware_concurrency(), 1u);
+  std::vector<uint32_t> threadCounts;
+  for (uint32_t threadCount = 1; threadCount < coreCount; threadCount *= 2) {
+    threadCounts.push_back(threadCount);
+  }
+  threadCounts.push_back(coreCount);
+
+  // Ids and scores of the single-threaded results every other run is compared with.
+  std::vector<std::vector<std::tuple<float, std::string>>> expectedResults;
+  double singleThreadTime = 0;
+
+  ImageMatchingSettings settings = aMatcher.GetSettings();
+  for (const uint32_t threadCount : threadCounts) {
+    settings.mThreadCount = threadCount;
+    const ImageMatcher matcher = CreateMatcher(aMatcher, settings);
+
+    uint32_t mismatchCount = 0;
+    std::chrono::duration<double, std::milli> time(0);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const auto start = std::chrono::high_resolution_clock::now();
+      const auto matches = matcher.FindMatches(queries[i]);
+      time += std::chrono::high_resolution_clock::now() - start;
+
+      std::vector<std::tuple<float, std::string>> results;
+      for (const auto &match : matches) {
+        results.push_back(std::make_tuple(std::get<0>(match), std::get<1>(match)->GetId()));
+      }
+
+      if (threadCount == 1) {
+        expectedResults.push_back(results);
+      } else if (results != expectedResults[i]) {
+        mismatchCount++;
+      }
+    }
+
+    if (threadCount == 1) {
+      singleThreadTime = time.count();
+    }
+
+    fprintf(stderr, "Benchmark::MeasureThreadScaling(%u thread(s)) mean latency %f ms, speedup %f, %u result(s) differ "
+        "from single thread.\n", threadCount, time.count() / queries.size(),
+        time.count() > 0 ? singleThreadTime / time.count() : 0.0, mismatchCount);
+  }
+}
+
+/*static*/ void Benchmark::MeasureTopMatches(const ImageMatcher &aMatcher, float aCertaintyScore,
+    float aCertaintyMargin) {
+  TopMatchesOptions options;
+  options.mCertaintyScore = aCertaintyScore;
+  options.mCertaintyMargin = aCertaintyMargin;
+  options.mPrior = std::make_shared<RecentMatchesPrior>(kRecentMatchesCount);
+
+  uint32_t queryCount = 0, agreementCount = 0;
+  std::chrono::duration<double, std::milli> fullTime(0), topTime(0);
+  for (const ImageDescriptionPtr &description : aMatcher.GetDescriptions()) {
+    const ImageDescription query = MakeQuery(*description, 2);
+
+    for (uint32_t repetition = 0; repetition < 2; ++repetition) {
+      auto start = std::chrono::high_resolution_clock::now();
+      const auto matches = aMatcher.FindMatches(query);
+      auto end = std::chrono::high_resolution_clock::now();
+      fullTime += end - start;
+
+      start = std::chrono::high_resolution_clock::now();
+      const auto topMatches = aMatcher.FindTopMatches(query, 1, options);
+      end = std::chrono::high_resolution_clock::now();
+      topTime += end - start;
+
+      queryCount++;
+      if (matches.empty() ? topMatches.empty() :
+          !topMatches.empty() && std::get<1>(topMatches[0])->GetId() == std::get<1>(matches[0])->GetId()) {
+        agreementCount++;
+      }
+    }
+  }
+
+  const size_t runCount = std::max<size_t>(queryCount, 1);
+  fprintf(stderr, "Benchmark::MeasureTopMatches(certainty %f, margin %f) %u query(ies): same top match %u time(s), "
+      "mean latency %f ms vs %f ms for FindMatches.\n", aCertaintyScore, aCertaintyMargin, queryCount, agreementCount,
+      topTime.count() / runCount, fullTime.count() / runCount);
+}
+
+/*static*/ void Benchmark::CompareBackends(const ImageMatcher &aMatcher, const std::vector<uint32_t> &aDBSizes) {
+  const std::vector<ImageDescriptionPtr> descriptions = aMatcher.GetDescriptions();
+  if (descriptions.empty()) {
+    return;
+  }
+
+  // Every backend is measured on its own, with neither the vocabulary nor the aggressive histogram cascade in the way.
+  ImageMatchingSettings settings = aMatcher.GetSettings();
+  settings.mShortlistSize = 0;
+  settings.mHistogramShortlistSize = 0;
+
+  const std::vector<std::tuple<std::string, MatcherBackend>> backends = {
+    std::make_tuple("brute force", MatcherBackend::BRUTE_FORCE),
+    std::make_tuple("multi-index hash", MatcherBackend::MULTI_INDEX_HASH),
+    std::make_tuple("LSH", MatcherBackend::LSH),
+  };
+
+  for (const uint32_t dbSize : aDBSizes) {
+    const std::vector<ImageDescription> db = MakeSyntheticDB(aMatcher, dbSize);
+
+    std::vector<ImageDescription> queries;
+    for (size_t i = 0; i < descriptions.size() && i < db.size() && queries.size() < kBackendQueryCount; ++i) {
+      queries.push_back(MakeQuery(db[i], 2));
+    }
+
+    // Top match id of the exact backend for every query, empty if there is no match.
+    std::vector<std::string> expectedIds;
+    for (const auto &backend : backends) {
+      settings.mMatcherBackend = std::get<1>(backend);
+      ImageMatcher matcher(settings);
+
+      auto start = std::chrono::high_resolution_clock::now();
+      matcher.AddToDB(db);
+      const std::chrono::duration<double, std::milli> buildTime = std::chrono::high_resolution_clock::now() - start;
+
+      uint32_t queryCount = 0, hitCount = 0;
+      std::chrono::duration<double, std::milli> time(0);
+      for (size_t i = 0; i < queries.size(); ++i) {
+        start = std::chrono::high_resolution_clock::now();
+        const auto matches = matcher.FindMatches(queries[i]);
+        time += std::chrono::high_resolution_clock::now() - start;
+
+        const std::string topId = matches.empty() ? "" : std::get<1>(matches[0])->GetId();
+        if (settings.mMatcherBackend == MatcherBackend::BRUTE_FORCE) {
+          expectedIds.push_back(topId);
+        }
+
+        // Recall is measured only for queries that the exact backend can answer.
+        if (!expectedIds[i].empty()) {
+          queryCount++;
+          hitCount += topId == expectedIds[i] ? 1 : 0;
+        }
+      }
+
+      fprintf(stderr, "Benchmark::CompareBackends(%s) %lu item(s): recall@1 %f (%u/%u), mean latency %f ms, DB built "
+          "in %f ms.\n", std::get<0>(backend).c_str(), db.size(), queryCount > 0 ? (float) hitCount / queryCount : 0.0f,
+          hitCount, queryCount, time.count() / std::max<size_t>(queries.size(), 1), buildTime.count());
+    }
+  }
+}
+
+/*static*/ std::vector<ImageDescription> Benchmark::MakeSyntheticDB(const ImageMatcher &aMatcher, uint32_t aSize) {
+  const std::vector<ImageDescriptionPtr> descriptions = aMatcher.GetDescriptions();
+
+  std::vector<ImageDescription> db;
+  bool hasDescriptors = false;
+  for (size_t i = 0; i < descriptions.size() && db.size() < aSize; ++i) {
+    db.push_back(*descriptions[i]);
+    hasDescriptors = hasDescriptors || !descriptions[i]->GetDescriptors().empty();
+  }
+
+  if (!hasDescriptors) {
+    return db;
+  }
+
+  // Fixed seed, so that every run measures the same DB.
+  std::mt19937 generator(aSize);
+  for (uint32_t i = 0; db.size() < aSize; ++i) {
+    const ImageDescription &description = *descriptions[i % descriptions.size()];
+    const OrbDescriptorSet &sourceDescriptors = description.GetDescriptorSet();
+    if (sourceDescriptors.Empty()) {
+      continue;
+    }
+
+    const uint32_t step = std::max<uint32_t>(sourceDescriptors.Size() / kDistractorDescriptorCount, 1);
+    KeypointSet keypoints;
+    OrbDescriptorSet descriptors;
+    for (size_t row = 0; row < sourceDescriptors.Size() && keypoints.Size() < kDistractorDescriptorCount; row += step) {
+      descriptors.PushBack(sourceDescriptors.GetRow(row));
+      FlipRandomBits(descriptors.GetRow(descriptors.Size() - 1), DescriptorArena::kDescriptorBytes,
+          kDistractorFlippedBitCount, generator);
+
+      keypoints.PushBack(description.GetKeypoints(), row);
+    }
+
+    db.push_back(ImageDescription("distractor-" + std::to_string(i) + "-" + description.GetId(), keypoints,
+        descriptors, description.GetHistogram(), BowVector(), description.GetScale(), description.GetStorage()));
+  }
+
+  return db;
+}
+
+/*static*/ void Benchmark::MeasureVerification(const ImageMatcher &aMatcher,
+    const std::vector<std::string> &aSourceImagePaths) {
+  const std::vector<ImageDescriptionPtr> descriptions = aMatcher.GetDescriptions();
+  if (descriptions.empty()) {
+    return;
+  }
+
+  ImageMatchingSettings settings = aMatcher.GetSettings();
+  for (const uint32_t featureCount : {1000, 500}) {
+    settings.mNumberOfFeatures = featureCount;
+
+    // Extraction doesn't depend on verification, so it's measured once per feature count.
+    const ImageMatcher extractor(settings);
+    uint32_t imageCount = 0;
+    std::chrono::duration<double, std::milli> extractionTime(0);
+    for (const std::string &sourceImagePath : aSourceImagePaths) {
+      const cv::Mat sourceImage = cv::imread(sourceImagePath, cv::IMREAD_UNCHANGED);
+      if (sourceImage.empty() || sourceImage.channels() != 4) {
+        continue;
+      }
+
+      const auto start = std::chrono::high_resolution_clock::now();
+      try {
+        extractor.GetDescription(sourceImage);
+      } catch (const ImageQualityException &e) {
+        // Still counts, the user has waited for it all the same.
+      }
+      extractionTime += std::chrono::high_resolution_clock::now() - start;
+      imageCount++;
+    }
+    const double meanExtractionTime = imageCount > 0 ? extractionTime.count() / imageCount : 0;
+
+    std::vector<ImageDescription> db, queries;
+    for (const ImageDescriptionPtr &description : descriptions) {
+      db.push_back(KeepStrongestFeatures(*description, featureCount));
+      queries.push_back(MakeQuery(db.back(), 2, kQueryFlippedBitCount));
+    }
+
+    for (const uint32_t verificationCount : {0, 10}) {
+      settings.mVerificationCount = verificationCount;
+      ImageMatcher matcher(settings);
+      matcher.AddToDB(db);
+
+      uint32_t hitCount = 0;
+      std::chrono::duration<double, std::milli> matchingTime(0);
+      for (size_t i = 0; i < queries.size(); ++i) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        const auto matches = matcher.FindMatches(queries[i]);
+        matchingTime += std::chrono::high_resolution_clock::now() - start;
+
+        if (!matches.empty() && std::get<1>(matches[0])->GetId() == db[i].GetId()) {
+          hitCount++;
+        }
+      }
+
+      const double meanMatchingTime = matchingTime.count() / queries.size();
+      fprintf(stderr, "Benchmark::MeasureVerification(%u features, %u verified) accuracy@1 %f (%u/%lu), mean latency "
+          "%f ms = %f ms extraction (%u image(s)) + %f ms matching.\n", featureCount, verificationCount,
+          (float) hitCount / queries.size(), hitCount, queries.size(), meanExtractionTime + meanMatchingTime,
+          meanExtractionTime, imageCount, meanMatchingTime);
+    }
+  }
+}
+
+/*static*/ void Benchmark::MeasureTiledExtraction(const ImageMatcher &aMatcher,
+    const std::vector<std::string> &aSourceImagePaths) {
+  const int kSpreadGridSize = 8;
+
+  ImageMatchingSettings settings = aMatcher.GetSettings();
+  for (const uint32_t gridSize : {1, 2, 3, 4}) {
+    settings.mExtractionGridSize = gridSize;
+    const ImageMatcher extractor(settings);
+    const TiledOrbExtractor tiledExtractor(cv::ORB::create(settings.mNumberOfFeatures), gridSize);
+    const cv::Ptr<cv::ORB> detector = cv::ORB::create(settings.mNumberOfFeatures);
+
+    uint32_t imageCount = 0;
+    uint64_t keypointCount = 0;
+    // Descriptors `TiledOrbExtractor::Compute` and ORB over the whole image give for the keypoints `Detect` finds.
+    uint64_t tiledDescriptorCount = 0, descriptorCount = 0;
+    double spread = 0;
+    std::chrono::duration<double, std::milli> extractionTime(0);
+    for (const std::string &sourceImagePath : aSourceImagePaths) {
+      const cv::Mat sourceImage = cv::imread(sourceImagePath, cv::IMREAD_UNCHANGED);
+      if (sourceImage.empty() || sourceImage.channels() != 4) {
+        continue;
+      }
+
+      const auto start = std::chrono::high_resolution_clock::now();
+      ImageDescription description;
+      try {
+        description = extractor.GetDescription(sourceImage);
+      } catch (const ImageQualityException &e) {
+        continue;
+      }
+      extractionTime += std::chrono::high_resolution_clock::now() - start;
+      imageCount++;
+
+      const KeypointSet &keypoints = description.GetKeypoints();
+      std::vector<double> cellCounts(kSpreadGridSize * kSpreadGridSize, 0);
+      for (size_t i = 0; i < keypoints.Size(); ++i) {
+        const int row = std::min((int) (keypoints.GetY()[i] * kSpreadGridSize / sourceImage.rows),
+            kSpreadGridSize - 1);
+        const int col = std::min((int) (keypoints.GetX()[i] * kSpreadGridSize / sourceImage.cols),
+            kSpreadGridSize - 1);
+        cellCounts[row * kSpreadGridSize + col]++;
+      }
+
+      const double mean = (double) keypoints.Size() / cellCounts.size();
+      double variance = 0;
+      for (const double cellCount : cellCounts) {
+        variance += (cellCount - mean) * (cellCount - mean) / cellCounts.size();
+      }
+      spread += mean > 0 ? std::sqrt(variance) / mean : 0;
+      keypointCount += keypoints.Size();
+
+      // Tiles are computed apart, but every keypoint has to get its descriptor all the same.
+      cv::Mat gray, mask, histogram, tiledDescriptors, descriptors;
+      FramePreprocessor::Process(sourceImage, gray, mask, histogram);
+      std::vector<cv::KeyPoint> tiledKeypoints;
+      tiledExtractor.Detect(gray, mask, tiledKeypoints);
+      std::vector<cv::KeyPoint> wholeImageKeypoints = tiledKeypoints;
+      tiledExtractor.Compute(gray, tiledKeypoints, tiledDescriptors);
+      detector->compute(gray, wholeImageKeypoints, descriptors);
+      tiledDescriptorCount += tiledDescriptors.rows;
+      descriptorCount += descriptors.rows;
+    }
+
+    if (imageCount == 0) {
+      return;
+    }
+
+    fprintf(stderr, "Benchmark::MeasureTiledExtraction(%ux%u tiles) %u image(s), %f ms, %f keypoints per image, "
+        "spread %f.\n", gridSize, gridSize, imageCount, extractionTime.count() / imageCount,
+        (double) keypointCount / imageCount, spread / imageCount);
+    fprintf(stderr, "Benchmark::MeasureTiledExtraction(%ux%u tiles) computed %lu descriptor(s) of detected keypoints, "
+        "%lu over the whole image.\n", gridSize, gridSize, tiledDescriptorCount, descriptorCount);
+  }
+}
+
+/*static*/ void Benchmark::MeasureAnytimeIdentification(const ImageMatcher &aMatcher,
+    const std::vector<std::string> &aSourceImagePaths) {
+  // Source image of every item, blurred so that the query isn't identical to what's in the DB, and the item's id.
+  std::vector<std::pair<cv::Mat, std::string>> queries = LoadSourceImages(aMatcher, aSourceImagePaths);
+  if (queries.empty()) {
+    return;
+  }
+
+  for (auto &query : queries) {
+    cv::GaussianBlur(query.first, query.first, cv::Size(5, 5), 0);
+  }
+
+  TopMatchesOptions options;
+  options.mCertaintyScore = kIdentificationCertaintyScore;
+  options.mCertaintyMargin = kIdentificationCertaintyMargin;
+
+  ImageMatchingSettings settings = aMatcher.GetSettings();
+  for (const uint32_t firstStageFeatureCount : {0, 100, 200, 400}) {
+    settings.mProgressiveFeatureCount = firstStageFeatureCount;
+    const ImageMatcher matcher = CreateMatcher(aMatcher, settings);
+
+    // Per stage: number of queries that have reached it, have been answered at it and answered correctly, and times.
+    const size_t kMaxStageCount = 2;
+    uint32_t reachedCounts[kMaxStageCount] = {}, answeredCounts[kMaxStageCount] = {};
+    uint32_t correctCounts[kMaxStageCount] = {};
+    double extractionTimes[kMaxStageCount] = {}, matchingTimes[kMaxStageCount] = {};
+    uint32_t hitCount = 0, queryCount = 0;
+    double totalTime = 0;
+    for (const auto &query : queries) {
+      ImageDescription description;
+      std::vector<IdentificationStage> stages;
+      try {
+        const auto matches = matcher.Identify(query.first, 1, options, description, &stages);
+        if (!matches.empty() && std::get<1>(matches[0])->GetId() == query.second) {
+          hitCount++;
+        }
+      } catch (const ImageQualityException &e) {
+        continue;
+      }
+      queryCount++;
+
+      for (size_t stage = 0; stage < stages.size() && stage < kMaxStageCount; ++stage) {
+        reachedCounts[stage]++;
+        extractionTimes[stage] += stages[stage].mExtractionTime;
+        matchingTimes[stage] += stages[stage].mMatchingTime;
+        totalTime += stages[stage].mExtractionTime + stages[stage].mMatchingTime;
+      }
+
+      const IdentificationStage &lastStage = stages.back();
+      answeredCounts[stages.size() - 1]++;
+      if (lastStage.mBestMatch && lastStage.mBestMatch->GetId() == query.second) {
+        correctCounts[stages.size() - 1]++;
+      }
+    }
+
+    if (queryCount == 0) {
+      return;
+    }
+
+    fprintf(stderr, "Benchmark::MeasureAnytimeIdentification(%u first stage features) accuracy@1 %f (%u/%u), mean "
+        "latency %f ms.\n", firstStageFeatureCount, (float) hitCount / queryCount, hitCount, queryCount,
+        totalTime / queryCount);
+    for (size_t stage = 0; stage < kMaxStageCount; ++stage) {
+      if (reachedCounts[stage] == 0) {
+        continue;
+      }
+
+      fprintf(stderr, "Benchmark::MeasureAnytimeIdentification(%u first stage features) stage %lu: reached by %u, "
+          "answered %u (%u correctly), mean %f ms extraction + %f ms matching.\n", firstStageFeatureCount, stage,
+          reachedCounts[stage], answeredCounts[stage], correctCounts[stage],
+          extractionTimes[stage] / reachedCounts[stage], matchingTimes[stage] / reachedCounts[stage]);
+    }
+  }
+}
+
+/*static*/ void Benchmark::MeasureWorkingResolution(const ImageMatcher &aMatcher,
+    const std::vector<std::string> &aSourceImagePaths) {
+  const std::vector<std::pair<cv::Mat, std::string>> sourceImages = LoadSourceImages(aMatcher, aSourceImagePaths);
+  if (sourceImages.empty()) {
+    return;
+  }
+
+  // Queries are blurred source images, so that they aren't identical to what's in the DB.
+  std::vector<cv::Mat> queries(sourceImages.size());
+  for (size_t i = 0; i < sourceImages.size(); ++i) {
+    cv::GaussianBlur(sourceImages[i].first, queries[i], cv::Size(5, 5), 0);
+  }
+
+  TopMatchesOptions options;
+  options.mCertaintyScore = kIdentificationCertaintyScore;
+  options.mCertaintyMargin = kIdentificationCertaintyMargin;
+
+  ImageMatchingSettings settings = aMatcher.GetSettings();
+  settings.mWorkingMegapixels = 0;
+  // Max side, recall@1 and mean latency of every working resolution, full resolution (0) first.
+  std::vector<std::tuple<uint32_t, float, double>> results;
+  for (const uint32_t maxSide : {0, 1280, 960, 720, 640, 480, 320}) {
+    settings.mWorkingMaxSide = maxSide;
+    ImageMatcher matcher(settings);
+    matcher.SetVocabulary(*aMatcher.GetVocabulary());
+
+    // DB items are described again at this working resolution, under their own ids.
+    std::vector<ImageDescription> descriptions;
+    for (const auto &sourceImage : sourceImages) {
+      try {
+        const ImageDescription description = matcher.GetDescription(sourceImage.first);
+        descriptions.push_back(ImageDescription(sourceImage.second, description.GetKeypoints(),
+            description.GetDescriptorSet(), description.GetHistogram(), description.GetBowVector(),
+            description.GetScale()));
+      } catch (const ImageQualityException &e) {
+        continue;
+      }
+    }
+    matcher.AddToDB(descriptions);
+
+    uint32_t hitCount = 0;
+    std::chrono::duration<double, std::milli> time(0);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const auto start = std::chrono::high_resolution_clock::now();
+      ImageDescription description;
+      try {
+        const auto matches = matcher.Identify(queries[i], 1, options, description);
+        if (!matches.empty() && std::get<1>(matches[0])->GetId() == sourceImages[i].second) {
+          hitCount++;
+        }
+      } catch (const ImageQualityException &e) {
+        // Counts as a miss, it's what the user would get.
+      }
+      time += std::chrono::high_resolution_clock::now() - start;
+    }
+
+    const float recall = (float) hitCount / queries.size();
+    const double latency = time.count() / queries.size();
+    results.push_back(std::make_tuple(maxSide, recall, latency));
+    fprintf(stderr, "Benchmark::MeasureWorkingResolution(max side %u) recall@1 %f (%u/%lu), mean identification "
+        "latency %f ms.\n", maxSide, recall, hitCount, queries.size(), latency);
+  }
+
+  const float minRecall = std::get<1>(results[0]) - kWorkingResolutionRecallTolerance;
+  const std::tuple<uint32_t, float, double> *recommended = &results[0];
+  for (const auto &result : results) {
+    if (std::get<1>(result) >= minRecall && std::get<2>(result) < std::get<2>(*recommended)) {
+      recommended = &result;
+    }
+  }
+
+  fprintf(stderr, "Benchmark::MeasureWorkingResolution() recommended max side: %u (0 is full resolution), recall@1 %f, "
+      "mean identification latency %f ms.\n", std::get<0>(*recommended), std::get<1>(*recommended),
+      std::get<2>(*recommended));
+}
+
+/*static*/ void Benchmark::MeasurePrefixRecall(const ImageMatcher &aMatcher) {
+  const std::vector<ImageDescriptionPtr> descriptions = aMatcher.GetDescriptions();
+  if (descriptions.size() < 2) {
+    return;
+  }
+
+  DescriptorArena arena;
+  std::vector<ImageDescription> queries;
+  for (const ImageDescriptionPtr &description : descriptions) {
+    arena.Add(description->GetId(), description->GetDescriptorSet());
+    queries.push_back(MakeQuery(*description, 2, kQueryFlippedBitCount));
+  }
+
+  const float ratioTestK = aMatcher.GetSettings().mRatioTestK;
+  for (const uint32_t prefixLength : {25, 50, 100, 200, 400, 0}) {
+    uint32_t topHitCount = 0, shortlistHitCount = 0;
+    std::chrono::duration<double, std::milli> time(0);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const auto start = std::chrono::high_resolution_clock::now();
+      const CandidateMatches candidates = arena.KnnMatch(queries[i].GetDescriptors(), nullptr, prefixLength);
+
+      // Coarse score is the number of matches that pass the ratio test, ties are ranked against the true item.
+      std::vector<std::pair<uint32_t, std::string>> scores;
+      for (size_t slot = 0; slot < candidates.Size(); ++slot) {
+        scores.push_back(std::make_pair(candidates.CountGoodMatches(slot, ratioTestK),
+            arena.GetItemId(candidates.GetItem(slot))));
+      }
+      time += std::chrono::high_resolution_clock::now() - start;
+
+      uint32_t trueScore = 0;
+      for (const auto &score : scores) {
+        if (score.second == descriptions[i]->GetId()) {
+          trueScore = score.first;
+        }
+      }
+
+      uint32_t rank = 0;
+      for (const auto &score : scores) {
+        if (score.second != descriptions[i]->GetId() && score.first >= trueScore) {
+          rank++;
+        }
+      }
+
+      topHitCount += rank == 0 ? 1 : 0;
+      shortlistHitCount += rank < kCoarseShortlistSize ? 1 : 0;
+    }
+
+    fprintf(stderr, "Benchmark::MeasurePrefixRecall(%u strongest descriptors per item) recall@1 %f (%u/%lu), recall@%u "
+        "%f (%u/%lu), mean coarse pass %f ms.\n", prefixLength, (float) topHitCount / queries.size(), topHitCount,
+        queries.size(), kCoarseShortlistSize, (float) shortlistHitCount / queries.size(), shortlistHitCount,
+        queries.size(), time.count() / queries.size());
+  }
+}
+
+/*static*/ void Benchmark::MeasureKeypointStorage(const ImageMatcher &aMatcher) {
+  const std::vector<ImageDescriptionPtr> descriptions = aMatcher.GetDescriptions();
+  if (descriptions.empty()) {
+    return;
+  }
+
+  uint64_t keypointCount = 0, descriptorBytes = 0;
+  uint64_t keypointMemory = 0, compactMemory = 0, keypointDiskSize = 0, compactDiskSize = 0;
+  for (const ImageDescriptionPtr &description : descriptions) {
+    const KeypointSet &keypoints = description->GetKeypoints();
+    const std::vector<cv::KeyPoint> legacyKeypoints = keypoints.ToKeypoints();
+
+    std::ostringstream legacyStream, compactStream;
+    {
+      cereal::BinaryOutputArchive legacyArchive(legacyStream);
+      legacyArchive(legacyKeypoints);
+      cereal::BinaryOutputArchive compactArchive(compactStream);
+      compactArchive(keypoints);
+    }
+
+    keypointCount += keypoints.Size();
+    descriptorBytes += description->GetDescriptors().total() * description->GetDescriptors().elemSize();
+    keypointMemory += legacyKeypoints.size() * sizeof(cv::KeyPoint);
+    compactMemory += keypoints.GetByteSize();
+    keypointDiskSize += legacyStream.str().size();
+    compactDiskSize += compactStream.str().size();
+  }
+
+  const double itemCount = descriptions.size();
+  fprintf(stderr, "Benchmark::MeasureKeypointStorage() %lu item(s), %f keypoint(s) per item: cv::KeyPoint %f KB in "
+      "memory / %f KB on disk per item, KeypointSet %f KB / %f KB (%f%% / %f%%), descriptors %f KB per item.\n",
+      descriptions.size(), keypointCount / itemCount, keypointMemory / 1024.0 / itemCount,
+      keypointDiskSize / 1024.0 / itemCount, compactMemory / 1024.0 / itemCount, compactDiskSize / 1024.0 / itemCount,
+      keypointMemory > 0 ? 100.0 * compactMemory / keypointMemory : 0,
+      keypointDiskSize > 0 ? 100.0 * compactDiskSize / keypointDiskSize : 0, descriptorBytes / 1024.0 / itemCount);
+}
+
+/*static*/ void Benchmark::MeasureColorHistogram(const std::vector<std::string> &aSourceImagePaths) {
+  const auto kernels = ColorHistogram::GetSupportedKernels();
+
+  uint32_t imageCount = 0;
+  std::chrono::duration<double, std::milli> referenceTime(0);
+  std::vector<std::chrono::duration<double, std::milli>> kernelTimes(kernels.size());
+  std::vector<double> kernelErrors(kernels.size(), 0);
+  for (const std::string &sourceImagePath : aSourceImagePaths) {
+    const cv::Mat frame = cv::imread(sourceImagePath, cv::IMREAD_UNCHANGED);
+    if (frame.empty() || frame.type() != CV_8UC4) {
+      continue;
+    }
+
+    cv::Mat referenceHistogram;
+    {
+      const auto start = std::chrono::high_resolution_clock::now();
+
+      std::vector<cv::Mat> bgraChannels(4);
+      cv::split(frame, bgraChannels);
+
+      const int channels[] = {0, 1, 2};
+      const int histogramSize[] = {ColorHistogram::kBins, ColorHistogram::kBins, ColorHistogram::kBins};
+      float colorRange[] = {0, 256};
+      const float *ranges[] = {colorRange, colorRange, colorRange};
+      cv::calcHist(&frame, 1, channels, bgraChannels[3], referenceHistogram, 3, histogramSize, ranges);
+      cv::normalize(referenceHistogram, referenceHistogram);
+
+      referenceTime += std::chrono::high_resolution_clock::now() - start;
+    }
+
+    for (size_t kernel = 0; kernel < kernels.size(); ++kernel) {
+      cv::Mat histogram;
+      const auto start = std::chrono::high_resolution_clock::now();
+      ColorHistogram::Compute(frame, histogram, kernels[kernel].second);
+      kernelTimes[kernel] += std::chrono::high_resolution_clock::now() - start;
+
+      kernelErrors[kernel] = std::max(kernelErrors[kernel], cv::norm(referenceHistogram, histogram, cv::NORM_INF));
+    }
+    imageCount++;
+  }
+
+  if (imageCount == 0) {
+    return;
+  }
+
+  fprintf(stderr, "Benchmark::MeasureColorHistogram() %u image(s), calcHist + normalize: %f ms per image.\n",
+      imageCount, referenceTime.count() / imageCount);
+  for (size_t kernel = 0; kernel < kernels.size(); ++kernel) {
+    fprintf(stderr, "Benchmark::MeasureColorHistogram() %s kernel: %f ms per image, max difference %g.\n",
+        kernels[kernel].first.c_str(), kernelTimes[kernel].count() / imageCount, kernelErrors[kernel]);
+  }
+}
+
+/*static*/ void Benchmark::MeasureFramePreprocessing(const std::vector<std::string> &aSourceImagePaths) {
+  uint32_t imageCount = 0, mismatchCount = 0;
+  uint64_t splitAllocationCount = 0, splitAllocatedBytes = 0, fusedAllocationCount = 0, fusedAllocatedBytes = 0;
+  std::chrono::duration<double, std::milli> splitTime(0), fusedTime(0);
+  for (const std::string &sourceImagePath : aSourceImagePaths) {
+    const cv::Mat frame = cv::imread(sourceImagePath, cv::IMREAD_UNCHANGED);
+    if (frame.empty() || frame.type() != CV_8UC4) {
+      continue;
+    }
+
+    cv::Mat splitGray, splitMask, splitHistogram;
+    {
+      const CountingMatAllocator allocator;
+      const auto start = std::chrono::high_resolution_clock::now();
+
+      std::vector<cv::Mat> bgraChannels(4);
+      cv::split(frame, bgraChannels);
+      splitMask = bgraChannels[3];
+
+      const int channels[] = {0, 1, 2};
+      const int histogramSize[] = {8, 8, 8};
+      float colorRange[] = {0, 256};
+      const float *ranges[] = {colorRange, colorRange, colorRange};
+      cv::calcHist(&frame, 1, channels, splitMask, splitHistogram, 3, histogramSize, ranges);
+      cv::normalize(splitHistogram, splitHistogram);
+
+      // That's what ORB does with a color image before anything else.
+      cv::cvtColor(frame, splitGray, cv::COLOR_BGR2GRAY);
+
+      splitTime += std::chrono::high_resolution_clock::now() - start;
+      splitAllocationCount += allocator.GetAllocationCount();
+      splitAllocatedBytes += allocator.GetAllocatedBytes();
+    }
+
+    cv::Mat fusedGray, fusedMask, fusedHistogram;
+    {
+      const CountingMatAllocator allocator;
+      const auto start = std::chrono::high_resolution_clock::now();
+
+      FramePreprocessor::Process(frame, fusedGray, fusedMask, fusedHistogram);
+
+      fusedTime += std::chrono::high_resolution_clock::now() - start;
+      fusedAllocationCount += allocator.GetAllocationCount();
+      fusedAllocatedBytes += allocator.GetAllocatedBytes();
+    }
+
+    if (cv::norm(splitGray, fusedGray, cv::NORM_INF) != 0 || cv::norm(splitMask, fusedMask, cv::NORM_INF) != 0 ||
+        cv::norm(splitHistogram, fusedHistogram, cv::NORM_INF) > 1e-6) {
+      mismatchCount++;
+    }
+    imageCount++;
+  }
+
+  if (imageCount == 0) {
+    return;
+  }
+
+  fprintf(stderr, "Benchmark::MeasureFramePreprocessing() %u image(s), %u mismatch(es): split %f ms, %f allocation(s), "
+      "%f KB per image; fused %f ms, %f allocation(s), %f KB per image.\n", imageCount, mismatchCount,
+      splitTime.count() / imageCount, (double) splitAllocationCount / imageCount,
+      splitAllocatedBytes / 1024.0 / imageCount, fusedTime.count() / imageCount,
+      (double) fusedAllocationCount / imageCount, fusedAllocatedBytes / 1024.0 / imageCount);
+}
+
+/*static*/ ImageDescription Benchmark::KeepStrongestFeatures(const ImageDescription &aDescription, uint32_t aCount) {
+  const KeypointSet &keypoints = aDescription.GetKeypoints();
+  if (keypoints.Size() <= aCount || keypoints.Size() != (size_t) aDescription.GetDescriptors().rows) {
+    return aDescription;
+  }
+
+  // Features are ordered by response, so the strongest ones are the first ones.
+  return ImageDescription(aDescription.GetId(), keypoints.Head(aCount), aDescription.GetDescriptorSet().Head(aCount),
+      aDescription.GetHistogram(), BowVector(), aDescription.GetScale(), aDescription.GetStorage());
+}
+
+/*static*/ ImageMatcher Benchmark::CreateMatcher(const ImageMatcher &aMatcher, const ImageMatchingSettings &aSettings) {
+  ImageMatcher matcher(aSettings);
+  matcher.SetVocabulary(*aMatcher.GetVocabulary());
+  std::vector<ImageDescription> descriptions;
+  for (const ImageDescriptionPtr &description : aMatcher.GetDescriptions()) {
+    descriptions.push_back(*description);
+  }
+  matcher.AddToDB(descriptions);
+
+  return matcher;
+}
+
+/*static*/ ImageDescription Benchmark::MakeQuery(const ImageDescription &aDescription, uint32_t aStep,
+    uint32_t aFlippedBitCount) {
+  std::mt19937 generator(aDescription.GetKeypoints().Size());
+  KeypointSet keypoints;
+  OrbDescriptorSet descriptors;
+  for (size_t i = 0; i < aDescription.GetKeypoints().Size(); i += aStep) {
+    descriptors.PushBack(aDescription.GetDescriptorSet().GetRow(i));
+    FlipRandomBits(descriptors.GetRow(descriptors.Size() - 1), DescriptorArena::kDescriptorBytes, aFlippedBitCount,
+        generator);
+
+    keypoints.PushBack(aDescription.GetKeypoints(), i);
+  }
+
+  return ImageDescription("query-" + aDescription.GetId(), keypoints, descriptors, aDescription.GetHistogram(),
+      BowVector(), aDescription.GetScale(), aDescription.GetStorage());
+}
+
+} // namespace lighthouse
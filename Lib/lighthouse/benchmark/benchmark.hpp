@@ -0,0 +1,112 @@
+//
+//  benchmark.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef benchmark_hpp
+#define benchmark_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "image_matcher.hpp"
+
+namespace lighthouse {
+
+// Developer-only measurements of matching strategies over the items that are currently in the DB. Results are printed
+// to stderr, nothing here is used during normal app operation.
+class Benchmark {
+public:
+  // Runs all benchmarks against the items in the matcher's DB. Source images of the items (missing ones are skipped)
+  // are used to measure feature extraction. Returns false if any correctness check (see `CheckHammingKernels`) has
+  // failed, measurements are taken anyway.
+  static bool Run(const ImageMatcher &aMatcher, const std::vector<std::string> &aSourceImagePaths);
+
+  // Builds a query out of every `aStep`-th descriptor of every DB item (so that the query is a partial, noisier view of
+  // the item) and compares top match and latency of `aMatcher.FindMatches` against `aMatcher.FindMatchesExhaustive`.
+  static void CompareWithExhaustive(const std::string &aName, const ImageMatcher &aMatcher, uint32_t aStep = 2);
+
+  // Compares every Hamming kernel the CPU supports with `cv::BFMatcher(cv::NORM_HAMMING).knnMatch(..., 2)` on pairs of
+  // DB items and reports distances that differ and nearest neighbours that differ without being a tie. Returns false if
+  // any kernel has such a mismatch, ties resolved differently aren't failures.
+  static bool CheckHammingKernels(const ImageMatcher &aMatcher);
+
+  // Measures throughput of every Hamming kernel the CPU supports and of `cv::BFMatcher` matching descriptors of the
+  // first DB item against descriptors of all DB items.
+  static void MeasureHammingKernels(const ImageMatcher &aMatcher);
+
+  // Measures mean `FindMatches` latency for 1, 2, 4, ... threads up to the number of cores and checks that results are
+  // the same as with a single thread.
+  static void MeasureThreadScaling(const ImageMatcher &aMatcher);
+
+  // Compares latency and top match of `FindTopMatches` with early exit and the recent matches prior against
+  // `FindMatches`. Every query is run twice in a row, as if the user kept pointing the camera at the same object.
+  static void MeasureTopMatches(const ImageMatcher &aMatcher, float aCertaintyScore, float aCertaintyMargin);
+
+  // Compares recall@1 and mean `FindMatches` latency of every matcher backend against the exact one on synthetic DBs of
+  // the specified sizes (see `MakeSyntheticDB`). Queries are partial views of the real DB items.
+  static void CompareBackends(const ImageMatcher &aMatcher, const std::vector<uint32_t> &aDBSizes);
+
+  // Returns `aSize` descriptions: real DB items first, then as many distractors as needed. Every distractor is a subset
+  // of descriptors of a real item with random bits flipped, so it looks like a real item without matching it.
+  static std::vector<ImageDescription> MakeSyntheticDB(const ImageMatcher &aMatcher, uint32_t aSize);
+
+  // Measures end-to-end identification latency (feature extraction on the source images plus `FindMatches`) and
+  // accuracy@1 with 1000 and 500 features, with and without geometric verification. Fewer features are simulated by
+  // keeping only the strongest ones of every DB item, queries are noisy partial views of the items.
+  static void MeasureVerification(const ImageMatcher &aMatcher, const std::vector<std::string> &aSourceImagePaths);
+
+  // Extracts features from the source images with 1 to 4 tiles per side and reports mean extraction time, number of
+  // keypoints and how evenly they are spread (coefficient of variation of keypoint counts over an 8x8 grid). Also
+  // reports how many descriptors of the detected keypoints are computed tile by tile and how many ORB computes over the
+  // whole image, they should be the same.
+  static void MeasureTiledExtraction(const ImageMatcher &aMatcher, const std::vector<std::string> &aSourceImagePaths);
+
+  // Identifies blurred source images of the DB items with the first stage of anytime identification disabled and with
+  // several first stage feature counts, and reports accuracy and latency of every stage: how many queries have reached
+  // it, how many have been answered there and how many of those correctly.
+  static void MeasureAnytimeIdentification(const ImageMatcher &aMatcher,
+      const std::vector<std::string> &aSourceImagePaths);
+
+  // Identifies blurred source images of the DB items against the items described again at several working resolutions
+  // (longer side of 1280, 960, ... px, or full resolution) and reports recall@1 and mean identification latency of
+  // every one, and recommends the fastest one that's nearly as accurate as full resolution.
+  static void MeasureWorkingResolution(const ImageMatcher &aMatcher, const std::vector<std::string> &aSourceImagePaths);
+
+  // Matches noisy partial views of the DB items against only the strongest 25, 50, ... descriptors of every item (0
+  // stands for all of them) and reports how often the true item is the best one of such a coarse pass and how often
+  // it's among the best few, along with the time the pass takes.
+  static void MeasurePrefixRecall(const ImageMatcher &aMatcher);
+
+  // Compares memory and serialized size of the DB items' keypoints stored as `KeypointSet` with what they'd take as
+  // `cv::KeyPoint`s, per item.
+  static void MeasureKeypointStorage(const ImageMatcher &aMatcher);
+
+  // Compares every supported `ColorHistogram` kernel with `cv::calcHist` masked by the alpha channel and
+  // `cv::normalize` on the source images: reports timings and max differences.
+  static void MeasureColorHistogram(const std::vector<std::string> &aSourceImagePaths);
+
+  // Compares `FramePreprocessor` with what feature extraction used to do with a BGRA frame (split it into channels for
+  // the mask, calculate and normalize the histogram, let ORB convert the frame to grayscale) on the source images:
+  // checks that results are the same and reports timings and `cv::Mat` allocations of both.
+  static void MeasureFramePreprocessing(const std::vector<std::string> &aSourceImagePaths);
+
+  // Returns description with only `aCount` keypoints/descriptors with the strongest response.
+  static ImageDescription KeepStrongestFeatures(const ImageDescription &aDescription, uint32_t aCount);
+
+  // Creates a new matcher with the specified settings and the same vocabulary and DB as `aMatcher`.
+  static ImageMatcher CreateMatcher(const ImageMatcher &aMatcher, const ImageMatchingSettings &aSettings);
+
+  // Returns query description built out of every `aStep`-th keypoint/descriptor of the description, with
+  // `aFlippedBitCount` random (but the same for every run) bits flipped in every descriptor.
+  static ImageDescription MakeQuery(const ImageDescription &aDescription, uint32_t aStep,
+      uint32_t aFlippedBitCount = 0);
+};
+
+} // namespace lighthouse
+
+#endif /* benchmark_hpp */
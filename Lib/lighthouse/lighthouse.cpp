@@ -6,6 +6,15 @@
 //  Copyright © 2016 Lighthouse. All rights reserved.
 //
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <unordered_set>
+
+#include "benchmark.hpp"
+#include "color_histogram.hpp"
+#include "description_database.hpp"
+#include "feature_tracker.hpp"
 #include "feedback.hpp"
 #include "filesystem.hpp"
 #include "lighthouse.hpp"
@@ -14,34 +23,43 @@
 
 namespace lighthouse {
 
-Lighthouse::Lighthouse(ImageMatchingSettings aImageMatchingSettings)
+namespace {
+
+// Returns the whole frame the image is a view into (e.g. the object crop `Camera` captures), nothing is copied.
+cv::Mat GetWholeFrame(const cv::Mat &aImage) {
+  cv::Size frameSize;
+  cv::Point offset;
+  aImage.locateROI(frameSize, offset);
+
+  cv::Mat frame = aImage;
+  frame.adjustROI(offset.y, frameSize.height - offset.y - aImage.rows, offset.x,
+      frameSize.width - offset.x - aImage.cols);
+  return frame;
+}
+
+} // namespace
+
+Lighthouse::Lighthouse(ImageMatchingSettings aImageMatchingSettings, EarlyQueryPolicy aEarlyQueryPolicy)
     : mImageMatcher(ImageMatcher(aImageMatchingSettings)),
+      mIdentificationOptions(),
       mCamera(),
       mDbFolderPath(),
-      mVideoThread() {
+      mVideoThread(),
+      mEarlyQueryPolicy(aEarlyQueryPolicy),
+      mDatabaseLoaded(),
+      mStartTime(std::chrono::high_resolution_clock::now()) {
   // Create Data directory if it doesn't exist.
   mDbFolderPath = Filesystem::GetRoot() + "/Data/";
   Filesystem::CreateDirectory(mDbFolderPath);
 
   fprintf(stderr, "Lighthouse::Lighthouse() data folder is at %s.\n", mDbFolderPath.c_str());
 
-  // Iterate through all sub folders, every folder should contain the following files:
-  // 1. description.bin - binary serialized image description (keypoints, descriptors, histogram etc.);
-  // 2. image.png - source image. Optional, can be disabled;
-  // 3. voice-label.aiff - voice label.
-  std::vector<std::string> subFolders = Filesystem::GetSubFolders(mDbFolderPath);
-  for (std::string descriptionFolderPath : subFolders) {
-    try {
-      const ImageDescription description = ImageDescription::Load(
-          descriptionFolderPath + GetDescriptionAssetName(ImageDescriptionAsset::Data));
-      mImageMatcher.AddToDB(description);
-    } catch (const cereal::Exception &e) {
-      fprintf(stderr, "Lighthouse::Lighthouse() couldn't deserialize description at %s (reason: %s). Skipping...\n",
-          descriptionFolderPath.c_str(), e.what());
-    }
-  }
+  mIdentificationOptions.mCertaintyScore = kIdentificationCertaintyScore;
+  mIdentificationOptions.mCertaintyMargin = kIdentificationCertaintyMargin;
+  mIdentificationOptions.mPrior = std::make_shared<RecentMatchesPrior>(kRecentMatchesCount);
 
-  fprintf(stderr, "Lighthouse::Lighthouse() loaded %lu image description(s).\n", subFolders.size());
+  // DB is loaded in the background, so that it doesn't hold the app launch up. Event loop may need it right away.
+  mDatabaseLoaded = std::async(std::launch::async, &Lighthouse::LoadDatabase, this).share();
 
   // Start event loop.
   std::thread thread(Lighthouse::AuxRunEventLoop, this);
@@ -52,16 +70,20 @@ Lighthouse::~Lighthouse() {
   StopRecord();
   SendMessage(Task::STOP);
   mVideoThread.join();
+  mDatabaseLoaded.wait();
+  if (mCompaction.valid()) {
+    mCompaction.wait();
+  }
 }
 
 void Lighthouse::DrawKeypoints(const cv::Mat &aInputFrame, cv::Mat &aOutputFrame) {
   ImageDescription description = mImageMatcher.GetDescription(aInputFrame);
 
-  // We can't draw keypoints on the BGRA image.
+  // We can't draw keypoints on the BGRA image. Keypoints are in the coordinates of the whole frame.
   cv::Mat bgrInputFrame;
-  cvtColor(aInputFrame, bgrInputFrame, cv::COLOR_BGRA2BGR);
+  cvtColor(GetWholeFrame(aInputFrame), bgrInputFrame, cv::COLOR_BGRA2BGR);
 
-  cv::drawKeypoints(bgrInputFrame, description.GetKeypoints(), aOutputFrame, cv::Scalar::all(-1),
+  cv::drawKeypoints(bgrInputFrame, description.GetSourceKeypoints(), aOutputFrame, cv::Scalar::all(-1),
       cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
 }
 
@@ -69,7 +91,9 @@ ImageDescription Lighthouse::GetDescription(const cv::Mat &aInputFrame) const {
   return mImageMatcher.GetDescription(aInputFrame);
 }
 
-const ImageDescription &Lighthouse::GetDescription(const std::string &aId) const {
+ImageDescriptionPtr Lighthouse::GetDescription(const std::string &aId) const {
+  // Item that hasn't been loaded yet isn't missing.
+  WaitForDatabase(false);
   return mImageMatcher.GetDescription(aId);
 }
 
@@ -100,25 +124,48 @@ void Lighthouse::SaveDescription(const ImageDescription &aDescription, const cv:
 
   RecordVoiceLabel(aDescription);
 
-  // Save image description itself.
-  ImageDescription::Save(aDescription, GetDescriptionAssetPath(aDescription.GetId(), ImageDescriptionAsset::Data));
+  // Save source image for the later use (eg. display matches, but it isn't needed for matching). Keypoints are in the
+  // coordinates of the whole frame, so that's what is saved even if the description has been made of a crop.
+  cv::imwrite(GetDescriptionAssetPath(aDescription.GetId(), ImageDescriptionAsset::SourceImage),
+      GetWholeFrame(aSourceImage), {CV_IMWRITE_PNG_COMPRESSION, 9 /* compression level, from 0 to 9 */});
+
+  // Save image description itself. Its journal record is what makes the item recorded, so it's written last: if
+  // anything fails before, there is only an item folder nobody refers to. Journal is opened once the DB is loaded.
+  WaitForDatabase(false);
   mImageMatcher.AddToDB(aDescription);
+  bool isJournaled = false;
+  if (mJournal) {
+    try {
+      mJournal->Append(aDescription);
+      isJournaled = true;
+    } catch (const std::runtime_error &e) {
+      fprintf(stderr, "Lighthouse::SaveDescription() couldn't journal description (reason: %s).\n", e.what());
+    }
+  }
 
-  // Save source image for the later use (eg. display matches, but it isn't needed for matching).
-  cv::imwrite(GetDescriptionAssetPath(aDescription.GetId(), ImageDescriptionAsset::SourceImage), aSourceImage,
-      {CV_IMWRITE_PNG_COMPRESSION, 9 /* compression level, from 0 to 9 */});
+  if (!isJournaled) {
+    SaveDatabase();
+  } else if (mJournal->GetRecordCount() >= kJournalCompactionRecordCount &&
+      (!mCompaction.valid() || mCompaction.wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+    // Journal is folded into the DB in the background, items can be recorded meanwhile.
+    mCompaction = std::async(std::launch::async, &Lighthouse::SaveDatabase, this);
+  }
 
   // FIXME: Should it be called from UI instead?
   // Notify user about successfully registered image and re-play voice label once again.
   Feedback::PlaySoundNamed("registered");
 }
 
-std::vector<std::tuple<float, ImageDescription>> Lighthouse::FindMatches(const cv::Mat &aInputFrame) const {
+std::vector<std::tuple<float, ImageDescriptionPtr>> Lighthouse::FindMatches(const cv::Mat &aInputFrame) const {
   return FindMatches(GetDescription(aInputFrame));
 }
 
-std::vector<std::tuple<float, ImageDescription>> Lighthouse::FindMatches(const ImageDescription &aDescription) const {
-  return mImageMatcher.FindMatches(aDescription);
+std::vector<std::tuple<float, ImageDescriptionPtr>> Lighthouse::FindMatches(
+    const ImageDescription &aDescription) const {
+  WaitForDatabase(true);
+  const std::vector<std::tuple<float, ImageDescriptionPtr>> matches = mImageMatcher.FindMatches(aDescription);
+  ReportIdentification();
+  return matches;
 }
 
 void Lighthouse::OnRecordObject() {
@@ -129,10 +176,28 @@ void Lighthouse::OnIdentifyObject() {
   SendMessage(Task::IDENTIFY);
 }
 
+void Lighthouse::OnTrackObjects() {
+  SendMessage(Task::TRACK);
+}
+
 void Lighthouse::StopRecord() {
   SendMessage(Task::WAIT);
 }
 
+void Lighthouse::OnMemoryWarning() {
+  const PayloadCacheStats stats = mImageMatcher.GetPayloadCacheStats();
+  mImageMatcher.ReleasePayloads();
+  fprintf(stderr, "Lighthouse::OnMemoryWarning() released %lu byte(s) of DB item payloads.\n", stats.mResidentBytes);
+}
+
+void Lighthouse::OnTrainVocabulary() {
+  SendMessage(Task::TRAIN_VOCABULARY);
+}
+
+void Lighthouse::OnRunBenchmarks() {
+  SendMessage(Task::BENCHMARK);
+}
+
 void Lighthouse::SendMessage(lighthouse::Task aMessage) {
   int message = (int) aMessage;
   fprintf(stderr, "Lighthouse::SendMessage(%d) to loop\n", message);
@@ -157,10 +222,14 @@ void Lighthouse::RunIdentifyObject() {
     return;
   }
 
-  // Extract comparison points.
+  // Extract comparison points and compare with existing images, we only need the best match. The strongest points are
+  // tried first, the rest only if they aren't enough to be sure.
   ImageDescription sourceDescription;
+  std::vector<std::tuple<float, ImageDescriptionPtr>> matches;
+  WaitForDatabase(true);
   try {
-    sourceDescription = GetDescription(sourceImage);
+    matches = mImageMatcher.Identify(sourceImage, 1, mIdentificationOptions, sourceDescription);
+    ReportIdentification();
   } catch (ImageQualityException e) {
     fprintf(stderr, "Lighthouse::RunIdentifyObject() encountered an error: %s\n", e.what());
     Feedback::PlaySoundNamed("nothing-recognized");
@@ -168,16 +237,13 @@ void Lighthouse::RunIdentifyObject() {
     return; // FIXME: Report actual error.
   }
 
-  // Compare with existing images.
-  std::vector<std::tuple<float, ImageDescription>> matches = FindMatches(sourceDescription);
-
   if (matches.empty()) {
     Feedback::PlaySoundNamed("no-item");
     // FIXME: Display something.
     return;
   }
 
-  ImageDescription matchedDescription = std::get<1>(matches[0]);
+  const ImageDescription &matchedDescription = *std::get<1>(matches[0]);
 
   PlayVoiceLabel(matchedDescription);
 
@@ -191,14 +257,54 @@ void Lighthouse::RunIdentifyObject() {
       ImageDescriptionAsset::SourceImage));
 
   // When DrawMatches creates cv::Mat by itself it uses only 3 channels, so BGRA images are not supported, so we
-  // should convert source image to BGR and matched image is read in BGR by default.
-  cv::cvtColor(sourceImage, sourceImage, cv::COLOR_BGRA2BGR);
+  // should convert source image to BGR and matched image is read in BGR by default. Source image is the object crop,
+  // keypoints are drawn over the whole frame.
+  cv::cvtColor(GetWholeFrame(sourceImage), sourceImage, cv::COLOR_BGRA2BGR);
 
   cv::Mat imageWithMatch;
-  cv::drawMatches(sourceImage, sourceDescription.GetKeypoints(), matchedImage, matchedDescription.GetKeypoints(),
-      goodMatches, imageWithMatch);
+  cv::drawMatches(sourceImage, sourceDescription.GetSourceKeypoints(), matchedImage,
+      matchedDescription.GetSourceKeypoints(), goodMatches, imageWithMatch);
 
   Feedback::ReceivedFrame("match", imageWithMatch);
+
+  const PayloadCacheStats stats = mImageMatcher.GetPayloadCacheStats();
+  fprintf(stderr, "Lighthouse::RunIdentifyObject() payload cache hit rate is %f (%llu hit(s), %llu miss(es), %llu "
+      "eviction(s), %lu byte(s) resident).\n", stats.GetHitRate(), stats.mHitCount, stats.mMissCount,
+      stats.mEvictionCount, stats.mResidentBytes);
+}
+
+void Lighthouse::RunTrackObjects() {
+  assert(std::this_thread::get_id() == mVideoThreadId);
+
+  WaitForDatabase(true);
+  FeatureTracker tracker(mImageMatcher, mIdentificationOptions, kTrackingMinCoverage, kTrackingRequeryCoverage);
+  std::string matchedId;
+  // Start streaming. `mCamera` is in charge of stopping itself if `mTask` stops being `Task::TRACK`.
+  const bool isCaptured = mCamera.CaptureForTracking(&mTask, [this, &tracker, &matchedId](const cv::Mat &aFrame) {
+    const TrackingUpdate update = tracker.Process(aFrame);
+    if (update.mIsQueried) {
+      ReportIdentification();
+    }
+
+    if (update.mIsDetected) {
+      fprintf(stderr, "Lighthouse::RunTrackObjects() %s %u keypoint(s) in %f ms.\n",
+          update.mIsQueried ? "detected and queried" : "detected", update.mTrackedCount, update.mTime);
+    }
+
+    // Voice label is played only when a different object comes into view.
+    const std::string id = update.mMatch ? update.mMatch->GetId() : std::string();
+    if (id != matchedId) {
+      matchedId = id;
+      if (update.mMatch) {
+        PlayVoiceLabel(*update.mMatch);
+      }
+    }
+  });
+
+  if (!isCaptured) {
+    // FIXME: Somehow report error.
+    return;
+  }
 }
 
 void Lighthouse::RunRecordObject() {
@@ -226,6 +332,45 @@ void Lighthouse::RunRecordObject() {
   Feedback::OnItemRecorded(sourceDescription.GetId());
 }
 
+void Lighthouse::RunTrainVocabulary() {
+  assert(std::this_thread::get_id() == mVideoThreadId);
+  WaitForDatabase(false);
+
+  // Descriptor matrices are views into the descriptions, which have to outlive the training.
+  const std::vector<ImageDescriptionPtr> descriptions = mImageMatcher.GetDescriptions();
+  std::vector<cv::Mat> descriptors;
+  for (const ImageDescriptionPtr &description : descriptions) {
+    descriptors.push_back(description->GetDescriptors());
+  }
+
+  const Vocabulary vocabulary = Vocabulary::Train(descriptors, kVocabularyBranchingFactor, kVocabularyDepth);
+  try {
+    Vocabulary::Save(vocabulary, GetVocabularyPath());
+  } catch (const std::runtime_error &e) {
+    // It's still used until the app is restarted.
+    fprintf(stderr, "Lighthouse::RunTrainVocabulary() couldn't save vocabulary (reason: %s).\n", e.what());
+  }
+  mImageMatcher.SetVocabulary(vocabulary);
+
+  // Persist bag-of-words vectors, otherwise they'd be re-computed at every start.
+  SaveDatabase();
+}
+
+void Lighthouse::RunBenchmarks() {
+  assert(std::this_thread::get_id() == mVideoThreadId);
+  WaitForDatabase(false);
+
+  std::vector<std::string> sourceImagePaths;
+  for (const ImageDescriptionPtr &description : mImageMatcher.GetDescriptions()) {
+    sourceImagePaths.push_back(GetDescriptionAssetPath(description->GetId(), ImageDescriptionAsset::SourceImage));
+  }
+
+  if (!Benchmark::Run(mImageMatcher, sourceImagePaths)) {
+    fprintf(stderr, "Lighthouse::RunBenchmarks() correctness checks have failed.\n");
+    Feedback::ShowLabel("Benchmark correctness checks have failed!");
+  }
+}
+
 void Lighthouse::RunEventLoop() {
   mVideoThreadId = std::this_thread::get_id();
   // Stamp of the latest message received.
@@ -257,6 +402,18 @@ void Lighthouse::RunEventLoop() {
         RunIdentifyObject();
         Feedback::OperationComplete();
         continue;
+      case (int) Task::TRACK:
+        RunTrackObjects();
+        Feedback::OperationComplete();
+        continue;
+      case (int) Task::TRAIN_VOCABULARY:
+        RunTrainVocabulary();
+        Feedback::OperationComplete();
+        continue;
+      case (int) Task::BENCHMARK:
+        RunBenchmarks();
+        Feedback::OperationComplete();
+        continue;
       case (int) Task::STOP:
         // We're done with the loop.
         return;
@@ -267,6 +424,328 @@ void Lighthouse::RunEventLoop() {
   }
 }
 
+void Lighthouse::LoadDatabase() {
+  const auto start = std::chrono::high_resolution_clock::now();
+
+  // Vocabulary is optional and should be loaded before descriptions, so that they are added to the inverted file.
+  if (std::ifstream(GetVocabularyPath()).good()) {
+    try {
+      mImageMatcher.SetVocabulary(Vocabulary::Load(GetVocabularyPath()));
+      fprintf(stderr, "Lighthouse::LoadDatabase() loaded vocabulary with %u word(s).\n",
+          mImageMatcher.GetVocabulary()->GetWordCount());
+    } catch (const cereal::Exception &e) {
+      fprintf(stderr, "Lighthouse::LoadDatabase() couldn't deserialize vocabulary (reason: %s). Skipping...\n",
+          e.what());
+    }
+  }
+
+  // All descriptions live in the single DB file, descriptions from the per-item folders they used to be saved to are
+  // moved into it once. Every item still has its own folder with the source image and the voice label.
+  std::vector<ImageDescription> descriptions;
+  uint32_t migratedCount = 0;
+  bool isDatabaseMissing = !std::ifstream(GetDatabasePath()).good();
+  bool isDatabaseOutdated = false;
+  bool isDatabaseSetAside = false;
+  std::vector<ImageDescription> salvagedDescriptions;
+  if (!isDatabaseMissing) {
+    try {
+      DescriptionDatabaseInfo info;
+      descriptions = DescriptionDatabase::Load(GetDatabasePath(), &info);
+      // Payloads are checked once they're needed.
+      mImageMatcher.AddPayloadChecksums(info.mPayloadChecksums);
+      isDatabaseOutdated = info.mVersion != DescriptionDatabase::kVersion;
+      // Histograms used to cover the background too, they're recomputed once: the upgraded DB is saved below.
+      if (info.mVersion < DescriptionDatabase::kMaskedHistogramsVersion) {
+        MaskHistograms(descriptions);
+      }
+      if (info.mNumberOfFeatures != 0 && info.mNumberOfFeatures != mImageMatcher.GetSettings().mNumberOfFeatures) {
+        fprintf(stderr, "Lighthouse::LoadDatabase() description DB has been extracted with %u feature(s) per image, "
+            "%u are extracted now.\n", info.mNumberOfFeatures, mImageMatcher.GetSettings().mNumberOfFeatures);
+      }
+    } catch (const std::runtime_error &e) {
+      // Bad DB is kept aside rather than overwritten by the next save, and so are the ones set aside before. Its intact
+      // items are salvaged, the rest are taken from their folders if they're still there.
+      std::string badPath = GetDatabasePath() + ".bad";
+      for (uint32_t n = 1; std::ifstream(badPath).good(); ++n) {
+        badPath = GetDatabasePath() + ".bad." + std::to_string(n);
+      }
+      fprintf(stderr, "Lighthouse::LoadDatabase() couldn't load description DB (reason: %s). Setting it aside as "
+          "%s...\n", e.what(), badPath.c_str());
+      try {
+        salvagedDescriptions = DescriptionDatabase::Salvage(GetDatabasePath());
+        fprintf(stderr, "Lighthouse::LoadDatabase() salvaged %lu description(s) from the bad description DB.\n",
+            salvagedDescriptions.size());
+      } catch (const std::runtime_error &e) {
+        fprintf(stderr, "Lighthouse::LoadDatabase() couldn't salvage description DB (reason: %s).\n", e.what());
+      }
+      std::rename(GetDatabasePath().c_str(), badPath.c_str());
+      descriptions.clear();
+      isDatabaseMissing = true;
+      isDatabaseSetAside = true;
+    }
+  }
+  if (isDatabaseMissing) {
+    // Folders' histograms predate masking. Salvaged items are newer than their folders' descriptions, if they have any.
+    descriptions = LoadDescriptionFolders(migratedCount);
+    MaskHistograms(descriptions);
+
+    std::unordered_set<std::string> salvagedIds;
+    for (const ImageDescription &description : salvagedDescriptions) {
+      salvagedIds.insert(description.GetId());
+    }
+    descriptions.erase(std::remove_if(descriptions.begin(), descriptions.end(),
+        [&](const ImageDescription &aDescription) { return salvagedIds.count(aDescription.GetId()) > 0; }),
+        descriptions.end());
+    descriptions.insert(descriptions.end(), salvagedDescriptions.begin(), salvagedDescriptions.end());
+  }
+
+  // Items recorded since the DB has been saved the last time are in the journal, its torn tail (if the app has been
+  // killed in the middle of a write) is dropped.
+  size_t journaledCount = 0;
+  try {
+    mJournal.reset(new DescriptionJournal(GetJournalPath()));
+    const std::vector<ImageDescription> journaledDescriptions = mJournal->Recover();
+    descriptions.insert(descriptions.end(), journaledDescriptions.begin(), journaledDescriptions.end());
+    journaledCount = journaledDescriptions.size();
+    fprintf(stderr, "Lighthouse::LoadDatabase() recovered %lu description(s) from the journal.\n", journaledCount);
+  } catch (const std::runtime_error &e) {
+    // Descriptions are saved into the DB directly then.
+    mJournal.reset();
+    fprintf(stderr, "Lighthouse::LoadDatabase() couldn't open journal (reason: %s). Skipping...\n", e.what());
+  }
+
+  // Items of a DB that has been set aside that have been neither salvaged nor found in their folders are lost. All of
+  // them still have their folders (source image and voice label), so the user can be told which have to be recorded
+  // again. Folders of the recordings that have been interrupted before they were journaled are counted as well. It's
+  // the UI that tells the user (see `GetLostItemIds`): the DB starts loading before there is any view to show it in.
+  if (isDatabaseSetAside) {
+    std::unordered_set<std::string> ids;
+    for (const ImageDescription &description : descriptions) {
+      ids.insert(description.GetId());
+    }
+    for (const std::string &folder : Filesystem::GetSubFolders(mDbFolderPath)) {
+      const std::string id = folder.substr(folder.find_last_of('/') + 1);
+      if (ids.count(id) == 0) {
+        fprintf(stderr, "Lighthouse::LoadDatabase() description of %s has been lost.\n", id.c_str());
+        mLostItemIds.push_back(id);
+      }
+    }
+
+    fprintf(stderr, "Lighthouse::LoadDatabase() %lu item(s) have to be recorded again.\n", mLostItemIds.size());
+  }
+
+  // LSH index saved at the previous run saves us from hashing the descriptions that it has already indexed. It points
+  // at descriptor positions, so it can't be trusted if any description has been migrated or the DB has been set aside
+  // (that may reorder them).
+  std::unique_ptr<LshIndex> lshIndex;
+  if (mImageMatcher.GetSettings().mMatcherBackend == MatcherBackend::LSH && migratedCount == 0 && !isDatabaseSetAside &&
+      std::ifstream(GetLshIndexPath()).good()) {
+    try {
+      lshIndex.reset(new LshIndex(LshIndex::Load(GetLshIndexPath())));
+      fprintf(stderr, "Lighthouse::LoadDatabase() loaded LSH index with %lu item(s).\n",
+          lshIndex->GetItemIds().size());
+    } catch (const cereal::Exception &e) {
+      fprintf(stderr, "Lighthouse::LoadDatabase() couldn't deserialize LSH index (reason: %s). Skipping...\n",
+          e.what());
+    }
+  }
+
+  // If the DB has to be queried while it's still loading, descriptions are added in batches that double in size, so
+  // that the first items can be matched almost right away: every `AddToDB` call costs only as much as its batch, but
+  // it also computes bag-of-words vectors of the batch on all threads, which works best with large batches. Otherwise
+  // they're added at once, as they are if there is a saved LSH index: it covers the whole DB and would be rebuilt from
+  // scratch over the first batch.
+  size_t batchSize = mEarlyQueryPolicy == EarlyQueryPolicy::MATCH_LOADED && !lshIndex ? kDatabaseLoadFirstBatchSize :
+      descriptions.size();
+  for (size_t begin = 0; begin < descriptions.size(); begin += batchSize, batchSize *= 2) {
+    const size_t end = std::min(begin + batchSize, descriptions.size());
+    mImageMatcher.AddToDB(std::vector<ImageDescription>(descriptions.begin() + begin, descriptions.begin() + end),
+        lshIndex.get());
+  }
+
+  fprintf(stderr, "Lighthouse::LoadDatabase() loaded %lu image description(s) in %f ms.\n", descriptions.size(),
+      std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
+  // Anything recorded since the DB has been saved the last time is folded into it, so that the journal is short and
+  // the next start maps all items at once. DB of an older version is saved in the current one, so that it's upgraded
+  // only once. Saving the DB saves the LSH index too, otherwise the index is re-saved only if anything had to be
+  // hashed.
+  if (isDatabaseMissing || isDatabaseOutdated || journaledCount > 0) {
+    SaveDatabase();
+    fprintf(stderr, "Lighthouse::LoadDatabase() saved %lu description(s) into the description DB.\n",
+        descriptions.size());
+  } else if (!lshIndex || mImageMatcher.GetLshIndex().GetItemIds() != lshIndex->GetItemIds()) {
+    SaveLshIndex();
+  }
+}
+
+bool Lighthouse::IsDatabaseLoaded() const {
+  return mDatabaseLoaded.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+std::shared_future<void> Lighthouse::GetDatabaseLoaded() const {
+  return mDatabaseLoaded;
+}
+
+std::vector<std::string> Lighthouse::GetLostItemIds() const {
+  WaitForDatabase(false);
+  return mLostItemIds;
+}
+
+void Lighthouse::WaitForDatabase(bool aIsQuery) const {
+  if (!aIsQuery || mEarlyQueryPolicy == EarlyQueryPolicy::WAIT) {
+    mDatabaseLoaded.wait();
+  }
+}
+
+void Lighthouse::ReportIdentification() const {
+  std::call_once(mFirstIdentificationFlag, [this]() {
+    fprintf(stderr, "Lighthouse::ReportIdentification() time to first identification is %f ms, %s DB of %lu item(s).\n",
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - mStartTime).count(),
+        IsDatabaseLoaded() ? "whole" : "partially loaded", mImageMatcher.GetDescriptions().size());
+  });
+}
+
+std::string Lighthouse::GetVocabularyPath() const {
+  return mDbFolderPath + "vocabulary.bin";
+}
+
+std::string Lighthouse::GetDatabasePath() const {
+  return mDbFolderPath + "descriptions.db";
+}
+
+std::vector<ImageDescription> Lighthouse::LoadDescriptionFolders(uint32_t &aMigratedCount) const {
+  // Iterate through all sub folders, every folder used to contain description.bin - binary serialized image description
+  // (keypoints, descriptors, histogram etc.). Folders are independent, so they're loaded on all cores.
+  const std::vector<std::string> subFolders = Filesystem::GetSubFolders(mDbFolderPath);
+  std::vector<ImageDescription> folderDescriptions(subFolders.size());
+  std::vector<uint8_t> isLoaded(subFolders.size(), 0), isMigrated(subFolders.size(), 0);
+  ThreadPool threadPool(0);
+  threadPool.ParallelFor(subFolders.size(), 1, [&](size_t aBegin, size_t aEnd) {
+    for (size_t i = aBegin; i < aEnd; ++i) {
+      const std::string descriptionPath = subFolders[i] + GetDescriptionAssetName(ImageDescriptionAsset::Data);
+      if (!std::ifstream(descriptionPath).good()) {
+        continue;
+      }
+
+      try {
+        bool isDescriptionMigrated = false;
+        folderDescriptions[i] = ImageDescription::Load(descriptionPath, &isDescriptionMigrated);
+        isLoaded[i] = 1;
+        isMigrated[i] = isDescriptionMigrated;
+      } catch (const cereal::Exception &e) {
+        fprintf(stderr, "Lighthouse::LoadDescriptionFolders() couldn't deserialize description at %s (reason: %s). "
+            "Skipping...\n", subFolders[i].c_str(), e.what());
+      }
+    }
+  });
+
+  std::vector<ImageDescription> descriptions;
+  aMigratedCount = 0;
+  for (size_t i = 0; i < subFolders.size(); ++i) {
+    if (isLoaded[i]) {
+      descriptions.push_back(folderDescriptions[i]);
+      aMigratedCount += isMigrated[i];
+    }
+  }
+
+  if (aMigratedCount > 0) {
+    fprintf(stderr, "Lighthouse::LoadDescriptionFolders() migrated %u description(s) to the response-ordered format.\n",
+        aMigratedCount);
+  }
+
+  return descriptions;
+}
+
+uint32_t Lighthouse::MaskHistograms(std::vector<ImageDescription> &aDescriptions) const {
+  // Every item needs its source image decoded, so they're done on all cores. The object crop is within the mask's
+  // bounding box, so the masked whole frame has the same pixels in the histogram as the crop the item was made of.
+  std::vector<uint8_t> isMasked(aDescriptions.size(), 0);
+  ThreadPool threadPool(0);
+  threadPool.ParallelFor(aDescriptions.size(), 1, [&](size_t aBegin, size_t aEnd) {
+    for (size_t i = aBegin; i < aEnd; ++i) {
+      const ImageDescription &description = aDescriptions[i];
+      const cv::Mat sourceImage = cv::imread(GetDescriptionAssetPath(description.GetId(),
+          ImageDescriptionAsset::SourceImage), cv::IMREAD_UNCHANGED);
+      if (sourceImage.type() != CV_8UC4) {
+        continue;
+      }
+
+      cv::Mat histogram;
+      ColorHistogram::Compute(sourceImage, histogram);
+      aDescriptions[i] = ImageDescription(description.GetId(), description.GetKeypoints(),
+          description.GetDescriptorSet(), histogram, description.GetBowVector(), description.GetScale(),
+          description.GetStorage());
+      isMasked[i] = 1;
+    }
+  });
+
+  const uint32_t maskedCount = (uint32_t) std::count(isMasked.begin(), isMasked.end(), 1);
+  fprintf(stderr, "Lighthouse::MaskHistograms() recomputed %u of %lu histogram(s) within the mask.\n", maskedCount,
+      aDescriptions.size());
+  return maskedCount;
+}
+
+std::string Lighthouse::GetJournalPath() const {
+  return mDbFolderPath + "descriptions.journal";
+}
+
+void Lighthouse::SaveDatabase() {
+  std::lock_guard<std::mutex> lock(mDatabaseSaveMutex);
+
+  const auto save = [this]() {
+    // Payloads are checksummed as they are when they're saved, so the corrupt ones must not get there: items loaded
+    // from the DB whose payload hasn't been needed yet are checked now.
+    std::vector<ImageDescriptionPtr> descriptions;
+    for (const ImageDescriptionPtr &description : mImageMatcher.GetDescriptions()) {
+      if (mImageMatcher.CheckPayload(*description)) {
+        descriptions.push_back(description);
+      } else {
+        fprintf(stderr, "Lighthouse::SaveDatabase() dropping %s, its keypoints or descriptors are corrupt.\n",
+            description->GetId().c_str());
+      }
+    }
+
+    DescriptionDatabase::Save(descriptions, mImageMatcher.GetSettings().mNumberOfFeatures, GetDatabasePath());
+
+    // Saving has read every payload, the ones that aren't kept for matching shouldn't stay resident.
+    for (const ImageDescriptionPtr &description : descriptions) {
+      mImageMatcher.ReleasePayload(*description);
+    }
+  };
+
+  try {
+    // Journaled items are in the saved DB, so the journal is folded into it.
+    if (mJournal) {
+      mJournal->Compact(save);
+    } else {
+      save();
+    }
+  } catch (const std::runtime_error &e) {
+    fprintf(stderr, "Lighthouse::SaveDatabase() couldn't save description DB (reason: %s).\n", e.what());
+  }
+
+  // The index is saved whole, so it's saved along with the DB rather than with every recorded item: items journaled
+  // since are hashed again at the next start.
+  SaveLshIndex();
+}
+
+std::string Lighthouse::GetLshIndexPath() const {
+  return mDbFolderPath + "lsh-index.bin";
+}
+
+void Lighthouse::SaveLshIndex() const {
+  if (mImageMatcher.GetSettings().mMatcherBackend != MatcherBackend::LSH) {
+    return;
+  }
+
+  try {
+    LshIndex::Save(mImageMatcher.GetLshIndex(), GetLshIndexPath());
+  } catch (const std::runtime_error &e) {
+    fprintf(stderr, "Lighthouse::SaveLshIndex() couldn't save LSH index (reason: %s).\n", e.what());
+  }
+}
+
 std::string Lighthouse::GetDescriptionAssetName(const ImageDescriptionAsset aAsset) const {
   switch (aAsset) {
     case ImageDescriptionAsset::Data:
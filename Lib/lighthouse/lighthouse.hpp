@@ -16,16 +16,40 @@
 #include <stdatomic.h>
 #include <atomic>
 #include <condition_variable>
+#include <chrono>
+#include <future>
 
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/features2d.hpp>
 
+#include "description_journal.hpp"
 #include "image_matcher.hpp"
 #include "video.hpp"
 
 namespace lighthouse {
 
+// Shape of the vocabulary tree trained by `Task::TRAIN_VOCABULARY`: up to 10^4 visual words.
+static const uint32_t kVocabularyBranchingFactor = 10;
+static const uint32_t kVocabularyDepth = 4;
+
+// Identification stops scanning the DB once the best match scores at least that and is that far ahead of the runner-up.
+static const float kIdentificationCertaintyScore = 40;
+static const float kIdentificationCertaintyMargin = 20;
+// Number of recently identified items that are matched first.
+static const uint32_t kRecentMatchesCount = 16;
+
+// Tracking re-detects keypoints once fewer than that fraction of the detected ones are still tracked, and re-queries
+// the DB once fewer than that fraction of the ones it has been queried with are.
+static const float kTrackingMinCoverage = 0.5;
+static const float kTrackingRequeryCoverage = 0.25;
+
+// Journal is folded into the description DB file once it has that many records.
+static const uint32_t kJournalCompactionRecordCount = 16;
+
+// Descriptions are loaded into the DB in batches of that many items at first, every next batch is twice as large.
+static const uint32_t kDatabaseLoadFirstBatchSize = 64;
+
 enum class Task {
   // Nothing to do.
   WAIT = 0,
@@ -34,12 +58,20 @@ enum class Task {
   RECORD = 1,
   IDENTIFY = 2,
 
+  // Developer-only tasks.
+  TRAIN_VOCABULARY = 3,
+  BENCHMARK = 4,
+
+  // Identify objects continuously, at video rate.
+  TRACK = 5,
+
   STOP,
 };
 
 // Describes all possible assets that are related to the image description, but are managed separately.
 enum ImageDescriptionAsset {
-  // Main binary data for the image description (id, descriptors, keypoints, histogram).
+  // Main binary data for the image description (id, descriptors, keypoints, histogram). Only in the folders of items
+  // recorded before the description DB, it's moved into the DB at the first start.
   Data,
   // Image description voice label.
   VoiceLabel,
@@ -47,9 +79,18 @@ enum ImageDescriptionAsset {
   SourceImage
 };
 
+// What identification does if it's requested while the DB is still being loaded.
+enum class EarlyQueryPolicy {
+  // Wait until the whole DB has been loaded.
+  WAIT = 0,
+  // Match against the items that have been loaded so far, they're added in growing batches then.
+  MATCH_LOADED = 1,
+};
+
 class Lighthouse {
 public:
-  Lighthouse(ImageMatchingSettings aImageMatchingSettings);
+  // DB is loaded in the background, see `GetDatabaseLoaded`.
+  Lighthouse(ImageMatchingSettings aImageMatchingSettings, EarlyQueryPolicy aEarlyQueryPolicy);
 
   ~Lighthouse();
 
@@ -57,7 +98,8 @@ public:
 
   ImageDescription GetDescription(const cv::Mat &aInputFrame) const;
 
-  const ImageDescription &GetDescription(const std::string &aId) const;
+  // Returns the DB item with the specified id or `nullptr` if there is no such item.
+  ImageDescriptionPtr GetDescription(const std::string &aId) const;
 
   // Record voice label for the specified existing description.
   void RecordVoiceLabel(const ImageDescription &aDescription) const;
@@ -67,9 +109,9 @@ public:
 
   void SaveDescription(const ImageDescription &aDescription, const cv::Mat &aSourceImage);
 
-  std::vector<std::tuple<float, ImageDescription>> FindMatches(const cv::Mat &aInputFrame) const;
+  std::vector<std::tuple<float, ImageDescriptionPtr>> FindMatches(const cv::Mat &aInputFrame) const;
 
-  std::vector<std::tuple<float, ImageDescription>> FindMatches(const ImageDescription &aDescription) const;
+  std::vector<std::tuple<float, ImageDescriptionPtr>> FindMatches(const ImageDescription &aDescription) const;
 
   // Start recording a new object.
   void OnRecordObject();
@@ -77,9 +119,32 @@ public:
   // Start identifying an existing object.
   void OnIdentifyObject();
 
-  // Stop recording/identifying object.
+  // Start identifying objects continuously, until stopped.
+  void OnTrackObjects();
+
+  // Stop recording/identifying/tracking objects.
   void StopRecord();
 
+  // Whether the whole DB has been loaded.
+  bool IsDatabaseLoaded() const;
+
+  // Returns a future that becomes ready once the whole DB has been loaded.
+  std::shared_future<void> GetDatabaseLoaded() const;
+
+  // Returns ids of the items that have been lost with a damaged DB file at load: their folders are there, but they
+  // couldn't be salvaged, so they have to be recorded again. Empty unless the DB has been set aside. Blocks until the
+  // whole DB has been loaded.
+  std::vector<std::string> GetLostItemIds() const;
+
+  // Drops keypoints and descriptors of the DB items from memory, they're read from disk again once they're needed.
+  void OnMemoryWarning();
+
+  // Start training the vocabulary over all items in the DB.
+  void OnTrainVocabulary();
+
+  // Start running matching benchmarks against all items in the DB.
+  void OnRunBenchmarks();
+
 private:
   // Run the C++ event loop on thread `mVideoThread`.
   //
@@ -97,6 +162,55 @@ private:
   // Actual implementation of identifying an object. Runs in `mVideoThread`.
   void RunIdentifyObject();
 
+  // Actual implementation of continuous identification. Runs in `mVideoThread`.
+  void RunTrackObjects();
+
+  // Trains the vocabulary over all items in the DB, saves it and re-saves all descriptions with their bag-of-words
+  // vectors. Runs in `mVideoThread`.
+  void RunTrainVocabulary();
+
+  // Runs matching benchmarks and shows a label if their correctness checks fail. Runs in `mVideoThread`.
+  void RunBenchmarks();
+
+  // Loads the vocabulary, descriptions and the LSH index into the matcher. Runs in the background, see
+  // `mDatabaseLoaded`.
+  void LoadDatabase();
+
+  // Blocks until the whole DB has been loaded, unless it's a query and the policy allows matching against the items
+  // loaded so far.
+  void WaitForDatabase(bool aIsQuery) const;
+
+  // Logs the time from the start to the first identification, does nothing after the first call.
+  void ReportIdentification() const;
+
+  // Returns a full absolute path to the vocabulary file.
+  std::string GetVocabularyPath() const;
+
+  // Returns a full absolute path to the description DB file.
+  std::string GetDatabasePath() const;
+
+  // Loads descriptions from the per-item folders they were saved to before the description DB, upgrading the ones saved
+  // in older formats. Number of upgraded descriptions is returned in `aMigratedCount`.
+  std::vector<ImageDescription> LoadDescriptionFolders(uint32_t &aMigratedCount) const;
+
+  // Recomputes histograms of the descriptions within the alpha mask of their saved source images, for the items
+  // recorded before histograms were masked. Descriptions without a BGRA source image keep theirs. Returns the number of
+  // recomputed histograms.
+  uint32_t MaskHistograms(std::vector<ImageDescription> &aDescriptions) const;
+
+  // Returns a full absolute path to the journal of the descriptions recorded since the DB file has been saved.
+  std::string GetJournalPath() const;
+
+  // Saves all descriptions in the DB into the description DB file and empties the journal, then saves the LSH index.
+  void SaveDatabase();
+
+  // Returns a full absolute path to the LSH index file.
+  std::string GetLshIndexPath() const;
+
+  // Saves the LSH index, so that it doesn't have to be rebuilt at the next start. No-op for other matcher backends.
+  // Failures are only logged: the index is rebuilt if it's missing.
+  void SaveLshIndex() const;
+
   // Returns a file name of the description asset (data, voice label, source image).
   std::string GetDescriptionAssetName(const ImageDescriptionAsset aAsset) const;
 
@@ -120,7 +234,27 @@ private:
   Camera mCamera;
 
   ImageMatcher mImageMatcher;
+  // Options of the identification scan, with the prior that remembers recently identified items.
+  TopMatchesOptions mIdentificationOptions;
   std::string mDbFolderPath;
+
+  EarlyQueryPolicy mEarlyQueryPolicy;
+  // Ready once `LoadDatabase` is done.
+  std::shared_future<void> mDatabaseLoaded;
+  // When the instance has been created and whether anything has been identified since then.
+  std::chrono::high_resolution_clock::time_point mStartTime;
+  mutable std::once_flag mFirstIdentificationFlag;
+
+  // See `GetLostItemIds`, set by `LoadDatabase`.
+  std::vector<std::string> mLostItemIds;
+
+  // Records descriptions saved since the DB file has been saved, `nullptr` until the DB is loaded or if the journal
+  // can't be opened.
+  std::unique_ptr<DescriptionJournal> mJournal;
+  // Background compaction of the journal, if one has been started. Access only on mVideoThread.
+  std::future<void> mCompaction;
+  // Serializes DB saves, e.g. a compaction and vocabulary training.
+  std::mutex mDatabaseSaveMutex;
 };
 
 } // namespace lighthouse
@@ -0,0 +1,210 @@
+//
+//  binary_descriptor_set.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef binary_descriptor_set_hpp
+#define binary_descriptor_set_hpp
+
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <cereal/cereal.hpp>
+#include <cereal/types/vector.hpp>
+
+#include "aligned_allocator.hpp"
+
+namespace lighthouse {
+
+// Rows of `Bytes` long binary descriptors stored back to back as `std::array<uint64_t, Bytes / 8>`, with the buffer
+// aligned to the cache line size. Unlike `cv::Mat` there is no header to check at every use, and the width is known at
+// compile time, so everything that takes the set (e.g. `HammingMatcher<Bytes>`) gets the code specialised for it.
+// `AsMat` gives OpenCV a view of the rows without copying them. Serialized exactly as `cv::Mat` of the same rows. The
+// set can also be a view of rows stored elsewhere (e.g. in the memory-mapped description DB), it takes its own copy
+// only once it's changed.
+template<uint32_t Bytes>
+class BinaryDescriptorSet {
+  static_assert(Bytes > 0 && Bytes % sizeof(uint64_t) == 0, "Descriptor width must be a multiple of 8 bytes!");
+
+public:
+  typedef std::array<uint64_t, Bytes / sizeof(uint64_t)> Row;
+
+  // Alignment of the row buffer.
+  static const size_t kAlignment = 64;
+
+  BinaryDescriptorSet() : mRows(), mView(nullptr), mViewSize(0), mStorage() {
+  }
+
+  // Copies descriptors out of the matrix, which must be either empty or a `CV_8U` matrix with `Bytes` columns.
+  explicit BinaryDescriptorSet(const cv::Mat &aDescriptors) : BinaryDescriptorSet() {
+    if (aDescriptors.empty()) {
+      return;
+    }
+
+    if (aDescriptors.type() != CV_8U || aDescriptors.cols != (int) Bytes) {
+      throw std::invalid_argument("Descriptor width doesn't match the descriptor set!");
+    }
+
+    mRows.resize(aDescriptors.rows);
+    for (int row = 0; row < aDescriptors.rows; ++row) {
+      memcpy(mRows[row].data(), aDescriptors.ptr<uint8_t>(row), Bytes);
+    }
+  }
+
+  // View of `aCount` rows stored back to back, at least 8-byte aligned. `aStorage` keeps them alive, nothing is copied.
+  BinaryDescriptorSet(const uint8_t *aRows, size_t aCount, std::shared_ptr<const void> aStorage)
+      : mRows(), mView(reinterpret_cast<const Row *>(aRows)), mViewSize(aCount), mStorage(aStorage) {
+  }
+
+  // Number of descriptors.
+  size_t Size() const {
+    return mView != nullptr ? mViewSize : mRows.size();
+  }
+
+  bool Empty() const {
+    return Size() == 0;
+  }
+
+  // Whether the set is a view of rows stored elsewhere.
+  bool IsView() const {
+    return mView != nullptr;
+  }
+
+  const uint8_t *GetRow(size_t aIndex) const {
+    return reinterpret_cast<const uint8_t *>(GetRows()[aIndex].data());
+  }
+
+  uint8_t *GetRow(size_t aIndex) {
+    Detach();
+    return reinterpret_cast<uint8_t *>(mRows[aIndex].data());
+  }
+
+  // Rows are contiguous, every one `Bytes` after the previous one.
+  const uint8_t *GetData() const {
+    return reinterpret_cast<const uint8_t *>(GetRows());
+  }
+
+  void Reserve(size_t aCount) {
+    Detach();
+    mRows.reserve(aCount);
+  }
+
+  // Appends copy of the `Bytes` long descriptor.
+  void PushBack(const uint8_t *aDescriptor) {
+    Detach();
+    mRows.push_back(Row());
+    memcpy(mRows.back().data(), aDescriptor, Bytes);
+  }
+
+  void Append(const BinaryDescriptorSet &aSet) {
+    Detach();
+    mRows.insert(mRows.end(), aSet.GetRows(), aSet.GetRows() + aSet.Size());
+  }
+
+  // Returns the first `aCount` descriptors (all if there are fewer), a view shares the rows instead of copying them.
+  BinaryDescriptorSet Head(size_t aCount) const {
+    if (mView != nullptr) {
+      return BinaryDescriptorSet(GetData(), std::min(aCount, mViewSize), mStorage);
+    }
+
+    BinaryDescriptorSet head;
+    head.mRows.assign(mRows.begin(), mRows.begin() + std::min(aCount, mRows.size()));
+    return head;
+  }
+
+  // Returns descriptors of the specified rows, in that order.
+  BinaryDescriptorSet Select(const std::vector<uint32_t> &aRows) const {
+    BinaryDescriptorSet selected;
+    selected.mRows.reserve(aRows.size());
+    for (const uint32_t row : aRows) {
+      selected.mRows.push_back(GetRows()[row]);
+    }
+    return selected;
+  }
+
+  // Returns `CV_8U` matrix with `Bytes` columns over the first `aCount` rows (all if there are fewer), the data isn't
+  // copied. The view doesn't keep the set alive and is valid only until the set is changed or destroyed.
+  cv::Mat AsMat(size_t aCount = std::numeric_limits<size_t>::max()) const {
+    const size_t rows = std::min(aCount, Size());
+    if (rows == 0) {
+      return cv::Mat();
+    }
+
+    return cv::Mat((int) rows, (int) Bytes, CV_8U, const_cast<uint8_t *>(GetData()), Bytes);
+  }
+
+private:
+  const Row *GetRows() const {
+    return mView != nullptr ? mView : mRows.data();
+  }
+
+  // Copies viewed rows into the set's own buffer, so that they can be changed.
+  void Detach() {
+    if (mView == nullptr) {
+      return;
+    }
+
+    mRows.assign(mView, mView + mViewSize);
+    mView = nullptr;
+    mViewSize = 0;
+    mStorage.reset();
+  }
+
+  std::vector<Row, AlignedAllocator<Row, kAlignment>> mRows;
+  // Rows the set is a view of, `nullptr` if it has its own buffer.
+  const Row *mView;
+  size_t mViewSize;
+  std::shared_ptr<const void> mStorage;
+
+  friend class cereal::access;
+
+  // Same layout as `cv::save(Archive &, const cv::Mat &)` (see serialization.hpp) writes for a continuous matrix.
+  template<class Archive>
+  void save(Archive &aArchive) const {
+    const std::vector<int> matrixSize = {(int) Size(), (int) Bytes};
+    aArchive(2, matrixSize, CV_8U, true, cereal::binary_data(GetData(), Size() * Bytes));
+  }
+
+  // Reads what either `save` above or `cv::save` of a `CV_8U` matrix with `Bytes` columns has written, straight into
+  // the aligned rows.
+  template<class Archive>
+  void load(Archive &aArchive) {
+    int dims, type;
+    bool continuous;
+    std::vector<int> matrixSize;
+    aArchive(dims, matrixSize, type, continuous);
+
+    mView = nullptr;
+    mViewSize = 0;
+    mStorage.reset();
+    mRows.clear();
+    // Empty matrices have no data.
+    if (dims == 0 || std::find(matrixSize.begin(), matrixSize.end(), 0) != matrixSize.end()) {
+      return;
+    }
+
+    if (dims != 2 || matrixSize.size() != 2 || matrixSize[0] < 0 || matrixSize[1] != (int) Bytes || type != CV_8U ||
+        !continuous) {
+      throw cereal::Exception("Serialized descriptors don't match the descriptor set!");
+    }
+
+    mRows.resize(matrixSize[0]);
+    aArchive(cereal::binary_data(mRows.data(), mRows.size() * Bytes));
+  }
+};
+
+// ORB descriptors, the only ones features are described with.
+typedef BinaryDescriptorSet<32> OrbDescriptorSet;
+
+} // namespace lighthouse
+
+#endif /* binary_descriptor_set_hpp */
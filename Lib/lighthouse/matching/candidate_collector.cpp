@@ -0,0 +1,161 @@
+//
+//  candidate_collector.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+#include "candidate_collector.hpp"
+#include "hamming.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Scratch state of the rows a thread matches, kept from query to query so that none of it is allocated or cleared per
+// query: it's as large as the DB. Every row gets a new stamp, so a descriptor or item is visited by the current row
+// only if its stamp is the current one.
+struct KnnScratch {
+  std::vector<uint32_t> mDescriptorStamps;
+  std::vector<uint32_t> mItemStamps;
+  // Two nearest neighbours per item.
+  std::vector<HammingTop2> mNeighbours;
+  // Descriptors the index has found for the current row.
+  std::vector<uint32_t> mCandidates;
+  // Items the current row has found at least one descriptor for.
+  std::vector<uint32_t> mTouchedItems;
+  uint32_t mStamp = 0;
+
+  // Makes room for the arena, new entries are stamped 0, which no row has.
+  void Reserve(const DescriptorArena &aArena) {
+    if (mDescriptorStamps.size() < aArena.Size()) {
+      mDescriptorStamps.resize(aArena.Size(), 0);
+    }
+    if (mItemStamps.size() < aArena.GetItemCount()) {
+      mItemStamps.resize(aArena.GetItemCount(), 0);
+      mNeighbours.resize(aArena.GetItemCount());
+    }
+  }
+
+  uint32_t NextStamp() {
+    if (++mStamp == 0) {
+      std::fill(mDescriptorStamps.begin(), mDescriptorStamps.end(), 0);
+      std::fill(mItemStamps.begin(), mItemStamps.end(), 0);
+      mStamp = 1;
+    }
+    return mStamp;
+  }
+};
+
+} // namespace
+
+/*static*/ CandidateMatches CandidateCollector::KnnMatch(const DescriptorArena &aArena,
+    const cv::Mat &aQueryDescriptors, uint32_t aMaxDistance, const Enumerator &aEnumerate, ThreadPool *aThreadPool,
+    const std::vector<uint8_t> *aItemFilter) {
+  if (aArena.Size() == 0 || aQueryDescriptors.empty()) {
+    return CandidateMatches();
+  }
+
+  if (aQueryDescriptors.type() != CV_8U || aQueryDescriptors.cols != DescriptorArena::kDescriptorBytes) {
+    throw std::invalid_argument("Only 32-byte binary descriptors can be matched!");
+  }
+
+  // Every chunk of query rows collects (item, row, two nearest neighbours) into its own list, lists are merged into the
+  // result afterwards, when it's known which items have been found.
+  const uint32_t chunkCount = aThreadPool != nullptr ? aThreadPool->GetThreadCount() * 2 : 1;
+  const size_t chunkSize = (aQueryDescriptors.rows + chunkCount - 1) / chunkCount;
+  std::vector<std::vector<std::tuple<uint32_t, uint32_t, HammingTop2>>> chunkMatches(
+      (aQueryDescriptors.rows + chunkSize - 1) / chunkSize);
+
+  auto matchRows = [&](size_t aFirstRow, size_t aLastRow) {
+    static thread_local KnnScratch scratch;
+    scratch.Reserve(aArena);
+    std::vector<std::tuple<uint32_t, uint32_t, HammingTop2>> &matches = chunkMatches[aFirstRow / chunkSize];
+
+    for (int row = (int) aFirstRow; row < (int) aLastRow; ++row) {
+      const uint8_t *query = aQueryDescriptors.ptr<uint8_t>(row);
+      const uint32_t stamp = scratch.NextStamp();
+      scratch.mTouchedItems.clear();
+      scratch.mCandidates.clear();
+      aEnumerate(query, scratch.mCandidates);
+
+      for (const uint32_t descriptorIndex : scratch.mCandidates) {
+        if (scratch.mDescriptorStamps[descriptorIndex] == stamp) {
+          continue;
+        }
+        scratch.mDescriptorStamps[descriptorIndex] = stamp;
+
+        const uint32_t owner = aArena.GetOwner(descriptorIndex);
+        if (aItemFilter != nullptr && !(*aItemFilter)[owner]) {
+          continue;
+        }
+
+        // Only descriptors within the distance are (supposed to be) all found, so only they can be ranked here.
+        const uint32_t distance = HammingMatcher<DescriptorArena::kDescriptorBytes>::Distance(query,
+            aArena.GetDescriptor(descriptorIndex));
+        if (distance > aMaxDistance) {
+          continue;
+        }
+
+        HammingTop2 &neighbours = scratch.mNeighbours[owner];
+        if (scratch.mItemStamps[owner] != stamp) {
+          scratch.mItemStamps[owner] = stamp;
+          ResetHammingTop2(neighbours);
+          scratch.mTouchedItems.push_back(owner);
+        }
+        UpdateHammingTop2(distance, aArena.GetRow(descriptorIndex), neighbours);
+      }
+
+      for (const uint32_t owner : scratch.mTouchedItems) {
+        HammingTop2 &neighbours = scratch.mNeighbours[owner];
+        if (neighbours.mDistances[1] == std::numeric_limits<uint32_t>::max()) {
+          // Second neighbour is further than the distance, so it's looked up among all of the item's descriptors:
+          // the ratio test needs its exact distance. It costs one item, and only for the items this row has found
+          // anything in. Item's descriptors are its rows in order, so neighbour indices are rows already.
+          const uint32_t itemStart = aArena.GetItemOffset(owner);
+          aArena.FindTop2(query, itemStart, aArena.GetItemOffset(owner + 1) - itemStart, neighbours);
+        }
+        matches.push_back(std::make_tuple(owner, (uint32_t) row, neighbours));
+      }
+    }
+  };
+
+  if (aThreadPool != nullptr) {
+    aThreadPool->ParallelFor(aQueryDescriptors.rows, chunkSize, matchRows);
+  } else {
+    matchRows(0, aQueryDescriptors.rows);
+  }
+
+  // Found items in arena order, each gets its slot in the result.
+  std::vector<int32_t> itemSlots(aArena.GetItemCount(), -1);
+  std::vector<uint32_t> items;
+  for (const auto &matches : chunkMatches) {
+    for (const auto &match : matches) {
+      if (itemSlots[std::get<0>(match)] < 0) {
+        itemSlots[std::get<0>(match)] = 0;
+        items.push_back(std::get<0>(match));
+      }
+    }
+  }
+  std::sort(items.begin(), items.end());
+  for (size_t slot = 0; slot < items.size(); ++slot) {
+    itemSlots[items[slot]] = slot;
+  }
+
+  CandidateMatches itemMatches(items, aQueryDescriptors.rows);
+  for (const auto &matches : chunkMatches) {
+    for (const auto &match : matches) {
+      itemMatches.Get(itemSlots[std::get<0>(match)], std::get<1>(match)) = std::get<2>(match);
+    }
+  }
+
+  return itemMatches;
+}
+
+} // namespace lighthouse
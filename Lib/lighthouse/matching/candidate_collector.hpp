@@ -0,0 +1,45 @@
+//
+//  candidate_collector.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef candidate_collector_hpp
+#define candidate_collector_hpp
+
+#include <stdio.h>
+#include <functional>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "descriptor_arena.hpp"
+#include "thread_pool.hpp"
+
+namespace lighthouse {
+
+// Turns the arena descriptors an index finds for every query row into per-item k-NN lists, the part of `KnnMatch`
+// that doesn't depend on how the index is organised (`MultiIndexHash`, `LshIndex`).
+class CandidateCollector {
+public:
+  // Appends arena indices of the descriptors the index finds for the query descriptor to the list, the same
+  // descriptor may be appended more than once.
+  typedef std::function<void(const uint8_t *aQuery, std::vector<uint32_t> &aCandidates)> Enumerator;
+
+  // For every row of `aQueryDescriptors` ranks the descriptors `aEnumerate` finds that are within `aMaxDistance`. Every
+  // item that has at least one of them gets exactly the two neighbours `knnMatch(..., 2)` against that item would
+  // return for the row, as long as the index finds all of the item's descriptors within the distance: if the second
+  // neighbour isn't among them, both are looked up among the item's descriptors, so the ratio test applies as is. Rows
+  // that have no descriptor of an item within the distance get no neighbours for it, and items that have none for any
+  // row aren't returned at all. Items are returned in arena order. Query rows are spread over the thread pool if one is
+  // given. If `aItemFilter` is given, descriptors of the items that have 0 in it (by arena item index) are skipped
+  // before their distance is computed.
+  static CandidateMatches KnnMatch(const DescriptorArena &aArena, const cv::Mat &aQueryDescriptors,
+      uint32_t aMaxDistance, const Enumerator &aEnumerate, ThreadPool *aThreadPool,
+      const std::vector<uint8_t> *aItemFilter);
+};
+
+} // namespace lighthouse
+
+#endif /* candidate_collector_hpp */
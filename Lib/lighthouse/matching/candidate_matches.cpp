@@ -0,0 +1,55 @@
+//
+//  candidate_matches.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+
+#include "candidate_matches.hpp"
+
+namespace lighthouse {
+
+CandidateMatches::CandidateMatches() : mItems(), mRowCount(0), mNeighbours() {
+}
+
+CandidateMatches::CandidateMatches(const std::vector<uint32_t> &aItems, uint32_t aRowCount)
+    : mItems(aItems), mRowCount(aRowCount), mNeighbours() {
+  HammingTop2 empty;
+  ResetHammingTop2(empty);
+  mNeighbours.assign(mItems.size() * mRowCount, empty);
+}
+
+int32_t CandidateMatches::FindSlot(uint32_t aItem) const {
+  const auto slot = std::lower_bound(mItems.begin(), mItems.end(), aItem);
+  return slot != mItems.end() && *slot == aItem ? (int32_t) (slot - mItems.begin()) : -1;
+}
+
+uint32_t CandidateMatches::CountGoodMatches(size_t aSlot, float aRatioTestK) const {
+  uint32_t goodMatchCount = 0;
+  for (uint32_t row = 0; row < mRowCount; ++row) {
+    if (IsGoodMatch(Get(aSlot, row), aRatioTestK)) {
+      goodMatchCount++;
+    }
+  }
+
+  return goodMatchCount;
+}
+
+std::vector<std::vector<cv::DMatch>> CandidateMatches::GetGoodMatches(size_t aSlot, float aRatioTestK) const {
+  std::vector<std::vector<cv::DMatch>> goodMatches;
+  for (uint32_t row = 0; row < mRowCount; ++row) {
+    const HammingTop2 &neighbours = Get(aSlot, row);
+    if (IsGoodMatch(neighbours, aRatioTestK)) {
+      goodMatches.push_back({
+          cv::DMatch(row, neighbours.mIndices[0], (float) neighbours.mDistances[0]),
+          cv::DMatch(row, neighbours.mIndices[1], (float) neighbours.mDistances[1])});
+    }
+  }
+
+  return goodMatches;
+}
+
+} // namespace lighthouse
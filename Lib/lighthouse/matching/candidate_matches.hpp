@@ -0,0 +1,86 @@
+//
+//  candidate_matches.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef candidate_matches_hpp
+#define candidate_matches_hpp
+
+#include <stdio.h>
+#include <limits>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "hamming.hpp"
+
+namespace lighthouse {
+
+// k-NN lists of the query against the candidate items, `knnMatch(query, item, ..., 2)`-like: two nearest neighbours
+// of every query row among every candidate's descriptors. They are kept in one flat buffer allocated upfront and
+// indexed by (candidate, query row), so collecting them allocates nothing per item or row, and are bucketed into
+// per-item lists only for the few candidates that are verified. Neighbour indices are rows in the item's descriptor
+// set, a neighbour the row doesn't have (no list at all, or an item with a single descriptor) has the max distance.
+// Candidates are arena item indices in arena order and are referred to by their slot in that order.
+class CandidateMatches {
+public:
+  CandidateMatches();
+
+  // Allocates empty lists of `aRowCount` query rows for every item, items must be given in arena order, every one
+  // once.
+  CandidateMatches(const std::vector<uint32_t> &aItems, uint32_t aRowCount);
+
+  // Number of candidates.
+  size_t Size() const {
+    return mItems.size();
+  }
+
+  bool Empty() const {
+    return mItems.empty();
+  }
+
+  // Returns arena index of the candidate item.
+  uint32_t GetItem(size_t aSlot) const {
+    return mItems[aSlot];
+  }
+
+  // Returns slot of the arena item or -1 if it isn't a candidate.
+  int32_t FindSlot(uint32_t aItem) const;
+
+  uint32_t GetRowCount() const {
+    return mRowCount;
+  }
+
+  HammingTop2 &Get(size_t aSlot, uint32_t aRow) {
+    return mNeighbours[aSlot * mRowCount + aRow];
+  }
+
+  const HammingTop2 &Get(size_t aSlot, uint32_t aRow) const {
+    return mNeighbours[aSlot * mRowCount + aRow];
+  }
+
+  // Returns true if the row has both neighbours and the first one is closer than `aRatioTestK` times the second one,
+  // the same ratio test `ImageMatcher::PartitionMatches` applies to `knnMatch` lists.
+  static bool IsGoodMatch(const HammingTop2 &aNeighbours, float aRatioTestK) {
+    return aNeighbours.mDistances[1] != std::numeric_limits<uint32_t>::max() &&
+        (float) aNeighbours.mDistances[0] < aRatioTestK * (float) aNeighbours.mDistances[1];
+  }
+
+  // Returns number of the candidate's rows that pass the ratio test. Every query row counts towards the total matches.
+  uint32_t CountGoodMatches(size_t aSlot, float aRatioTestK) const;
+
+  // Returns the candidate's rows that pass the ratio test as `knnMatch` lists of two matches.
+  std::vector<std::vector<cv::DMatch>> GetGoodMatches(size_t aSlot, float aRatioTestK) const;
+
+private:
+  std::vector<uint32_t> mItems;
+  uint32_t mRowCount;
+  // `mRowCount` entries per candidate.
+  std::vector<HammingTop2> mNeighbours;
+};
+
+} // namespace lighthouse
+
+#endif /* candidate_matches_hpp */
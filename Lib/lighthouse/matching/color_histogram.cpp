@@ -0,0 +1,216 @@
+//
+//  color_histogram.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+
+#include "color_histogram.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LIGHTHOUSE_HISTOGRAM_X86 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LIGHTHOUSE_HISTOGRAM_NEON 1
+#endif
+
+namespace lighthouse {
+
+namespace {
+
+// SIMD kernels turn every little-endian BGRA pixel (B | G << 8 | R << 16 | A << 24) into its bin index in the low
+// 16 bits and 1 (alpha is non-zero) or 0 (alpha is zero) in the high 16 bits, so that counting doesn't branch.
+const uint32_t kBlueBits = 0xe0;
+const uint32_t kGreenBits = 0x38;
+const uint32_t kRedBits = 0x07;
+const uint32_t kAlphaBits = 0xff000000;
+const uint32_t kCountedBit = 1 << 16;
+
+// Number of pixels whose values SIMD kernels compute before counting them.
+const uint32_t kBlockSize = 64;
+
+inline void CountValues(const uint32_t *aValues, uint32_t aCount, uint32_t *aBinCounts) {
+  for (uint32_t i = 0; i < aCount; ++i) {
+    aBinCounts[aValues[i] & 0xffff] += aValues[i] >> 16;
+  }
+}
+
+#if LIGHTHOUSE_HISTOGRAM_X86
+// SSE2 is always there on x86-64.
+void AddPixelsSse2(const uint8_t *aPixels, uint32_t aCount, uint32_t *aBinCounts) {
+  const __m128i blueBits = _mm_set1_epi32(kBlueBits);
+  const __m128i greenBits = _mm_set1_epi32(kGreenBits);
+  const __m128i redBits = _mm_set1_epi32(kRedBits);
+  const __m128i alphaBits = _mm_set1_epi32((int) kAlphaBits);
+  const __m128i countedBit = _mm_set1_epi32(kCountedBit);
+
+  alignas(16) uint32_t values[kBlockSize];
+  uint32_t pixel = 0;
+  while (pixel + 4 <= aCount) {
+    const uint32_t blockSize = std::min(kBlockSize, (aCount - pixel) & ~3u);
+    for (uint32_t i = 0; i < blockSize; i += 4) {
+      const __m128i bgra = _mm_loadu_si128((const __m128i *) (aPixels + (pixel + i) * 4));
+
+      const __m128i bins = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(bgra, blueBits), 1),
+          _mm_or_si128(_mm_and_si128(_mm_srli_epi32(bgra, 10), greenBits),
+              _mm_and_si128(_mm_srli_epi32(bgra, 21), redBits)));
+      const __m128i counted = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(bgra, alphaBits), _mm_setzero_si128()),
+          countedBit);
+
+      _mm_store_si128((__m128i *) (values + i), _mm_or_si128(bins, counted));
+    }
+
+    CountValues(values, blockSize, aBinCounts);
+    pixel += blockSize;
+  }
+
+  ColorHistogram::AddPixelsScalar(aPixels + pixel * 4, aCount - pixel, aBinCounts);
+}
+
+__attribute__((target("avx2")))
+void AddPixelsAvx2(const uint8_t *aPixels, uint32_t aCount, uint32_t *aBinCounts) {
+  const __m256i blueBits = _mm256_set1_epi32(kBlueBits);
+  const __m256i greenBits = _mm256_set1_epi32(kGreenBits);
+  const __m256i redBits = _mm256_set1_epi32(kRedBits);
+  const __m256i alphaBits = _mm256_set1_epi32((int) kAlphaBits);
+  const __m256i countedBit = _mm256_set1_epi32(kCountedBit);
+
+  alignas(32) uint32_t values[kBlockSize];
+  uint32_t pixel = 0;
+  while (pixel + 8 <= aCount) {
+    const uint32_t blockSize = std::min(kBlockSize, (aCount - pixel) & ~7u);
+    for (uint32_t i = 0; i < blockSize; i += 8) {
+      const __m256i bgra = _mm256_loadu_si256((const __m256i *) (aPixels + (pixel + i) * 4));
+
+      const __m256i bins = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(bgra, blueBits), 1),
+          _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(bgra, 10), greenBits),
+              _mm256_and_si256(_mm256_srli_epi32(bgra, 21), redBits)));
+      const __m256i counted = _mm256_andnot_si256(
+          _mm256_cmpeq_epi32(_mm256_and_si256(bgra, alphaBits), _mm256_setzero_si256()), countedBit);
+
+      _mm256_store_si256((__m256i *) (values + i), _mm256_or_si256(bins, counted));
+    }
+
+    CountValues(values, blockSize, aBinCounts);
+    pixel += blockSize;
+  }
+
+  ColorHistogram::AddPixelsScalar(aPixels + pixel * 4, aCount - pixel, aBinCounts);
+}
+#endif // LIGHTHOUSE_HISTOGRAM_X86
+
+#if LIGHTHOUSE_HISTOGRAM_NEON
+void AddPixelsNeon(const uint8_t *aPixels, uint32_t aCount, uint32_t *aBinCounts) {
+  const uint32x4_t blueBits = vdupq_n_u32(kBlueBits);
+  const uint32x4_t greenBits = vdupq_n_u32(kGreenBits);
+  const uint32x4_t redBits = vdupq_n_u32(kRedBits);
+  const uint32x4_t alphaBits = vdupq_n_u32(kAlphaBits);
+  const uint32x4_t countedBit = vdupq_n_u32(kCountedBit);
+
+  uint32_t values[kBlockSize];
+  uint32_t pixel = 0;
+  while (pixel + 4 <= aCount) {
+    const uint32_t blockSize = std::min(kBlockSize, (aCount - pixel) & ~3u);
+    for (uint32_t i = 0; i < blockSize; i += 4) {
+      const uint32x4_t bgra = vreinterpretq_u32_u8(vld1q_u8(aPixels + (pixel + i) * 4));
+
+      const uint32x4_t bins = vorrq_u32(vshlq_n_u32(vandq_u32(bgra, blueBits), 1),
+          vorrq_u32(vandq_u32(vshrq_n_u32(bgra, 10), greenBits), vandq_u32(vshrq_n_u32(bgra, 21), redBits)));
+      const uint32x4_t counted = vbicq_u32(countedBit, vceqq_u32(vandq_u32(bgra, alphaBits), vdupq_n_u32(0)));
+
+      vst1q_u32(values + i, vorrq_u32(bins, counted));
+    }
+
+    CountValues(values, blockSize, aBinCounts);
+    pixel += blockSize;
+  }
+
+  ColorHistogram::AddPixelsScalar(aPixels + pixel * 4, aCount - pixel, aBinCounts);
+}
+#endif // LIGHTHOUSE_HISTOGRAM_NEON
+
+} // namespace
+
+/*static*/ void ColorHistogram::AddPixelsScalar(const uint8_t *aPixels, uint32_t aCount, uint32_t *aBinCounts) {
+  for (uint32_t i = 0; i < aCount; ++i, aPixels += 4) {
+    if (aPixels[3] != 0) {
+      AddPixel(aPixels[0], aPixels[1], aPixels[2], aBinCounts);
+    }
+  }
+}
+
+/*static*/ void ColorHistogram::Normalize(const uint32_t *aBinCounts, cv::Mat &aHistogram) {
+  const int histogramSize[] = {kBins, kBins, kBins};
+  aHistogram.create(3, histogramSize, CV_32F);
+  float *histogram = aHistogram.ptr<float>();
+
+  double squaredNorm = 0;
+  for (int bin = 0; bin < kBinCount; ++bin) {
+    histogram[bin] = (float) aBinCounts[bin];
+    squaredNorm += (double) histogram[bin] * histogram[bin];
+  }
+
+  // Same as `cv::normalize`: the norm is computed in double precision, scaling is done in float.
+  const double norm = std::sqrt(squaredNorm);
+  const float scale = norm > DBL_EPSILON ? (float) (1.0 / norm) : 0;
+  for (int bin = 0; bin < kBinCount; ++bin) {
+    histogram[bin] *= scale;
+  }
+}
+
+/*static*/ void ColorHistogram::Compute(const cv::Mat &aFrame, cv::Mat &aHistogram, ColorHistogramKernel aKernel) {
+  if (aFrame.type() != CV_8UC4) {
+    throw std::invalid_argument("Only BGRA frames are supported!");
+  }
+
+  if (aKernel == nullptr) {
+    aKernel = GetKernel();
+  }
+
+  std::vector<uint32_t> binCounts(kBinCount, 0);
+  for (int row = 0; row < aFrame.rows; ++row) {
+    aKernel(aFrame.ptr<uint8_t>(row), aFrame.cols, binCounts.data());
+  }
+
+  Normalize(binCounts.data(), aHistogram);
+}
+
+/*static*/ std::vector<std::pair<std::string, ColorHistogramKernel>> ColorHistogram::GetSupportedKernels() {
+  std::vector<std::pair<std::string, ColorHistogramKernel>> kernels;
+  kernels.push_back(std::make_pair("scalar", AddPixelsScalar));
+
+#if LIGHTHOUSE_HISTOGRAM_X86
+  kernels.push_back(std::make_pair("sse2", AddPixelsSse2));
+
+  if (cv::checkHardwareSupport(CV_CPU_AVX2)) {
+    kernels.push_back(std::make_pair("avx2", AddPixelsAvx2));
+  }
+#endif
+
+#if LIGHTHOUSE_HISTOGRAM_NEON
+  kernels.push_back(std::make_pair("neon", AddPixelsNeon));
+#endif
+
+  return kernels;
+}
+
+/*static*/ const std::string &ColorHistogram::GetKernelName() {
+  static const std::string name = GetSupportedKernels().back().first;
+  return name;
+}
+
+/*static*/ ColorHistogramKernel ColorHistogram::GetKernel() {
+  static const ColorHistogramKernel kernel = GetSupportedKernels().back().second;
+  return kernel;
+}
+
+} // namespace lighthouse
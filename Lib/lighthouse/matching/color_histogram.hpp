@@ -0,0 +1,69 @@
+//
+//  color_histogram.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef color_histogram_hpp
+#define color_histogram_hpp
+
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace lighthouse {
+
+// Adds `aCount` BGRA pixels that start at `aPixels` to the 512 bin counts, pixels with zero alpha are skipped.
+typedef void (*ColorHistogramKernel)(const uint8_t *aPixels, uint32_t aCount, uint32_t *aBinCounts);
+
+// The 8x8x8 B, G, R histogram of masked BGRA frames, exactly what `cv::calcHist` with the alpha channel as a mask
+// followed by `cv::normalize` gives. Bin indices are computed with SIMD and runtime dispatch picks the best kernel the
+// CPU supports (AVX2, SSE2, NEON or scalar), pixels are then counted without branching on the mask.
+class ColorHistogram {
+public:
+  // Number of bins per color channel.
+  static const int kBins = 8;
+  // Total number of bins.
+  static const int kBinCount = kBins * kBins * kBins;
+
+  // Adds pixels to the bin counts with the best supported kernel.
+  static void AddPixels(const uint8_t *aPixels, uint32_t aCount, uint32_t *aBinCounts) {
+    GetKernel()(aPixels, aCount, aBinCounts);
+  }
+
+  // Plain scalar version of the kernels, they all must give exactly the same counts.
+  static void AddPixelsScalar(const uint8_t *aPixels, uint32_t aCount, uint32_t *aBinCounts);
+
+  // Adds a single pixel with the specified channel values, the way all kernels do.
+  static void AddPixel(int aBlue, int aGreen, int aRed, uint32_t *aBinCounts) {
+    aBinCounts[((aBlue >> kBinShift) * kBins + (aGreen >> kBinShift)) * kBins + (aRed >> kBinShift)]++;
+  }
+
+  // Turns bin counts into the L2 normalized 8x8x8 CV_32F histogram: the norm is accumulated in the same pass that
+  // converts counts to floats, a second pass scales them. The histogram is all zeros if there are no counts, as with
+  // `cv::normalize`.
+  static void Normalize(const uint32_t *aBinCounts, cv::Mat &aHistogram);
+
+  // Computes the normalized histogram of the BGRA frame with the specified kernel (the best supported one by default).
+  static void Compute(const cv::Mat &aFrame, cv::Mat &aHistogram, ColorHistogramKernel aKernel = nullptr);
+
+  // Returns name of the kernel `AddPixels` dispatches to.
+  static const std::string &GetKernelName();
+
+  // Returns all kernels the CPU supports, the best one is the last.
+  static std::vector<std::pair<std::string, ColorHistogramKernel>> GetSupportedKernels();
+
+private:
+  // `cv::calcHist` maps [0, 256) uniformly onto the bins, so the bin is just the top bits of the value.
+  static const int kBinShift = 5;
+
+  static ColorHistogramKernel GetKernel();
+};
+
+} // namespace lighthouse
+
+#endif /* color_histogram_hpp */
@@ -0,0 +1,61 @@
+//
+//  db_snapshot.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef db_snapshot_hpp
+#define db_snapshot_hpp
+
+#include <stdio.h>
+#include <memory>
+#include <string>
+
+#include "append_only_vector.hpp"
+#include "descriptor_arena.hpp"
+#include "image_description.hpp"
+#include "inverted_file.hpp"
+#include "lsh_index.hpp"
+#include "multi_index_hash.hpp"
+#include "vocabulary.hpp"
+
+namespace lighthouse {
+
+// Shared handle to a DB item. Items are never modified once added, so handles can be passed around and kept for as
+// long as needed without copying the description and without any locking.
+typedef std::shared_ptr<const ImageDescription> ImageDescriptionPtr;
+
+// Everything matching reads from the DB, frozen at some point in time. Snapshot is never modified once it's published:
+// writers copy the current snapshot, apply their changes to the copy and publish it in place of the current one, while
+// readers keep using whatever snapshot they've started the query with. Copies are cheap: items and indices are
+// append-only containers that share their storage with the snapshot they've been copied from (see
+// `AppendOnlyVector`), and the vocabulary is shared as it is, so a write costs only as much as the items it adds.
+struct DBSnapshot {
+  DBSnapshot(uint32_t aIndexSearchRadius, uint32_t aLshTableCount, uint32_t aLshKeySize, uint32_t aLshProbeRadius)
+      : mDescriptions(), mArena(), mIndex(aIndexSearchRadius), mLshIndex(aLshTableCount, aLshKeySize, aLshProbeRadius),
+        mVocabulary(std::make_shared<const Vocabulary>()), mInvertedFile() {
+  }
+
+  // Returns the item with the specified id, `nullptr` if there is no such item.
+  ImageDescriptionPtr GetDescription(const std::string &aId) const {
+    const int32_t item = mArena.GetItemIndex(aId);
+    return item >= 0 ? mDescriptions[item] : nullptr;
+  }
+
+  // All items, by their index in the arena.
+  AppendOnlyVector<ImageDescriptionPtr> mDescriptions;
+  // Descriptors of all items in `mDescriptions` and indices over them, only the one of the selected backend is filled.
+  DescriptorArena mArena;
+  MultiIndexHash mIndex;
+  LshIndex mLshIndex;
+  // Optional vocabulary and inverted file over bag-of-words vectors of all items in `mDescriptions`, the vocabulary is
+  // never `nullptr` (but may be empty).
+  std::shared_ptr<const Vocabulary> mVocabulary;
+  InvertedFile mInvertedFile;
+};
+
+} // namespace lighthouse
+
+#endif /* db_snapshot_hpp */
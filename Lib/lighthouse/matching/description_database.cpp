@@ -0,0 +1,584 @@
+//
+//  description_database.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "crc32c.hpp"
+#include "description_database.hpp"
+#include "file_sync.hpp"
+#include "mapped_file.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+const char kMagic[4] = {'L', 'H', 'D', 'B'};
+
+// Alignment of every item's descriptors and of everything else in the sections.
+const uint64_t kDescriptorAlignment = OrbDescriptorSet::kAlignment;
+const uint64_t kAlignment = 16;
+
+// Max number of histogram dimensions, color histograms have 3.
+const int kMaxHistogramDims = 3;
+
+// Features the descriptions are made of.
+enum class FeatureType : uint32_t {
+  ORB = 1,
+};
+
+// Sections of the file in the order they're laid out, the table right after the header. Every section runs up to the
+// next one, so it includes the padding before its first item.
+enum class Section : uint32_t {
+  TABLE = 0,
+  DESCRIPTORS = 1,
+  KEYPOINTS = 2,
+  HISTOGRAMS = 3,
+  BOW_VECTORS = 4,
+};
+
+const size_t kSectionCount = 5;
+
+// Magic and version are at the start of every version's header.
+struct DatabaseHeaderV1 {
+  char mMagic[4];
+  uint32_t mVersion;
+  uint64_t mItemCount;
+  uint64_t mFileSize;
+};
+
+struct DatabaseHeader {
+  char mMagic[4];
+  uint32_t mVersion;
+  uint64_t mItemCount;
+  // Size of the whole file, anything shorter has been truncated.
+  uint64_t mFileSize;
+  // `FeatureType`, descriptor size in bytes and ORB `nfeatures` (0 if it isn't known).
+  uint32_t mFeatureType;
+  uint32_t mDescriptorBytes;
+  uint32_t mNumberOfFeatures;
+  uint32_t mReserved;
+  // Indexed by `Section`, offsets are from the start of the file.
+  uint64_t mSectionOffsets[kSectionCount];
+  uint64_t mSectionSizes[kSectionCount];
+  uint32_t mSectionChecksums[kSectionCount];
+  // CRC-32C of all of the above.
+  uint32_t mHeaderChecksum;
+};
+
+// Table entry of versions 1 to 3.
+struct DatabaseItemV1 {
+  char mId[48];
+  uint64_t mDescriptorsOffset;
+  uint64_t mKeypointsOffset;
+  uint64_t mHistogramOffset;
+  uint64_t mBowVectorOffset;
+  uint32_t mFeatureCount;
+  uint32_t mBowWordCount;
+  int32_t mHistogramDims;
+  int32_t mHistogramSizes[kMaxHistogramDims];
+  float mScale;
+  uint32_t mReserved;
+};
+
+// Offsets are from the start of the file. Keypoints are packed as `KeypointSet::WritePacked` writes them, bag-of-words
+// vector is an array of word ids followed by an array of their weights.
+struct DatabaseItem {
+  char mId[48];
+  uint64_t mDescriptorsOffset;
+  uint64_t mKeypointsOffset;
+  uint64_t mHistogramOffset;
+  uint64_t mBowVectorOffset;
+  uint32_t mFeatureCount;
+  uint32_t mBowWordCount;
+  // Histogram is a `CV_32F` matrix with that many dimensions of the sizes, 0 dimensions if it's empty.
+  int32_t mHistogramDims;
+  int32_t mHistogramSizes[kMaxHistogramDims];
+  float mScale;
+  // See `DescriptionDatabase::GetPayloadChecksum`, 0 for the entries upgraded from older versions.
+  uint32_t mPayloadChecksum;
+  // CRC-32C of the item's histogram and bag-of-words vector followed by all of the above, so that the entry can be
+  // checked on its own along with everything that is read at load.
+  uint32_t mChecksum;
+};
+
+static_assert(std::is_pod<DatabaseHeaderV1>::value && std::is_pod<DatabaseHeader>::value &&
+    std::is_pod<DatabaseItemV1>::value && std::is_pod<DatabaseItem>::value,
+    "DB header and items are written as they're laid out in memory!");
+static_assert(sizeof(DatabaseHeaderV1) % 8 == 0 && sizeof(DatabaseHeader) % 8 == 0 &&
+    sizeof(DatabaseItemV1) % 8 == 0 && sizeof(DatabaseItem) % 8 == 0, "DB items have to stay 8-byte aligned!");
+
+// First version whose table entries have checksums of their own and of their payload.
+const uint32_t kItemChecksumsVersion = 4;
+
+uint64_t Align(uint64_t aOffset, uint64_t aAlignment) {
+  return (aOffset + aAlignment - 1) / aAlignment * aAlignment;
+}
+
+uint64_t GetHistogramSize(const int32_t *aSizes, int32_t aDims) {
+  uint64_t size = aDims > 0 ? sizeof(float) : 0;
+  for (int32_t dim = 0; dim < aDims; ++dim) {
+    size *= (uint64_t) std::max(aSizes[dim], 0);
+  }
+  return size;
+}
+
+// Writes the file after the header section by section, keeping the checksum of every section in the header.
+class SectionWriter {
+public:
+  SectionWriter(std::ostream &aStream, DatabaseHeader &aHeader)
+      : mStream(aStream), mHeader(aHeader), mPosition(sizeof(DatabaseHeader)), mChecksum(nullptr) {
+  }
+
+  // Everything written from now on is in the section, it should start right here.
+  void BeginSection(Section aSection) {
+    mChecksum = &mHeader.mSectionChecksums[(size_t) aSection];
+    *mChecksum = 0;
+  }
+
+  void Write(const void *aData, uint64_t aSize) {
+    mStream.write(static_cast<const char *>(aData), aSize);
+    *mChecksum = Crc32c::Update(*mChecksum, aData, aSize);
+    mPosition += aSize;
+  }
+
+  // Writes zeros up to the offset.
+  void PadTo(uint64_t aOffset) {
+    static const char kZeros[kDescriptorAlignment] = {};
+    Write(kZeros, aOffset - mPosition);
+  }
+
+private:
+  std::ostream &mStream;
+  DatabaseHeader &mHeader;
+  uint64_t mPosition;
+  uint32_t *mChecksum;
+};
+
+// Checks that `aSize` bytes at the offset are within the file and that the offset is aligned.
+void CheckRange(const MappedFile &aFile, uint64_t aOffset, uint64_t aSize, uint64_t aAlignment) {
+  if (aOffset > aFile.GetSize() || aSize > aFile.GetSize() - aOffset || aOffset % aAlignment != 0) {
+    throw std::runtime_error("Description DB item points outside of the file!");
+  }
+}
+
+// Size of the table entries of the version.
+uint64_t GetItemSize(uint32_t aVersion) {
+  return aVersion >= kItemChecksumsVersion ? sizeof(DatabaseItem) : sizeof(DatabaseItemV1);
+}
+
+// Checks that the table holds exactly the header's items.
+void CheckTable(const MappedFile &aFile, const DatabaseHeader &aHeader) {
+  const uint64_t tableSize = aHeader.mSectionSizes[(size_t) Section::TABLE];
+  const uint64_t itemSize = GetItemSize(aHeader.mVersion);
+  CheckRange(aFile, aHeader.mSectionOffsets[(size_t) Section::TABLE], tableSize, 8);
+  if (tableSize % itemSize != 0 || tableSize / itemSize != aHeader.mItemCount) {
+    throw std::runtime_error("Description DB table doesn't match its item count!");
+  }
+}
+
+// Returns the table entry in the current version's layout, entries of older versions have no checksums.
+DatabaseItem ReadItem(const uint8_t *aTable, uint64_t aIndex, uint32_t aVersion) {
+  DatabaseItem item;
+  if (aVersion >= kItemChecksumsVersion) {
+    memcpy(&item, aTable + aIndex * sizeof(DatabaseItem), sizeof(item));
+    return item;
+  }
+
+  DatabaseItemV1 itemV1;
+  memcpy(&itemV1, aTable + aIndex * sizeof(DatabaseItemV1), sizeof(itemV1));
+  memset(&item, 0, sizeof(item));
+  memcpy(item.mId, itemV1.mId, sizeof(item.mId));
+  item.mDescriptorsOffset = itemV1.mDescriptorsOffset;
+  item.mKeypointsOffset = itemV1.mKeypointsOffset;
+  item.mHistogramOffset = itemV1.mHistogramOffset;
+  item.mBowVectorOffset = itemV1.mBowVectorOffset;
+  item.mFeatureCount = itemV1.mFeatureCount;
+  item.mBowWordCount = itemV1.mBowWordCount;
+  item.mHistogramDims = itemV1.mHistogramDims;
+  memcpy(item.mHistogramSizes, itemV1.mHistogramSizes, sizeof(item.mHistogramSizes));
+  item.mScale = itemV1.mScale;
+  return item;
+}
+
+// Checksum of the item's histogram and bag-of-words vector (which must be within the file) followed by the entry, see
+// `DatabaseItem::mChecksum`.
+uint32_t GetItemChecksum(const uint8_t *aData, const DatabaseItem &aItem) {
+  uint32_t checksum = Crc32c::Compute(aData + aItem.mHistogramOffset,
+      GetHistogramSize(aItem.mHistogramSizes, aItem.mHistogramDims));
+  checksum = Crc32c::Update(checksum, aData + aItem.mBowVectorOffset,
+      (uint64_t) aItem.mBowWordCount * (sizeof(uint32_t) + sizeof(float)));
+  return Crc32c::Update(checksum, &aItem, offsetof(DatabaseItem, mChecksum));
+}
+
+// Checks that the entry's id is terminated and that everything it points at is within the file.
+void CheckItem(const MappedFile &aFile, const DatabaseItem &aItem) {
+  if (memchr(aItem.mId, 0, sizeof(aItem.mId)) == nullptr) {
+    throw std::runtime_error("Description DB item id is not terminated!");
+  }
+
+  CheckRange(aFile, aItem.mDescriptorsOffset, (uint64_t) aItem.mFeatureCount * sizeof(OrbDescriptorSet::Row),
+      sizeof(uint64_t));
+  CheckRange(aFile, aItem.mKeypointsOffset, KeypointSet::GetPackedSize(aItem.mFeatureCount), sizeof(float));
+  if (aItem.mHistogramDims < 0 || aItem.mHistogramDims > kMaxHistogramDims) {
+    throw std::runtime_error("Description DB item histogram has too many dimensions!");
+  }
+  CheckRange(aFile, aItem.mHistogramOffset, GetHistogramSize(aItem.mHistogramSizes, aItem.mHistogramDims),
+      sizeof(float));
+  CheckRange(aFile, aItem.mBowVectorOffset, (uint64_t) aItem.mBowWordCount * (sizeof(uint32_t) + sizeof(float)),
+      sizeof(uint32_t));
+}
+
+// Returns the description of the checked entry, a view into the mapping.
+ImageDescription MakeDescription(const std::shared_ptr<const MappedFile> &aFile, const DatabaseItem &aItem) {
+  const uint8_t *data = aFile->GetData();
+  const bool hasHistogram = GetHistogramSize(aItem.mHistogramSizes, aItem.mHistogramDims) > 0;
+  const cv::Mat histogram = hasHistogram ? cv::Mat(aItem.mHistogramDims, aItem.mHistogramSizes, CV_32F,
+      const_cast<uint8_t *>(data + aItem.mHistogramOffset)) : cv::Mat();
+
+  // Words are in the map's order, so every one goes right at the end.
+  const uint32_t *words = reinterpret_cast<const uint32_t *>(data + aItem.mBowVectorOffset);
+  const float *weights = reinterpret_cast<const float *>(words + aItem.mBowWordCount);
+  BowVector bowVector;
+  for (uint32_t word = 0; word < aItem.mBowWordCount; ++word) {
+    bowVector.emplace_hint(bowVector.end(), words[word], weights[word]);
+  }
+
+  return ImageDescription(aItem.mId, KeypointSet(data + aItem.mKeypointsOffset, aItem.mFeatureCount, aFile),
+      OrbDescriptorSet(data + aItem.mDescriptorsOffset, aItem.mFeatureCount, aFile), histogram, bowVector,
+      aItem.mScale, aFile);
+}
+
+// Headers of version 2 and later, they share the layout.
+DatabaseHeader ReadHeaderV2(const MappedFile &aFile) {
+  DatabaseHeader header;
+  if (aFile.GetSize() < sizeof(header)) {
+    throw std::runtime_error("Description DB is too short!");
+  }
+  memcpy(&header, aFile.GetData(), sizeof(header));
+  if (header.mHeaderChecksum != Crc32c::Compute(&header, offsetof(DatabaseHeader, mHeaderChecksum))) {
+    throw std::runtime_error("Description DB header is corrupt!");
+  }
+  if (header.mFileSize != aFile.GetSize()) {
+    throw std::runtime_error("Description DB has been truncated!");
+  }
+  for (size_t section = 0; section < kSectionCount; ++section) {
+    CheckRange(aFile, header.mSectionOffsets[section], header.mSectionSizes[section], 1);
+  }
+  CheckTable(aFile, header);
+  return header;
+}
+
+// Version 1 header was followed by the table right away, and the table hasn't changed since. It has no sections or
+// checksums, so only the table is described.
+DatabaseHeader UpgradeHeaderV1(const MappedFile &aFile) {
+  DatabaseHeaderV1 headerV1;
+  if (aFile.GetSize() < sizeof(headerV1)) {
+    throw std::runtime_error("Description DB is too short!");
+  }
+  memcpy(&headerV1, aFile.GetData(), sizeof(headerV1));
+  if (headerV1.mFileSize != aFile.GetSize()) {
+    throw std::runtime_error("Description DB has been truncated!");
+  }
+
+  DatabaseHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.mMagic, headerV1.mMagic, sizeof(header.mMagic));
+  header.mVersion = headerV1.mVersion;
+  header.mItemCount = headerV1.mItemCount;
+  header.mFileSize = headerV1.mFileSize;
+  header.mFeatureType = (uint32_t) FeatureType::ORB;
+  header.mDescriptorBytes = sizeof(OrbDescriptorSet::Row);
+  header.mSectionOffsets[(size_t) Section::TABLE] = sizeof(headerV1);
+  // Item count that doesn't fit into the file is refused by `CheckTable`, it must not overflow meanwhile.
+  header.mSectionSizes[(size_t) Section::TABLE] =
+      std::min<uint64_t>(header.mItemCount, aFile.GetSize() / sizeof(DatabaseItemV1) + 1) * sizeof(DatabaseItemV1);
+  CheckTable(aFile, header);
+  return header;
+}
+
+// Validates the header of the file, and only the header, and returns it in the current version's layout whatever the
+// version of the file is.
+DatabaseHeader ReadHeader(const MappedFile &aFile) {
+  char magic[sizeof(kMagic)];
+  uint32_t version;
+  if (aFile.GetSize() < sizeof(magic) + sizeof(version)) {
+    throw std::runtime_error("Description DB is too short!");
+  }
+  memcpy(magic, aFile.GetData(), sizeof(magic));
+  memcpy(&version, aFile.GetData() + sizeof(magic), sizeof(version));
+  if (memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error("File is not a description DB!");
+  }
+
+  switch (version) {
+    case 1:
+      return UpgradeHeaderV1(aFile);
+    case 2:
+    case 3:
+    case DescriptionDatabase::kVersion:
+      return ReadHeaderV2(aFile);
+    default:
+      throw std::runtime_error("Description DB version " + std::to_string(version) + " is not supported!");
+  }
+}
+
+} // namespace
+
+/*static*/ uint32_t DescriptionDatabase::GetPayloadChecksum(const ImageDescription &aDescription) {
+  const OrbDescriptorSet &descriptors = aDescription.GetDescriptorSet();
+  const uint32_t checksum = Crc32c::Compute(descriptors.GetData(), descriptors.Size() * sizeof(OrbDescriptorSet::Row));
+
+  // Keypoints of a view are packed already.
+  const KeypointSet &keypoints = aDescription.GetKeypoints();
+  if (keypoints.IsView()) {
+    return Crc32c::Update(checksum, keypoints.GetX(), KeypointSet::GetPackedSize(keypoints.Size()));
+  }
+
+  std::ostringstream packedKeypoints;
+  keypoints.WritePacked(packedKeypoints);
+  return Crc32c::Update(checksum, packedKeypoints.str().data(), KeypointSet::GetPackedSize(keypoints.Size()));
+}
+
+/*static*/ std::vector<ImageDescription> DescriptionDatabase::Load(const std::string &aPath,
+    DescriptionDatabaseInfo *aInfo) {
+  const std::shared_ptr<const MappedFile> file = std::make_shared<const MappedFile>(aPath);
+  const uint8_t *data = file->GetData();
+
+  const DatabaseHeader header = ReadHeader(*file);
+  if (header.mFeatureType != (uint32_t) FeatureType::ORB ||
+      header.mDescriptorBytes != sizeof(OrbDescriptorSet::Row)) {
+    throw std::runtime_error("Description DB is made of other features!");
+  }
+
+  // Header is fine, so the table is worth reading. Entries of the current version check their histograms and
+  // bag-of-words vectors themselves, payload of every item is checked once it's needed (see `GetPayloadChecksum`), so
+  // the payload sections aren't read at all. Files of older versions have only the section checksums, so all of them
+  // are checked, and payload pages are dropped again once they're checked.
+  const bool hasItemChecksums = header.mVersion >= kItemChecksumsVersion;
+  for (size_t section = 0; section < kSectionCount && header.mVersion >= 2; ++section) {
+    if (hasItemChecksums && section != (size_t) Section::TABLE) {
+      continue;
+    }
+
+    if (Crc32c::Compute(data + header.mSectionOffsets[section], header.mSectionSizes[section]) !=
+        header.mSectionChecksums[section]) {
+      throw std::runtime_error("Description DB section " + std::to_string(section) + " is corrupt!");
+    }
+    if (section == (size_t) Section::DESCRIPTORS || section == (size_t) Section::KEYPOINTS) {
+      MappedFile::Release(data + header.mSectionOffsets[section], header.mSectionSizes[section]);
+    }
+  }
+
+  if (aInfo != nullptr) {
+    aInfo->mVersion = header.mVersion;
+    aInfo->mNumberOfFeatures = header.mNumberOfFeatures;
+    aInfo->mPayloadChecksums.clear();
+  }
+
+  std::vector<ImageDescription> descriptions;
+  descriptions.reserve(header.mItemCount);
+  const uint8_t *table = data + header.mSectionOffsets[(size_t) Section::TABLE];
+  for (uint64_t i = 0; i < header.mItemCount; ++i) {
+    const DatabaseItem item = ReadItem(table, i, header.mVersion);
+    CheckItem(*file, item);
+    if (hasItemChecksums) {
+      if (GetItemChecksum(data, item) != item.mChecksum) {
+        throw std::runtime_error("Description DB item " + std::to_string(i) + " is corrupt!");
+      }
+      if (aInfo != nullptr) {
+        aInfo->mPayloadChecksums[item.mId] = item.mPayloadChecksum;
+      }
+    }
+    descriptions.push_back(MakeDescription(file, item));
+  }
+
+  return descriptions;
+}
+
+/*static*/ std::vector<ImageDescription> DescriptionDatabase::Salvage(const std::string &aPath) {
+  const std::shared_ptr<const MappedFile> file = std::make_shared<const MappedFile>(aPath);
+  const uint8_t *data = file->GetData();
+
+  // Neither the header nor the table checksum is trusted, only the entries themselves: the table is where the current
+  // version writes it, and it ends before the descriptors of any item, they're laid out right after it.
+  std::vector<ImageDescription> descriptions;
+  uint64_t tableEnd = file->GetSize();
+  for (uint64_t offset = sizeof(DatabaseHeader); offset + sizeof(DatabaseItem) <= tableEnd;
+      offset += sizeof(DatabaseItem)) {
+    DatabaseItem item;
+    memcpy(&item, data + offset, sizeof(item));
+    try {
+      CheckItem(*file, item);
+    } catch (const std::runtime_error &) {
+      continue;
+    }
+    if (GetItemChecksum(data, item) != item.mChecksum) {
+      continue;
+    }
+
+    tableEnd = std::min(tableEnd, item.mDescriptorsOffset);
+    const ImageDescription description = MakeDescription(file, item);
+    if (GetPayloadChecksum(description) == item.mPayloadChecksum) {
+      descriptions.push_back(description);
+    }
+  }
+
+  return descriptions;
+}
+
+/*static*/ void DescriptionDatabase::Save(const std::vector<ImageDescriptionPtr> &aDescriptions,
+    uint32_t aNumberOfFeatures, const std::string &aPath) {
+  DatabaseHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.mMagic, kMagic, sizeof(kMagic));
+  header.mVersion = kVersion;
+  header.mItemCount = aDescriptions.size();
+  header.mFeatureType = (uint32_t) FeatureType::ORB;
+  header.mDescriptorBytes = sizeof(OrbDescriptorSet::Row);
+  header.mNumberOfFeatures = aNumberOfFeatures;
+
+  // Lay the sections out first, the table that points into them comes before them.
+  std::vector<DatabaseItem> items(aDescriptions.size());
+  header.mSectionOffsets[(size_t) Section::TABLE] = sizeof(header);
+  uint64_t offset = sizeof(header) + items.size() * sizeof(DatabaseItem);
+  header.mSectionOffsets[(size_t) Section::DESCRIPTORS] = offset;
+  for (size_t i = 0; i < items.size(); ++i) {
+    const ImageDescription &description = *aDescriptions[i];
+    if (description.GetId().size() >= sizeof(items[i].mId)) {
+      throw std::invalid_argument("Description id is too long for the DB!");
+    }
+
+    memset(&items[i], 0, sizeof(DatabaseItem));
+    memcpy(items[i].mId, description.GetId().c_str(), description.GetId().size());
+    items[i].mFeatureCount = description.GetDescriptorSet().Size();
+    if (description.GetKeypoints().Size() != items[i].mFeatureCount) {
+      throw std::invalid_argument("Every DB description feature must have both keypoint and descriptor!");
+    }
+
+    offset = Align(offset, kDescriptorAlignment);
+    items[i].mDescriptorsOffset = offset;
+    offset += description.GetDescriptorSet().Size() * sizeof(OrbDescriptorSet::Row);
+  }
+  header.mSectionOffsets[(size_t) Section::KEYPOINTS] = offset;
+  for (size_t i = 0; i < items.size(); ++i) {
+    offset = Align(offset, kAlignment);
+    items[i].mKeypointsOffset = offset;
+    offset += KeypointSet::GetPackedSize(items[i].mFeatureCount);
+  }
+  header.mSectionOffsets[(size_t) Section::HISTOGRAMS] = offset;
+  for (size_t i = 0; i < items.size(); ++i) {
+    const cv::Mat &histogram = aDescriptions[i]->GetHistogram();
+    if (!histogram.empty() && (histogram.type() != CV_32F || histogram.dims > kMaxHistogramDims)) {
+      throw std::invalid_argument("Only `CV_32F` histograms of up to 3 dimensions can be stored in the DB!");
+    }
+    items[i].mHistogramDims = histogram.empty() ? 0 : histogram.dims;
+    for (int dim = 0; dim < items[i].mHistogramDims; ++dim) {
+      items[i].mHistogramSizes[dim] = histogram.size[dim];
+    }
+
+    offset = Align(offset, kAlignment);
+    items[i].mHistogramOffset = offset;
+    offset += GetHistogramSize(items[i].mHistogramSizes, items[i].mHistogramDims);
+  }
+  header.mSectionOffsets[(size_t) Section::BOW_VECTORS] = offset;
+  for (size_t i = 0; i < items.size(); ++i) {
+    items[i].mBowWordCount = aDescriptions[i]->GetBowVector().size();
+    items[i].mScale = aDescriptions[i]->GetScale();
+
+    offset = Align(offset, kAlignment);
+    items[i].mBowVectorOffset = offset;
+    offset += (uint64_t) items[i].mBowWordCount * (sizeof(uint32_t) + sizeof(float));
+  }
+  header.mFileSize = offset;
+  for (size_t section = 0; section < kSectionCount; ++section) {
+    const uint64_t sectionEnd = section + 1 < kSectionCount ? header.mSectionOffsets[section + 1] : header.mFileSize;
+    header.mSectionSizes[section] = sectionEnd - header.mSectionOffsets[section];
+  }
+
+  const std::string temporaryPath = aPath + ".tmp";
+  {
+    std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+    // Header and table are written again once the checksums are known.
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    SectionWriter writer(stream, header);
+
+    writer.BeginSection(Section::TABLE);
+    writer.Write(items.data(), items.size() * sizeof(DatabaseItem));
+
+    writer.BeginSection(Section::DESCRIPTORS);
+    for (size_t i = 0; i < items.size(); ++i) {
+      const OrbDescriptorSet &descriptors = aDescriptions[i]->GetDescriptorSet();
+      writer.PadTo(items[i].mDescriptorsOffset);
+      writer.Write(descriptors.GetData(), descriptors.Size() * sizeof(OrbDescriptorSet::Row));
+      items[i].mPayloadChecksum = Crc32c::Compute(descriptors.GetData(),
+          descriptors.Size() * sizeof(OrbDescriptorSet::Row));
+    }
+    writer.BeginSection(Section::KEYPOINTS);
+    for (size_t i = 0; i < items.size(); ++i) {
+      std::ostringstream keypoints;
+      aDescriptions[i]->GetKeypoints().WritePacked(keypoints);
+      writer.PadTo(items[i].mKeypointsOffset);
+      writer.Write(keypoints.str().data(), KeypointSet::GetPackedSize(items[i].mFeatureCount));
+      items[i].mPayloadChecksum = Crc32c::Update(items[i].mPayloadChecksum, keypoints.str().data(),
+          KeypointSet::GetPackedSize(items[i].mFeatureCount));
+    }
+
+    // Item checksums start with the histogram and the bag-of-words vector.
+    writer.BeginSection(Section::HISTOGRAMS);
+    for (size_t i = 0; i < items.size(); ++i) {
+      // Copy is continuous even if the histogram is a view of a larger matrix.
+      const cv::Mat histogram = aDescriptions[i]->GetHistogram().clone();
+      const uint64_t histogramSize = GetHistogramSize(items[i].mHistogramSizes, items[i].mHistogramDims);
+      writer.PadTo(items[i].mHistogramOffset);
+      writer.Write(histogram.data, histogramSize);
+      items[i].mChecksum = Crc32c::Compute(histogram.data, histogramSize);
+    }
+    writer.BeginSection(Section::BOW_VECTORS);
+    for (size_t i = 0; i < items.size(); ++i) {
+      const BowVector &bowVector = aDescriptions[i]->GetBowVector();
+      writer.PadTo(items[i].mBowVectorOffset);
+      for (const auto &word : bowVector) {
+        writer.Write(&word.first, sizeof(uint32_t));
+        items[i].mChecksum = Crc32c::Update(items[i].mChecksum, &word.first, sizeof(uint32_t));
+      }
+      for (const auto &word : bowVector) {
+        writer.Write(&word.second, sizeof(float));
+        items[i].mChecksum = Crc32c::Update(items[i].mChecksum, &word.second, sizeof(float));
+      }
+    }
+
+    for (DatabaseItem &item : items) {
+      item.mChecksum = Crc32c::Update(item.mChecksum, &item, offsetof(DatabaseItem, mChecksum));
+    }
+    header.mSectionChecksums[(size_t) Section::TABLE] = Crc32c::Compute(items.data(),
+        items.size() * sizeof(DatabaseItem));
+    stream.seekp(header.mSectionOffsets[(size_t) Section::TABLE]);
+    stream.write(reinterpret_cast<const char *>(items.data()), items.size() * sizeof(DatabaseItem));
+
+    header.mHeaderChecksum = Crc32c::Compute(&header, offsetof(DatabaseHeader, mHeaderChecksum));
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    stream.flush();
+    if (!stream.good()) {
+      throw std::runtime_error("Couldn't write description DB to " + temporaryPath + "!");
+    }
+  }
+
+  FileSync::Replace(temporaryPath, aPath);
+}
+
+} // namespace lighthouse
@@ -0,0 +1,84 @@
+//
+//  description_database.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef description_database_hpp
+#define description_database_hpp
+
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "db_snapshot.hpp"
+#include "image_description.hpp"
+
+namespace lighthouse {
+
+// What the header of a description DB records besides its layout.
+struct DescriptionDatabaseInfo {
+  // Format version the file has been written in.
+  uint32_t mVersion;
+  // ORB `nfeatures` the descriptions have been extracted with, 0 if it isn't known (files of version 1).
+  uint32_t mNumberOfFeatures;
+  // Checksums of the items' payloads (see `DescriptionDatabase::GetPayloadChecksum`) by item id, the payloads haven't
+  // been checked at load. Empty for files of versions before 4, their payloads are checked at load.
+  std::unordered_map<std::string, uint32_t> mPayloadChecksums;
+};
+
+// All DB item descriptions in a single file that is memory-mapped rather than read: a fixed header, a table with an
+// entry per item, and then descriptor, keypoint, histogram and bag-of-words sections, every item's data aligned within
+// them (descriptors to the cache line size). Loaded descriptions are views into the mapping, so loading costs a few
+// pointers per item and pages are read only once something touches them. Only ids and bag-of-words vectors (they're
+// `std::map`s) are copied out.
+//
+// The header records the format version, the features the descriptions are made of (type, descriptor size, ORB
+// `nfeatures`), where every section starts and how long it is, a CRC-32C of every section and a CRC-32C of the header
+// itself. A file that has been truncated, garbled or written by a newer version is rejected by its header alone, before
+// any item is looked at. Every table entry has a CRC-32C of its own (which covers the item's histogram and bag-of-words
+// vector too) and one of the item's payload (descriptors and keypoints). Loading checks the header, the table and the
+// entries, but not the payload sections, so that it doesn't read the bulk of the file: payload of an item is checked
+// against its checksum once it's needed (see `PayloadCache`). Files of older versions are read by the loader of their
+// version and upgraded in memory, they have only the section checksums, so all sections are checked at load.
+class DescriptionDatabase {
+public:
+  // Maps the file and returns its descriptions, they keep the mapping alive. `aInfo` (if given) is set from the header,
+  // a file of a version other than `kVersion` should be saved again. Throws `std::runtime_error` if the file can't be
+  // mapped or isn't a valid DB of the supported features.
+  static std::vector<ImageDescription> Load(const std::string &aPath, DescriptionDatabaseInfo *aInfo = nullptr);
+
+  // Recovers the intact items of a file of the current version that `Load` has rejected: every item whose table entry,
+  // histogram, bag-of-words vector, keypoints and descriptors match their checksums is returned, whatever is wrong with
+  // the header, the rest of the table or the other items. Payloads are checked here, so the descriptions need no
+  // further checks. Files of older versions have no item checksums, nothing is recovered from them. Throws
+  // `std::runtime_error` if the file can't be mapped.
+  static std::vector<ImageDescription> Salvage(const std::string &aPath);
+
+  // Writes the descriptions into a temporary file that then durably replaces the DB file, so that the DB is never left
+  // half-written. Descriptions that are views into the replaced file stay valid. `aNumberOfFeatures` is the ORB
+  // `nfeatures` they've been extracted with. Payloads are checksummed as they are, so the ones that haven't been
+  // checked against their checksums yet should be before they're saved again. Throws `std::runtime_error` if the file
+  // can't be written.
+  static void Save(const std::vector<ImageDescriptionPtr> &aDescriptions, uint32_t aNumberOfFeatures,
+      const std::string &aPath);
+
+  // CRC-32C of the description's descriptor rows followed by its keypoints packed as `KeypointSet::WritePacked` writes
+  // them, the way the DB records it for every item.
+  static uint32_t GetPayloadChecksum(const ImageDescription &aDescription);
+
+  // Format version written into the header. Version 1 had no feature parameters, sections or checksums, version 3 has
+  // the layout of version 2, versions before 4 had no item checksums.
+  static const uint32_t kVersion = 4;
+
+  // First version whose histograms are all masked. Items of older files may have histograms of the whole frame,
+  // background included, and should have them recomputed from their source images before the file is saved again.
+  static const uint32_t kMaskedHistogramsVersion = 3;
+};
+
+} // namespace lighthouse
+
+#endif /* description_database_hpp */
@@ -0,0 +1,298 @@
+//
+//  description_journal.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <cereal/archives/binary.hpp>
+
+#include "crc32c.hpp"
+#include "description_journal.hpp"
+#include "file_sync.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+const uint32_t kRecordMagic = 0x564A484C; // "LHJV"
+// Records written before they had a version, their header is `RecordHeaderV1`.
+const uint32_t kRecordMagicV1 = 0x524A484C; // "LHJR"
+
+// Format of the record, bumped whenever the way the description is serialized into it changes. Records of newer
+// versions are skipped, older ones are read by `ImageDescription::Load` (it upgrades older descriptions).
+const uint32_t kRecordVersion = 2;
+
+// Precedes every serialized description. Checksum covers the version, the size and the description.
+struct RecordHeader {
+  uint32_t mMagic;
+  uint32_t mVersion;
+  uint32_t mSize;
+  uint32_t mChecksum;
+};
+
+struct RecordHeaderV1 {
+  uint32_t mMagic;
+  uint32_t mSize;
+  uint32_t mChecksum;
+};
+
+uint32_t GetChecksum(const RecordHeader &aHeader, const char *aData) {
+  // Version 1 records have no version to cover.
+  const uint32_t headerChecksum = aHeader.mVersion == 1 ? Crc32c::Compute(&aHeader.mSize, sizeof(aHeader.mSize)) :
+      Crc32c::Compute(&aHeader.mVersion, sizeof(aHeader.mVersion) + sizeof(aHeader.mSize));
+  return Crc32c::Update(headerChecksum, aData, aHeader.mSize);
+}
+
+// Reads the header of the record at the offset in the layout of the current version, returns its size or 0 if there
+// is no header of any version.
+size_t ReadRecordHeader(const std::vector<char> &aJournal, size_t aOffset, RecordHeader &aHeader) {
+  uint32_t magic;
+  if (aOffset + sizeof(magic) > aJournal.size()) {
+    return 0;
+  }
+  memcpy(&magic, aJournal.data() + aOffset, sizeof(magic));
+
+  if (magic == kRecordMagic && aOffset + sizeof(RecordHeader) <= aJournal.size()) {
+    memcpy(&aHeader, aJournal.data() + aOffset, sizeof(aHeader));
+    return aHeader.mVersion != 1 ? sizeof(RecordHeader) : 0;
+  }
+  if (magic == kRecordMagicV1 && aOffset + sizeof(RecordHeaderV1) <= aJournal.size()) {
+    RecordHeaderV1 headerV1;
+    memcpy(&headerV1, aJournal.data() + aOffset, sizeof(headerV1));
+    aHeader = {kRecordMagic, 1, headerV1.mSize, headerV1.mChecksum};
+    return sizeof(RecordHeaderV1);
+  }
+  return 0;
+}
+
+// Writes all the bytes, returns false if the write has failed.
+bool WriteAll(int aFile, const char *aData, size_t aSize) {
+  while (aSize > 0) {
+    const ssize_t written = write(aFile, aData, aSize);
+    if (written < 0) {
+      return false;
+    }
+    aData += written;
+    aSize -= written;
+  }
+  return true;
+}
+
+// Reads `aSize` bytes at the offset, returns false if the read has failed or the file is shorter.
+bool ReadAll(int aFile, uint64_t aOffset, char *aData, size_t aSize) {
+  while (aSize > 0) {
+    const ssize_t read = pread(aFile, aData, aSize, aOffset);
+    if (read <= 0) {
+      return false;
+    }
+    aData += read;
+    aSize -= read;
+    aOffset += read;
+  }
+  return true;
+}
+
+} // namespace
+
+DescriptionJournal::DescriptionJournal(const std::string &aPath)
+    : mPath(aPath), mMutex(), mFile(-1), mRecordCount(0), mBaseOffset(0), mEndOffset(0), mSyncedOffset(0),
+      mIsSyncing(false), mSyncCondition() {
+  Open();
+
+  struct stat status;
+  if (fstat(mFile, &status) != 0) {
+    close(mFile);
+    throw std::runtime_error("Couldn't get size of " + mPath + "!");
+  }
+  mEndOffset = mSyncedOffset = status.st_size;
+}
+
+DescriptionJournal::~DescriptionJournal() {
+  close(mFile);
+}
+
+std::vector<ImageDescription> DescriptionJournal::Recover() {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  std::vector<char> journal(mEndOffset - mBaseOffset);
+  if (!ReadAll(mFile, 0, journal.data(), journal.size())) {
+    throw std::runtime_error("Couldn't read " + mPath + "!");
+  }
+
+  // Records are scanned up to the first one that isn't intact, nothing after it can be trusted.
+  std::vector<ImageDescription> descriptions;
+  size_t offset = 0;
+  uint32_t skippedCount = 0;
+  while (true) {
+    RecordHeader header;
+    const size_t headerSize = ReadRecordHeader(journal, offset, header);
+    const char *record = journal.data() + offset + headerSize;
+    if (headerSize == 0 || header.mSize > journal.size() - offset - headerSize ||
+        header.mChecksum != GetChecksum(header, record)) {
+      break;
+    }
+
+    if (header.mVersion > kRecordVersion) {
+      // Intact, only written by a newer version, so the records after it can still be read.
+      skippedCount++;
+    } else {
+      try {
+        std::istringstream stream(std::string(record, header.mSize));
+        descriptions.push_back(ImageDescription::Load(stream));
+      } catch (const cereal::Exception &e) {
+        fprintf(stderr, "DescriptionJournal::Recover() couldn't deserialize record at %lu (reason: %s).\n", offset,
+            e.what());
+        break;
+      }
+    }
+
+    offset += headerSize + header.mSize;
+  }
+
+  if (skippedCount > 0) {
+    fprintf(stderr, "DescriptionJournal::Recover() skipped %u record(s) of a newer version.\n", skippedCount);
+  }
+  if (offset < journal.size()) {
+    fprintf(stderr, "DescriptionJournal::Recover() dropped %lu byte(s) after the last intact record.\n",
+        journal.size() - offset);
+    if (ftruncate(mFile, offset) != 0) {
+      throw std::runtime_error("Couldn't truncate " + mPath + "!");
+    }
+    FileSync::Sync(mFile);
+  }
+
+  mRecordCount = descriptions.size();
+  mBaseOffset = 0;
+  mEndOffset = mSyncedOffset = offset;
+  return descriptions;
+}
+
+void DescriptionJournal::Append(const ImageDescription &aDescription) {
+  std::ostringstream stream;
+  ImageDescription::Save(aDescription, stream);
+  const std::string description = stream.str();
+
+  RecordHeader header;
+  header.mMagic = kRecordMagic;
+  header.mVersion = kRecordVersion;
+  header.mSize = description.size();
+  header.mChecksum = GetChecksum(header, description.data());
+
+  std::string record(reinterpret_cast<const char *>(&header), sizeof(header));
+  record += description;
+
+  std::unique_lock<std::mutex> lock(mMutex);
+
+  if (!WriteAll(mFile, record.data(), record.size())) {
+    // Whatever has made it to the file would hide the records appended after it.
+    if (ftruncate(mFile, mEndOffset - mBaseOffset) != 0) {
+      fprintf(stderr, "DescriptionJournal::Append() couldn't cut the partial record off.\n");
+    }
+    throw std::runtime_error("Couldn't append to " + mPath + "!");
+  }
+
+  mRecordCount++;
+  mEndOffset += record.size();
+  const uint64_t recordEndOffset = mEndOffset;
+
+  // Group commit: one flush makes every record written before it durable, so whoever flushes does it for everybody
+  // who has written a record by then, and the ones who come meanwhile wait for it and flush only what's left.
+  while (mSyncedOffset < recordEndOffset) {
+    if (mIsSyncing) {
+      mSyncCondition.wait(lock);
+      continue;
+    }
+
+    mIsSyncing = true;
+    const uint64_t syncedOffset = mEndOffset;
+    lock.unlock();
+    bool isSynced = true;
+    try {
+      FileSync::Sync(mFile);
+    } catch (const std::runtime_error &e) {
+      isSynced = false;
+    }
+    lock.lock();
+
+    mIsSyncing = false;
+    if (isSynced) {
+      mSyncedOffset = std::max(mSyncedOffset, syncedOffset);
+    }
+    mSyncCondition.notify_all();
+
+    if (!isSynced) {
+      throw std::runtime_error("Couldn't flush " + mPath + "!");
+    }
+  }
+}
+
+uint32_t DescriptionJournal::GetRecordCount() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mRecordCount;
+}
+
+uint64_t DescriptionJournal::GetSize() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mEndOffset - mBaseOffset;
+}
+
+void DescriptionJournal::Compact(const std::function<void()> &aSave) {
+  uint64_t foldedOffset;
+  uint32_t foldedRecordCount;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    foldedOffset = mEndOffset;
+    foldedRecordCount = mRecordCount;
+  }
+
+  aSave();
+
+  // File can't be replaced while somebody is flushing it.
+  std::unique_lock<std::mutex> lock(mMutex);
+  mSyncCondition.wait(lock, [this]() { return !mIsSyncing; });
+
+  // Records appended while the DB was being saved are moved into a new journal that replaces this one.
+  std::vector<char> tail(mEndOffset - foldedOffset);
+  if (!ReadAll(mFile, foldedOffset - mBaseOffset, tail.data(), tail.size())) {
+    throw std::runtime_error("Couldn't read " + mPath + "!");
+  }
+
+  const std::string temporaryPath = mPath + ".tmp";
+  const int temporaryFile = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (temporaryFile < 0) {
+    throw std::runtime_error("Couldn't create " + temporaryPath + "!");
+  }
+  const bool isWritten = WriteAll(temporaryFile, tail.data(), tail.size());
+  close(temporaryFile);
+  if (!isWritten) {
+    throw std::runtime_error("Couldn't write " + temporaryPath + "!");
+  }
+
+  FileSync::Replace(temporaryPath, mPath);
+  close(mFile);
+  Open();
+
+  mRecordCount -= foldedRecordCount;
+  mBaseOffset = foldedOffset;
+  mSyncedOffset = mEndOffset;
+  mSyncCondition.notify_all();
+}
+
+void DescriptionJournal::Open() {
+  mFile = open(mPath.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (mFile < 0) {
+    throw std::runtime_error("Couldn't open " + mPath + "!");
+  }
+}
+
+} // namespace lighthouse
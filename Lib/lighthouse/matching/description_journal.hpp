@@ -0,0 +1,80 @@
+//
+//  description_journal.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef description_journal_hpp
+#define description_journal_hpp
+
+#include <stdio.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "image_description.hpp"
+
+namespace lighthouse {
+
+// Append-only log of the descriptions recorded since the description DB has been saved the last time. Recording an
+// item costs a single sequential write of its record instead of rewriting the whole DB. Every record is the format
+// version, the length of the serialized description, their CRC-32C and the description itself, so a record that has
+// been cut short or garbled by a crash is detected at the next start and the journal is cut back to the last intact
+// record. Records are folded into the DB by `Compact`, which can run in the background while more records are
+// appended.
+class DescriptionJournal {
+public:
+  // Opens the journal, creating an empty one if there is none. Throws `std::runtime_error` if it can't be opened.
+  explicit DescriptionJournal(const std::string &aPath);
+
+  ~DescriptionJournal();
+
+  DescriptionJournal(const DescriptionJournal&) = delete;
+  DescriptionJournal &operator=(const DescriptionJournal&) = delete;
+
+  // Returns descriptions of all intact records in the order they've been appended, and cuts off whatever follows the
+  // last one of them. Records of a newer format version are skipped. Should be called before anything is appended.
+  std::vector<ImageDescription> Recover();
+
+  // Appends the description's record and returns once it's durable. Appends that run concurrently share the flush
+  // (group commit): the first one to wait for it flushes the records of all the others as well. Throws
+  // `std::runtime_error` if the record can't be written or flushed.
+  void Append(const ImageDescription &aDescription);
+
+  // Number of records and bytes in the journal.
+  uint32_t GetRecordCount() const;
+  uint64_t GetSize() const;
+
+  // Folds the journal into the DB: `aSave` is expected to durably save the DB with every description that has been
+  // appended before it's called (it's given no lock, appends go on meanwhile), and then the records it has covered
+  // are dropped from the journal. Records appended while `aSave` runs stay. Compactions shouldn't overlap.
+  void Compact(const std::function<void()> &aSave);
+
+private:
+  // Opens `mPath` for appending at its end, `mFile` is replaced.
+  void Open();
+
+  std::string mPath;
+
+  // Guards everything below.
+  mutable std::mutex mMutex;
+  int mFile;
+  uint32_t mRecordCount;
+  // Offsets count bytes ever appended, including the ones compacted away since the journal has been opened, so that
+  // they never go back: the journal file starts at `mBaseOffset`, ends at `mEndOffset` and is durable up to
+  // `mSyncedOffset`.
+  uint64_t mBaseOffset;
+  uint64_t mEndOffset;
+  uint64_t mSyncedOffset;
+  // Whether somebody is flushing the journal right now, the others wait for them on the condition.
+  bool mIsSyncing;
+  std::condition_variable mSyncCondition;
+};
+
+} // namespace lighthouse
+
+#endif /* description_journal_hpp */
@@ -0,0 +1,180 @@
+//
+//  descriptor_arena.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "descriptor_arena.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Number of descriptors swept against all query rows at once. 1024 descriptors take 32KB, so a tile together with the
+// query (1000 ORB features take another 32KB) stays in L2 cache for the whole tile.
+const uint32_t kTileDescriptors = 1024;
+
+// Number of buckets the item index starts with.
+const uint32_t kInitialBucketCount = 1024;
+
+} // namespace
+
+DescriptorArena::DescriptorArena()
+    : mDescriptors(), mOwners(), mRows(), mItemIds(), mItemOffsets(),
+      mItemIndex(kInitialBucketCount) {
+  mItemOffsets.PushBack(0);
+}
+
+uint32_t DescriptorArena::Add(const std::string &aItemId, const BinaryDescriptorSet<kDescriptorBytes> &aDescriptors) {
+  const uint32_t firstDescriptor = mOwners.Size();
+  if (GetItemIndex(aItemId) >= 0) {
+    return firstDescriptor;
+  }
+
+  const uint32_t itemIndex = mItemIds.Size();
+  mItemIds.PushBack(aItemId);
+
+  for (uint32_t row = 0; row < aDescriptors.Size(); ++row) {
+    BinaryDescriptorSet<kDescriptorBytes>::Row descriptor;
+    memcpy(descriptor.data(), aDescriptors.GetRow(row), kDescriptorBytes);
+    mDescriptors.PushBack(descriptor);
+    mOwners.PushBack(itemIndex);
+    mRows.PushBack(row);
+  }
+  mItemOffsets.PushBack(mOwners.Size());
+
+  if (mItemIds.Size() > mItemIndex.GetBucketCount()) {
+    // Index of the copies this one has been made of stays as it is.
+    mItemIndex = AppendOnlyBuckets(mItemIndex.GetBucketCount() * 2);
+    for (uint32_t item = 0; item < mItemIds.Size(); ++item) {
+      mItemIndex.Add(GetItemBucket(mItemIds[item]));
+    }
+  } else {
+    mItemIndex.Add(GetItemBucket(aItemId));
+  }
+
+  return firstDescriptor;
+}
+
+CandidateMatches DescriptorArena::KnnMatch(const cv::Mat &aQueryDescriptors, ThreadPool *aThreadPool,
+    uint32_t aPrefixLength) const {
+  std::vector<uint32_t> items;
+  items.reserve(mItemIds.Size());
+  for (uint32_t item = 0; item < mItemIds.Size(); ++item) {
+    if (mItemOffsets[item + 1] > mItemOffsets[item]) {
+      items.push_back(item);
+    }
+  }
+
+  return KnnMatch(aQueryDescriptors, items, aThreadPool, aPrefixLength);
+}
+
+CandidateMatches DescriptorArena::KnnMatch(const cv::Mat &aQueryDescriptors, const std::vector<std::string> &aItemIds,
+    ThreadPool *aThreadPool, uint32_t aPrefixLength) const {
+  std::vector<uint32_t> items;
+  for (const std::string &id : aItemIds) {
+    const int32_t item = GetItemIndex(id);
+    if (item >= 0 && mItemOffsets[item + 1] > mItemOffsets[item]) {
+      items.push_back(item);
+    }
+  }
+
+  // Keep the sweep in arena order and match every item only once.
+  std::sort(items.begin(), items.end());
+  items.erase(std::unique(items.begin(), items.end()), items.end());
+
+  return KnnMatch(aQueryDescriptors, items, aThreadPool, aPrefixLength);
+}
+
+CandidateMatches DescriptorArena::KnnMatch(const cv::Mat &aQueryDescriptors, const std::vector<uint32_t> &aItems,
+    ThreadPool *aThreadPool, uint32_t aPrefixLength) const {
+  if (aQueryDescriptors.empty()) {
+    return CandidateMatches();
+  }
+
+  if (aQueryDescriptors.type() != CV_8U || aQueryDescriptors.cols != kDescriptorBytes) {
+    throw std::invalid_argument("Only 32-byte binary descriptors can be matched!");
+  }
+
+  // Tiles consist of whole items, but have at least one item even if it's larger than the tile size.
+  std::vector<size_t> tileStarts;
+  for (size_t i = 0, tileDescriptors = 0; i < aItems.size(); ++i) {
+    const uint32_t itemDescriptors = GetMatchedCount(aItems[i], aPrefixLength);
+    if (tileStarts.empty() || tileDescriptors + itemDescriptors > kTileDescriptors) {
+      tileStarts.push_back(i);
+      tileDescriptors = 0;
+    }
+    tileDescriptors += itemDescriptors;
+  }
+  tileStarts.push_back(aItems.size());
+
+  // All results are allocated upfront, tiles only ever write to the slots of their own items.
+  CandidateMatches itemMatches(aItems, aQueryDescriptors.rows);
+
+  auto matchTiles = [&](size_t aFirstTile, size_t aLastTile) {
+    for (size_t tile = aFirstTile; tile < aLastTile; ++tile) {
+      const size_t tileStart = tileStarts[tile], tileEnd = tileStarts[tile + 1];
+
+      for (int row = 0; row < aQueryDescriptors.rows; ++row) {
+        const uint8_t *query = aQueryDescriptors.ptr<uint8_t>(row);
+
+        for (size_t i = tileStart; i < tileEnd; ++i) {
+          // Item's descriptors are its rows in order, so neighbour indices are rows already.
+          FindTop2(query, mItemOffsets[aItems[i]], GetMatchedCount(aItems[i], aPrefixLength), itemMatches.Get(i, row));
+        }
+      }
+    }
+  };
+
+  const size_t tileCount = tileStarts.size() - 1;
+  if (aThreadPool != nullptr) {
+    aThreadPool->ParallelFor(tileCount, 1, matchTiles);
+  } else {
+    matchTiles(0, tileCount);
+  }
+
+  return itemMatches;
+}
+
+void DescriptorArena::FindTop2(const uint8_t *aQuery, uint32_t aFirstIndex, uint32_t aCount,
+    HammingTop2 &aResult) const {
+  ResetHammingTop2(aResult);
+  for (uint32_t index = aFirstIndex; index < aFirstIndex + aCount;) {
+    const uint32_t runLength = std::min<size_t>(mDescriptors.GetRunLength(index), aFirstIndex + aCount - index);
+    HammingTop2 runTop2;
+    HammingMatcher<kDescriptorBytes>::FindTop2(aQuery, GetDescriptor(index), runLength, kDescriptorBytes, runTop2);
+
+    // Earlier runs win ties, same as earlier descriptors within a run.
+    for (int k = 0; k < 2; ++k) {
+      UpdateHammingTop2(runTop2.mDistances[k], index - aFirstIndex + runTop2.mIndices[k], aResult);
+    }
+    index += runLength;
+  }
+}
+
+int32_t DescriptorArena::GetItemIndex(const std::string &aItemId) const {
+  int32_t itemIndex = -1;
+  mItemIndex.ForEach(GetItemBucket(aItemId), [&](uint32_t aItem) {
+    if (itemIndex < 0 && mItemIds[aItem] == aItemId) {
+      itemIndex = aItem;
+    }
+  });
+
+  return itemIndex;
+}
+
+size_t DescriptorArena::Size() const {
+  return mOwners.Size();
+}
+
+size_t DescriptorArena::GetItemCount() const {
+  return mItemIds.Size();
+}
+
+} // namespace lighthouse
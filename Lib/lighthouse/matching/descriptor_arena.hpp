@@ -0,0 +1,133 @@
+//
+//  descriptor_arena.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef descriptor_arena_hpp
+#define descriptor_arena_hpp
+
+#include <stdio.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "aligned_allocator.hpp"
+#include "append_only_vector.hpp"
+#include "binary_descriptor_set.hpp"
+#include "candidate_matches.hpp"
+#include "hamming.hpp"
+#include "thread_pool.hpp"
+
+namespace lighthouse {
+
+// Contiguous storage for the descriptors of all DB items. Descriptors of every item are appended as one run to a
+// single row store of chunks aligned to the cache line size, and every descriptor has its owner item and row in that
+// item's descriptor set recorded in parallel arrays. Descriptors are copied in, including the ones of the items loaded
+// from the memory-mapped description DB: the arena is the resident copy matching sweeps, while the items' own payloads
+// are read only for one to one matching (see `PayloadCache`). Everything is append-only and shared between copies at
+// chunk granularity (see `AppendOnlyVector`), so a copy costs a few pointers and adding an item to it copies at most
+// that item's descriptors and the last chunk, while the arena it has been made of stays as it was: every DB snapshot
+// has its own copy. A chunk holds `kChunkDescriptors` descriptors, an item that doesn't fit into the rest of one
+// continues in the next one, so an item is at most a few runs.
+class DescriptorArena {
+public:
+  // Number of bytes in the only descriptor type we support (ORB).
+  static const uint32_t kDescriptorBytes = 32;
+  // Alignment of the row store chunks.
+  static const size_t kAlignment = 64;
+  // Number of descriptors in a row store chunk (128KB).
+  static const size_t kChunkDescriptors = 4096;
+
+  DescriptorArena();
+
+  // Appends all descriptors of the item. Returns index of the first appended descriptor. Items without descriptors
+  // are added too (so that every DB item has an index), they're just never matched. Items that are already stored
+  // aren't added again.
+  uint32_t Add(const std::string &aItemId, const BinaryDescriptorSet<kDescriptorBytes> &aDescriptors);
+
+  // Matches query against every item in a single sweep over the arena and returns exactly the two nearest neighbours
+  // `knnMatch(aQueryDescriptors, itemDescriptors, matches, 2)` would return for every item, in arena order. Tiles of
+  // the sweep are spread over the thread pool if one is given. If `aPrefixLength` isn't 0, only that many first
+  // descriptors of every item (the strongest ones, see `ImageDescription`) are matched, as if the item had no others: a
+  // cheap coarse pass.
+  CandidateMatches KnnMatch(const cv::Mat &aQueryDescriptors, ThreadPool *aThreadPool = nullptr,
+      uint32_t aPrefixLength = 0) const;
+
+  // Same as above, but only for the specified items. Unknown ids are ignored, items are returned in arena order.
+  CandidateMatches KnnMatch(const cv::Mat &aQueryDescriptors, const std::vector<std::string> &aItemIds,
+      ThreadPool *aThreadPool = nullptr, uint32_t aPrefixLength = 0) const;
+
+  const uint8_t *GetDescriptor(uint32_t aIndex) const {
+    return reinterpret_cast<const uint8_t *>(mDescriptors[aIndex].data());
+  }
+
+  // Finds two nearest neighbours of the query among `aCount` descriptors from `aFirstIndex` on, run by run, exactly as
+  // `HammingMatcher::FindTop2` would over all of them at once. Result indices are relative to `aFirstIndex`.
+  void FindTop2(const uint8_t *aQuery, uint32_t aFirstIndex, uint32_t aCount, HammingTop2 &aResult) const;
+
+  // Returns index of the item descriptor belongs to.
+  uint32_t GetOwner(uint32_t aIndex) const {
+    return mOwners[aIndex];
+  }
+
+  // Returns row of the descriptor in its item's descriptor matrix.
+  uint32_t GetRow(uint32_t aIndex) const {
+    return mRows[aIndex];
+  }
+
+  const std::string &GetItemId(uint32_t aItemIndex) const {
+    return mItemIds[aItemIndex];
+  }
+
+  // Returns index of the first descriptor of the item, `GetItemOffset(GetItemCount())` is one past the last descriptor.
+  uint32_t GetItemOffset(uint32_t aItemIndex) const {
+    return mItemOffsets[aItemIndex];
+  }
+
+  // Returns index of the item with the specified id or -1 if there is no such item.
+  int32_t GetItemIndex(const std::string &aItemId) const;
+
+  // Number of stored descriptors.
+  size_t Size() const;
+
+  // Number of stored items.
+  size_t GetItemCount() const;
+
+private:
+  // Sweeps the specified items (indices into `mItemIds`, in arena order) tile by tile.
+  CandidateMatches KnnMatch(const cv::Mat &aQueryDescriptors, const std::vector<uint32_t> &aItems,
+      ThreadPool *aThreadPool, uint32_t aPrefixLength) const;
+
+  // Returns number of the item's descriptors that are matched with the specified prefix length.
+  uint32_t GetMatchedCount(uint32_t aItemIndex, uint32_t aPrefixLength) const {
+    const uint32_t itemDescriptors = mItemOffsets[aItemIndex + 1] - mItemOffsets[aItemIndex];
+    return aPrefixLength > 0 && aPrefixLength < itemDescriptors ? aPrefixLength : itemDescriptors;
+  }
+
+  // Bucket of the item id in `mItemIndex`.
+  uint32_t GetItemBucket(const std::string &aItemId) const {
+    return std::hash<std::string>()(aItemId) & (mItemIndex.GetBucketCount() - 1);
+  }
+
+  // Per descriptor: the descriptor itself, owner item and row in the owner's descriptor set.
+  AppendOnlyVector<BinaryDescriptorSet<kDescriptorBytes>::Row, kChunkDescriptors,
+      AlignedAllocator<BinaryDescriptorSet<kDescriptorBytes>::Row, kAlignment>> mDescriptors;
+  AppendOnlyVector<uint32_t> mOwners;
+  AppendOnlyVector<uint32_t> mRows;
+
+  // Per item: id, index of the first descriptor (plus one past the last descriptor).
+  AppendOnlyVector<std::string> mItemIds;
+  AppendOnlyVector<uint32_t> mItemOffsets;
+  // Items by the hash of their id, entries are item indices. Bucket count is a power of two, it's doubled (and the
+  // index rebuilt) whenever it's exceeded by the number of items.
+  AppendOnlyBuckets mItemIndex;
+};
+
+} // namespace lighthouse
+
+#endif /* descriptor_arena_hpp */
@@ -0,0 +1,135 @@
+//
+//  frame_preprocessor.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "frame_preprocessor.hpp"
+#include "color_histogram.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// `cv::cvtColor` BGR -> gray weights (ITU-R BT.601) in fixed point with 14 fractional bits, rounded to nearest.
+const int kGrayShift = 14;
+const int kBlueWeight = 1868;
+const int kGreenWeight = 9617;
+const int kRedWeight = 4899;
+
+// Number of rows processed by a single thread pool task, every task has its own bin counts.
+const int kRowsPerTask = 64;
+
+inline uint8_t ToGray(int aBlue, int aGreen, int aRed) {
+  return (uint8_t) ((aBlue * kBlueWeight + aGreen * kGreenWeight + aRed * kRedWeight + (1 << (kGrayShift - 1))) >>
+      kGrayShift);
+}
+
+} // namespace
+
+/*static*/ void FramePreprocessor::Process(const cv::Mat &aFrame, cv::Mat &aGray, cv::Mat &aMask, cv::Mat &aHistogram,
+    ThreadPool *aThreadPool) {
+  if (aFrame.type() != CV_8UC4) {
+    throw std::invalid_argument("Only BGRA frames are supported!");
+  }
+
+  ProcessImage<4>(aFrame, aGray, aMask, aHistogram, aThreadPool);
+}
+
+/*static*/ void FramePreprocessor::Process(const cv::Mat &aImage, const cv::Mat &aMask, cv::Mat &aGray,
+    cv::Mat &aHistogram, ThreadPool *aThreadPool) {
+  if (!aMask.empty() && (aMask.type() != CV_8UC1 || aMask.rows != aImage.rows || aMask.cols != aImage.cols)) {
+    throw std::invalid_argument("Mask should be a one-channel image of the same size!");
+  }
+
+  // Mask is given, it's only read.
+  cv::Mat mask = aMask;
+  if (aImage.type() == CV_8UC3) {
+    ProcessImage<3>(aImage, aGray, mask, aHistogram, aThreadPool);
+  } else if (aImage.type() == CV_8UC1) {
+    ProcessImage<1>(aImage, aGray, mask, aHistogram, aThreadPool);
+  } else {
+    throw std::invalid_argument("Only BGR and grayscale images are supported!");
+  }
+}
+
+template<int Channels>
+/*static*/ void FramePreprocessor::ProcessRows(const cv::Mat &aImage, cv::Mat &aGray, cv::Mat &aMask,
+    uint32_t *aBinCounts, int aFirstRow, int aLastRow) {
+  for (int row = aFirstRow; row < aLastRow; ++row) {
+    const uint8_t *pixel = aImage.ptr<uint8_t>(row);
+    uint8_t *gray = Channels != 1 ? aGray.ptr<uint8_t>(row) : nullptr;
+    uint8_t *mask = !aMask.empty() ? aMask.ptr<uint8_t>(row) : nullptr;
+
+    if (Channels == 4) {
+      // The row is still in cache when the histogram kernel gets to it.
+      for (int col = 0; col < aImage.cols; ++col, pixel += 4) {
+        gray[col] = ToGray(pixel[0], pixel[1], pixel[2]);
+        mask[col] = pixel[3];
+      }
+      ColorHistogram::AddPixels(aImage.ptr<uint8_t>(row), aImage.cols, aBinCounts);
+      continue;
+    }
+
+    for (int col = 0; col < aImage.cols; ++col, pixel += Channels) {
+      const int blue = pixel[0];
+      const int green = Channels != 1 ? pixel[1] : blue;
+      const int red = Channels != 1 ? pixel[2] : blue;
+
+      if (Channels != 1) {
+        gray[col] = ToGray(blue, green, red);
+      }
+
+      if (mask == nullptr || mask[col] != 0) {
+        ColorHistogram::AddPixel(blue, green, red, aBinCounts);
+      }
+    }
+  }
+}
+
+template<int Channels>
+/*static*/ void FramePreprocessor::ProcessImage(const cv::Mat &aImage, cv::Mat &aGray, cv::Mat &aMask,
+    cv::Mat &aHistogram, ThreadPool *aThreadPool) {
+  if (Channels == 1) {
+    aGray = aImage;
+  } else {
+    aGray.create(aImage.rows, aImage.cols, CV_8UC1);
+  }
+
+  if (Channels == 4) {
+    aMask.create(aImage.rows, aImage.cols, CV_8UC1);
+  }
+
+  const size_t kBinCount = ColorHistogram::kBinCount;
+  const size_t taskCount = (aImage.rows + kRowsPerTask - 1) / kRowsPerTask;
+  std::vector<uint32_t> binCounts(std::max<size_t>(taskCount, 1) * kBinCount, 0);
+  auto processRows = [&](size_t aFirstTask, size_t aLastTask) {
+    for (size_t task = aFirstTask; task < aLastTask; ++task) {
+      ProcessRows<Channels>(aImage, aGray, aMask, &binCounts[task * kBinCount], task * kRowsPerTask,
+          std::min<int>(aImage.rows, (task + 1) * kRowsPerTask));
+    }
+  };
+
+  if (aThreadPool != nullptr) {
+    aThreadPool->ParallelFor(taskCount, 1, processRows);
+  } else {
+    processRows(0, taskCount);
+  }
+
+  // Per task counts are merged into the first task's ones.
+  for (size_t task = 1; task < taskCount; ++task) {
+    for (size_t bin = 0; bin < kBinCount; ++bin) {
+      binCounts[bin] += binCounts[task * kBinCount + bin];
+    }
+  }
+
+  ColorHistogram::Normalize(binCounts.data(), aHistogram);
+}
+
+} // namespace lighthouse
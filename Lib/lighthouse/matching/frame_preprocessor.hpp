@@ -0,0 +1,53 @@
+//
+//  frame_preprocessor.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef frame_preprocessor_hpp
+#define frame_preprocessor_hpp
+
+#include <stdio.h>
+#include <opencv2/opencv.hpp>
+
+#include "thread_pool.hpp"
+
+namespace lighthouse {
+
+// Prepares images for feature extraction: the grayscale image and the mask ORB works with, and the color histogram,
+// all in a single pass over the pixels and without any intermediate full-size planes. Grayscale conversion uses the
+// same fixed-point arithmetic as `cv::cvtColor(..., cv::COLOR_BGR2GRAY)` (which is what ORB does with a color image),
+// and the histogram is exactly the L2 normalized `cv::calcHist` of the B, G, R channels (8 bins each) within the mask
+// (see `ColorHistogram`), so descriptions are the same as if the channels had been split and ORB had converted the
+// image itself.
+class FramePreprocessor {
+public:
+  // BGRA frame, alpha channel is the mask. Allocates only the grayscale image and the mask. Rows are spread over the
+  // thread pool if one is given.
+  static void Process(const cv::Mat &aFrame, cv::Mat &aGray, cv::Mat &aMask, cv::Mat &aHistogram,
+      ThreadPool *aThreadPool = nullptr);
+
+  // BGR or grayscale image with a separate one-channel mask of the same size. Grayscale pixels count as B = G = R in
+  // the histogram and the grayscale image is returned as is, without a copy.
+  static void Process(const cv::Mat &aImage, const cv::Mat &aMask, cv::Mat &aGray, cv::Mat &aHistogram,
+      ThreadPool *aThreadPool = nullptr);
+
+private:
+  // Converts rows [aFirstRow, aLastRow) of the image with `Channels` interleaved channels (1, 3 or 4) into grayscale
+  // (skipped for 1 channel) and alpha (only for 4 channels, written into `aMask`) rows and adds their pixels within
+  // the mask (if it's not empty) to the histogram bin counts.
+  template<int Channels>
+  static void ProcessRows(const cv::Mat &aImage, cv::Mat &aGray, cv::Mat &aMask, uint32_t *aBinCounts,
+      int aFirstRow, int aLastRow);
+
+  // Runs `ProcessRows` over all rows, possibly in parallel, and turns bin counts into the normalized histogram.
+  template<int Channels>
+  static void ProcessImage(const cv::Mat &aImage, cv::Mat &aGray, cv::Mat &aMask, cv::Mat &aHistogram,
+      ThreadPool *aThreadPool);
+};
+
+} // namespace lighthouse
+
+#endif /* frame_preprocessor_hpp */
@@ -0,0 +1,138 @@
+//
+//  hamming.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include "hamming.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LIGHTHOUSE_HAMMING_X86 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LIGHTHOUSE_HAMMING_NEON 1
+#endif
+
+namespace lighthouse {
+
+namespace {
+
+void FindTop2Scalar(const uint8_t *aQuery, const uint8_t *aDescriptors, uint32_t aCount, size_t aStride,
+    HammingTop2 &aResult) {
+  ResetHammingTop2(aResult);
+  for (uint32_t i = 0; i < aCount; ++i) {
+    UpdateHammingTop2(HammingKernels<32>::Distance(aQuery, aDescriptors + i * aStride), i, aResult);
+  }
+}
+
+#if LIGHTHOUSE_HAMMING_X86
+__attribute__((target("popcnt,sse4.2")))
+void FindTop2Popcnt(const uint8_t *aQuery, const uint8_t *aDescriptors, uint32_t aCount, size_t aStride,
+    HammingTop2 &aResult) {
+  uint64_t query[4];
+  memcpy(query, aQuery, sizeof(query));
+
+  ResetHammingTop2(aResult);
+  for (uint32_t i = 0; i < aCount; ++i) {
+    uint64_t descriptor[4];
+    memcpy(descriptor, aDescriptors + i * aStride, sizeof(descriptor));
+
+    const uint32_t distance = (uint32_t) (_mm_popcnt_u64(query[0] ^ descriptor[0]) +
+        _mm_popcnt_u64(query[1] ^ descriptor[1]) + _mm_popcnt_u64(query[2] ^ descriptor[2]) +
+        _mm_popcnt_u64(query[3] ^ descriptor[3]));
+    UpdateHammingTop2(distance, i, aResult);
+  }
+}
+
+__attribute__((target("avx2")))
+void FindTop2Avx2(const uint8_t *aQuery, const uint8_t *aDescriptors, uint32_t aCount, size_t aStride,
+    HammingTop2 &aResult) {
+  // Per-nibble popcount lookup table (Muła et al.), summed up with SAD against zero.
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowNibbleMask = _mm256_set1_epi8(0x0f);
+  const __m256i query = _mm256_loadu_si256((const __m256i *) aQuery);
+
+  ResetHammingTop2(aResult);
+  for (uint32_t i = 0; i < aCount; ++i) {
+    const __m256i difference = _mm256_xor_si256(query,
+        _mm256_loadu_si256((const __m256i *) (aDescriptors + i * aStride)));
+
+    const __m256i bitCounts = _mm256_add_epi8(
+        _mm256_shuffle_epi8(lookup, _mm256_and_si256(difference, lowNibbleMask)),
+        _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(difference, 4), lowNibbleMask)));
+    const __m256i sums = _mm256_sad_epu8(bitCounts, _mm256_setzero_si256());
+
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+
+    UpdateHammingTop2((uint32_t) _mm_cvtsi128_si32(sum), i, aResult);
+  }
+}
+#endif // LIGHTHOUSE_HAMMING_X86
+
+#if LIGHTHOUSE_HAMMING_NEON
+void FindTop2Neon(const uint8_t *aQuery, const uint8_t *aDescriptors, uint32_t aCount, size_t aStride,
+    HammingTop2 &aResult) {
+  const uint8x16_t queryLow = vld1q_u8(aQuery);
+  const uint8x16_t queryHigh = vld1q_u8(aQuery + 16);
+
+  ResetHammingTop2(aResult);
+  for (uint32_t i = 0; i < aCount; ++i) {
+    const uint8_t *descriptor = aDescriptors + i * aStride;
+
+    // Every lane holds at most 16 set bits, so 8-bit lanes can't overflow.
+    const uint8x16_t bitCounts = vaddq_u8(vcntq_u8(veorq_u8(queryLow, vld1q_u8(descriptor))),
+        vcntq_u8(veorq_u8(queryHigh, vld1q_u8(descriptor + 16))));
+
+#if defined(__aarch64__)
+    const uint32_t distance = vaddlvq_u8(bitCounts);
+#else
+    const uint64x2_t sums = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(bitCounts)));
+    const uint32_t distance = (uint32_t) (vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1));
+#endif
+
+    UpdateHammingTop2(distance, i, aResult);
+  }
+}
+#endif // LIGHTHOUSE_HAMMING_NEON
+
+} // namespace
+
+/*static*/ std::vector<std::pair<std::string, HammingTop2Kernel>> HammingKernels<32>::GetSupportedKernels() {
+  std::vector<std::pair<std::string, HammingTop2Kernel>> kernels;
+  kernels.push_back(std::make_pair("scalar", FindTop2Scalar));
+
+#if LIGHTHOUSE_HAMMING_X86
+  if (cv::checkHardwareSupport(CV_CPU_POPCNT) && cv::checkHardwareSupport(CV_CPU_SSE4_2)) {
+    kernels.push_back(std::make_pair("sse4.2/popcnt", FindTop2Popcnt));
+  }
+
+  if (cv::checkHardwareSupport(CV_CPU_AVX2)) {
+    kernels.push_back(std::make_pair("avx2", FindTop2Avx2));
+  }
+#endif
+
+#if LIGHTHOUSE_HAMMING_NEON
+  kernels.push_back(std::make_pair("neon", FindTop2Neon));
+#endif
+
+  return kernels;
+}
+
+/*static*/ const std::string &HammingKernels<32>::GetKernelName() {
+  static const std::string name = GetSupportedKernels().back().first;
+  return name;
+}
+
+/*static*/ HammingTop2Kernel HammingKernels<32>::GetKernel() {
+  static const HammingTop2Kernel kernel = GetSupportedKernels().back().second;
+  return kernel;
+}
+
+} // namespace lighthouse
@@ -0,0 +1,176 @@
+//
+//  hamming.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef hamming_hpp
+#define hamming_hpp
+
+#include <stdio.h>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "binary_descriptor_set.hpp"
+
+namespace lighthouse {
+
+// Two nearest neighbours of a query descriptor: distances and positions among the searched descriptors.
+struct HammingTop2 {
+  uint32_t mDistances[2];
+  uint32_t mIndices[2];
+};
+
+// Finds two nearest neighbours of `aQuery` among `aCount` descriptors that start every `aStride` bytes at
+// `aDescriptors`. Ties are resolved in favour of the descriptor that comes first.
+typedef void (*HammingTop2Kernel)(const uint8_t *aQuery, const uint8_t *aDescriptors, uint32_t aCount, size_t aStride,
+    HammingTop2 &aResult);
+
+// Records distance of the descriptor with the specified index if it's one of the two smallest ones seen so far.
+inline void UpdateHammingTop2(uint32_t aDistance, uint32_t aIndex, HammingTop2 &aResult) {
+  if (aDistance < aResult.mDistances[0]) {
+    aResult.mDistances[1] = aResult.mDistances[0];
+    aResult.mIndices[1] = aResult.mIndices[0];
+    aResult.mDistances[0] = aDistance;
+    aResult.mIndices[0] = aIndex;
+  } else if (aDistance < aResult.mDistances[1]) {
+    aResult.mDistances[1] = aDistance;
+    aResult.mIndices[1] = aIndex;
+  }
+}
+
+inline void ResetHammingTop2(HammingTop2 &aResult) {
+  aResult.mDistances[0] = aResult.mDistances[1] = std::numeric_limits<uint32_t>::max();
+  aResult.mIndices[0] = aResult.mIndices[1] = 0;
+}
+
+// Hamming distance kernels for `Bytes` long binary descriptors. The generic version is plain scalar code, widths that
+// we actually use get specialised versions.
+template<uint32_t Bytes>
+struct HammingKernels {
+  static uint32_t Distance(const uint8_t *aFirst, const uint8_t *aSecond) {
+    uint32_t distance = 0;
+    uint32_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= Bytes; offset += sizeof(uint64_t)) {
+      uint64_t first, second;
+      memcpy(&first, aFirst + offset, sizeof(uint64_t));
+      memcpy(&second, aSecond + offset, sizeof(uint64_t));
+      distance += __builtin_popcountll(first ^ second);
+    }
+    for (; offset < Bytes; ++offset) {
+      distance += __builtin_popcount(aFirst[offset] ^ aSecond[offset]);
+    }
+    return distance;
+  }
+
+  static void FindTop2(const uint8_t *aQuery, const uint8_t *aDescriptors, uint32_t aCount, size_t aStride,
+      HammingTop2 &aResult) {
+    ResetHammingTop2(aResult);
+    for (uint32_t i = 0; i < aCount; ++i) {
+      UpdateHammingTop2(Distance(aQuery, aDescriptors + i * aStride), i, aResult);
+    }
+  }
+};
+
+// 32-byte (ORB) descriptors: `FindTop2` fuses XOR, popcount and top-2 tracking and dispatches at runtime to the best
+// kernel the CPU supports (AVX2, SSE4.2/POPCNT, NEON or scalar).
+template<>
+struct HammingKernels<32> {
+  static uint32_t Distance(const uint8_t *aFirst, const uint8_t *aSecond) {
+    uint64_t first[4], second[4];
+    memcpy(first, aFirst, sizeof(first));
+    memcpy(second, aSecond, sizeof(second));
+    return __builtin_popcountll(first[0] ^ second[0]) + __builtin_popcountll(first[1] ^ second[1]) +
+        __builtin_popcountll(first[2] ^ second[2]) + __builtin_popcountll(first[3] ^ second[3]);
+  }
+
+  static void FindTop2(const uint8_t *aQuery, const uint8_t *aDescriptors, uint32_t aCount, size_t aStride,
+      HammingTop2 &aResult) {
+    GetKernel()(aQuery, aDescriptors, aCount, aStride, aResult);
+  }
+
+  // Returns name of the kernel `FindTop2` dispatches to.
+  static const std::string &GetKernelName();
+
+  // Returns all kernels the CPU supports, the best one is the last.
+  static std::vector<std::pair<std::string, HammingTop2Kernel>> GetSupportedKernels();
+
+private:
+  static HammingTop2Kernel GetKernel();
+};
+
+// Drop-in replacement for `cv::BFMatcher(cv::NORM_HAMMING).knnMatch(..., 2)` specialised for `Bytes` long descriptors.
+template<uint32_t Bytes>
+class HammingMatcher {
+public:
+  static uint32_t Distance(const uint8_t *aFirst, const uint8_t *aSecond) {
+    return HammingKernels<Bytes>::Distance(aFirst, aSecond);
+  }
+
+  static void FindTop2(const uint8_t *aQuery, const uint8_t *aDescriptors, uint32_t aCount, size_t aStride,
+      HammingTop2 &aResult) {
+    HammingKernels<Bytes>::FindTop2(aQuery, aDescriptors, aCount, aStride, aResult);
+  }
+
+  // Returns up to two nearest train descriptors for every query descriptor, exactly as `knnMatch` with k = 2 does.
+  static void KnnMatch(const cv::Mat &aQueryDescriptors, const cv::Mat &aTrainDescriptors,
+      std::vector<std::vector<cv::DMatch>> &aMatches) {
+    aMatches.clear();
+    if (aQueryDescriptors.empty()) {
+      return;
+    }
+
+    if (aQueryDescriptors.cols != Bytes || aQueryDescriptors.type() != CV_8U ||
+        (!aTrainDescriptors.empty() && (aTrainDescriptors.cols != Bytes || aTrainDescriptors.type() != CV_8U))) {
+      throw std::invalid_argument("Descriptor width doesn't match the matcher!");
+    }
+
+    aMatches.resize(aQueryDescriptors.rows);
+    if (aTrainDescriptors.empty()) {
+      return;
+    }
+
+    HammingTop2 top2;
+    for (int row = 0; row < aQueryDescriptors.rows; ++row) {
+      FindTop2(aQueryDescriptors.ptr<uint8_t>(row), aTrainDescriptors.ptr<uint8_t>(), aTrainDescriptors.rows,
+          aTrainDescriptors.step[0], top2);
+      AddMatches(row, top2, aTrainDescriptors.rows, aMatches[row]);
+    }
+  }
+
+  // Same as above for descriptor sets, their width is checked at compile time.
+  static void KnnMatch(const BinaryDescriptorSet<Bytes> &aQueryDescriptors,
+      const BinaryDescriptorSet<Bytes> &aTrainDescriptors, std::vector<std::vector<cv::DMatch>> &aMatches) {
+    aMatches.clear();
+    aMatches.resize(aQueryDescriptors.Size());
+    if (aTrainDescriptors.Empty()) {
+      return;
+    }
+
+    HammingTop2 top2;
+    for (size_t row = 0; row < aQueryDescriptors.Size(); ++row) {
+      FindTop2(aQueryDescriptors.GetRow(row), aTrainDescriptors.GetData(), aTrainDescriptors.Size(), Bytes, top2);
+      AddMatches(row, top2, aTrainDescriptors.Size(), aMatches[row]);
+    }
+  }
+
+private:
+  static void AddMatches(size_t aRow, const HammingTop2 &aTop2, size_t aTrainCount, std::vector<cv::DMatch> &aMatches) {
+    aMatches.reserve(2);
+    aMatches.push_back(cv::DMatch(aRow, aTop2.mIndices[0], 0, (float) aTop2.mDistances[0]));
+    if (aTrainCount > 1) {
+      aMatches.push_back(cv::DMatch(aRow, aTop2.mIndices[1], 0, (float) aTop2.mDistances[1]));
+    }
+  }
+};
+
+} // namespace lighthouse
+
+#endif /* hamming_hpp */
@@ -6,7 +6,9 @@
 //  Copyright © 2016 Lighthouse. All rights reserved.
 //
 
+#include <algorithm>
 #include <fstream>
+#include <numeric>
 
 #include <cereal/archives/binary.hpp>
 
@@ -15,44 +17,165 @@
 
 namespace lighthouse {
 
-ImageDescription::ImageDescription(std::string aId, std::vector<cv::KeyPoint> aKeypoints, cv::Mat aDescriptors,
-    cv::Mat aHistogram) : mId(aId), mKeypoints(aKeypoints), mDescriptors(aDescriptors), mHistogram(aHistogram) {
+ImageDescription::ImageDescription(std::string aId, const std::vector<cv::KeyPoint> &aKeypoints,
+    const cv::Mat &aDescriptors, cv::Mat aHistogram, BowVector aBowVector, float aScale)
+    : mId(aId), mKeypoints(), mDescriptors(aDescriptors), mHistogram(aHistogram), mBowVector(aBowVector),
+      mScale(aScale), mStorage() {
+  const std::vector<uint32_t> order = GetResponseOrder(aKeypoints, mDescriptors.Size());
+  if (order.empty()) {
+    mKeypoints = KeypointSet(aKeypoints);
+    return;
+  }
+
+  std::vector<cv::KeyPoint> keypoints;
+  keypoints.reserve(order.size());
+  for (const uint32_t index : order) {
+    keypoints.push_back(aKeypoints[index]);
+  }
+
+  mKeypoints = KeypointSet(keypoints);
+  mDescriptors = mDescriptors.Select(order);
+}
+
+ImageDescription::ImageDescription(std::string aId, KeypointSet aKeypoints, OrbDescriptorSet aDescriptors,
+    cv::Mat aHistogram, BowVector aBowVector, float aScale, std::shared_ptr<const void> aStorage)
+    : mId(aId), mKeypoints(aKeypoints), mDescriptors(aDescriptors), mHistogram(aHistogram), mBowVector(aBowVector),
+      mScale(aScale), mStorage(aStorage) {
 }
 
 const std::string &ImageDescription::GetId() const {
   return mId;
 }
 
-const std::vector<cv::KeyPoint> &ImageDescription::GetKeypoints() const {
+const KeypointSet &ImageDescription::GetKeypoints() const {
   return mKeypoints;
 }
 
-const cv::Mat &ImageDescription::GetDescriptors() const {
+const OrbDescriptorSet &ImageDescription::GetDescriptorSet() const {
   return mDescriptors;
 }
 
+cv::Mat ImageDescription::GetDescriptors() const {
+  return mDescriptors.AsMat();
+}
+
+cv::Mat ImageDescription::GetStrongestDescriptors(uint32_t aCount) const {
+  return mDescriptors.AsMat(aCount);
+}
+
 const cv::Mat &ImageDescription::GetHistogram() const {
   return mHistogram;
 }
 
+const BowVector &ImageDescription::GetBowVector() const {
+  return mBowVector;
+}
+
+float ImageDescription::GetScale() const {
+  return mScale;
+}
+
+const std::shared_ptr<const void> &ImageDescription::GetStorage() const {
+  return mStorage;
+}
+
+std::vector<cv::KeyPoint> ImageDescription::GetSourceKeypoints() const {
+  std::vector<cv::KeyPoint> keypoints = mKeypoints.ToKeypoints();
+  for (cv::KeyPoint &keypoint : keypoints) {
+    keypoint.pt *= 1 / mScale;
+    keypoint.size /= mScale;
+  }
+  return keypoints;
+}
+
 void ImageDescription::Save(const ImageDescription &aDescription, const std::string &aPath) {
   std::ofstream outputStream(aPath, std::ios::binary);
-  cereal::BinaryOutputArchive ar(outputStream);
+  Save(aDescription, outputStream);
+}
+
+void ImageDescription::Save(const ImageDescription &aDescription, std::ostream &aStream) {
+  cereal::BinaryOutputArchive ar(aStream);
+
+  // Keypoints used to be stored as `cv::KeyPoint`s right after the id, that field is left empty now and the compact
+  // keypoints are stored at the end instead, so that older descriptions can still be loaded.
+  ar(aDescription.mId, std::vector<cv::KeyPoint>(), aDescription.mDescriptors, aDescription.mHistogram);
+
+  ar(aDescription.mBowVector);
+
+  ar(FeatureOrder::BY_RESPONSE);
 
-  ar(aDescription);
+  ar(aDescription.mKeypoints);
+
+  ar(aDescription.mScale);
 }
 
-ImageDescription ImageDescription::Load(const std::string &aPath) {
+ImageDescription ImageDescription::Load(const std::string &aPath, bool *aIsMigrated) {
   std::ifstream inputStream(aPath, std::ios::binary);
-  cereal::BinaryInputArchive archive(inputStream);
+  return Load(inputStream, aIsMigrated);
+}
+
+ImageDescription ImageDescription::Load(std::istream &aStream, bool *aIsMigrated) {
+  cereal::BinaryInputArchive archive(aStream);
 
   std::string id;
   std::vector<cv::KeyPoint> keypoints;
-  cv::Mat descriptors, histogram;
+  OrbDescriptorSet descriptors;
+  cv::Mat histogram;
+  archive(id, keypoints, descriptors, histogram);
+
+  // Older descriptions end right after the histogram, the bag-of-words vector, the feature order or the keypoints.
+  BowVector bowVector;
+  if (aStream.peek() != std::istream::traits_type::eof()) {
+    archive(bowVector);
+  }
+
+  FeatureOrder featureOrder = FeatureOrder::UNORDERED;
+  if (aStream.peek() != std::istream::traits_type::eof()) {
+    archive(featureOrder);
+  }
+
+  if (aStream.peek() != std::istream::traits_type::eof()) {
+    KeypointSet compactKeypoints;
+    archive(compactKeypoints);
+
+    // Descriptions saved before the working resolution was introduced have been extracted at full resolution, that's
+    // what the default scale stands for, so they don't have to be migrated.
+    float scale = 1;
+    if (aStream.peek() != std::istream::traits_type::eof()) {
+      archive(scale);
+    }
+
+    if (aIsMigrated != nullptr) {
+      *aIsMigrated = false;
+    }
+    return ImageDescription(id, compactKeypoints, descriptors, histogram, bowVector, scale);
+  }
+
+  if (aIsMigrated != nullptr) {
+    *aIsMigrated = true;
+  }
+
+  // Responses are still there in the older formats, so features that haven't been ordered yet are ordered before
+  // keypoints are compacted.
+  return ImageDescription(id, keypoints, descriptors.AsMat(), histogram, bowVector);
+}
+
+/*static*/ std::vector<uint32_t> ImageDescription::GetResponseOrder(const std::vector<cv::KeyPoint> &aKeypoints,
+    size_t aDescriptorCount) {
+  const auto isStronger = [](const cv::KeyPoint &aFirst, const cv::KeyPoint &aSecond) {
+    return aFirst.response > aSecond.response;
+  };
 
-  ImageDescription description = ImageDescription(id, keypoints, descriptors, histogram);
-  archive(description);
+  std::vector<uint32_t> order;
+  if (aKeypoints.size() != aDescriptorCount || std::is_sorted(aKeypoints.begin(), aKeypoints.end(), isStronger)) {
+    return order;
+  }
 
-  return description;
+  order.resize(aKeypoints.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&aKeypoints, &isStronger](uint32_t aFirst, uint32_t aSecond) {
+    return isStronger(aKeypoints[aFirst], aKeypoints[aSecond]);
+  });
+  return order;
 }
 } // namespace lighthouse
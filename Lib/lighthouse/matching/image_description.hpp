@@ -10,47 +10,102 @@
 #define image_description_hpp
 
 #include <stdio.h>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <cereal/access.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/string.hpp>
+#include <cereal/types/map.hpp>
+
+#include "binary_descriptor_set.hpp"
+#include "keypoint_set.hpp"
+#include "vocabulary.hpp"
 
 namespace lighthouse {
 
+// Keypoints and descriptor rows are kept ordered by response, strongest first, so the `n` first rows are always the
+// `n` strongest features and can be matched on their own without copying anything (see `GetStrongestDescriptors`).
+// Once ordered, keypoints are stored as a compact `KeypointSet` and descriptors as an `OrbDescriptorSet`.
+// Keypoints are in the coordinates of the working resolution image features have been extracted from, `aScale` is its
+// size relative to the source image (see `ImageMatchingSettings::mWorkingMaxSide`).
 class ImageDescription {
 public:
-  ImageDescription() : mId(), mKeypoints(), mDescriptors(), mHistogram() {
+  ImageDescription() : mId(), mKeypoints(), mDescriptors(), mHistogram(), mBowVector(), mScale(1), mStorage() {
   };
 
-  ImageDescription(std::string aId, std::vector<cv::KeyPoint> aKeypoints, cv::Mat aDescriptors, cv::Mat aHistogram);
+  // Keypoints (and their descriptor rows) are reordered by response unless they already are in that order. Descriptors
+  // are copied, they must be 32-byte `CV_8U` rows.
+  ImageDescription(std::string aId, const std::vector<cv::KeyPoint> &aKeypoints, const cv::Mat &aDescriptors,
+      cv::Mat aHistogram, BowVector aBowVector = BowVector(), float aScale = 1);
+
+  // Features must already be ordered, strongest first (e.g. taken from another description). Keypoints, descriptors
+  // and the histogram may be views of memory that `aStorage` keeps alive (e.g. the memory-mapped DB).
+  ImageDescription(std::string aId, KeypointSet aKeypoints, OrbDescriptorSet aDescriptors, cv::Mat aHistogram,
+      BowVector aBowVector = BowVector(), float aScale = 1, std::shared_ptr<const void> aStorage = nullptr);
 
   const std::string &GetId() const;
 
-  const std::vector<cv::KeyPoint> &GetKeypoints() const;
+  const KeypointSet &GetKeypoints() const;
+
+  const OrbDescriptorSet &GetDescriptorSet() const;
+
+  // Returns `cv::Mat` view of the descriptors (see `BinaryDescriptorSet::AsMat`), valid as long as the description.
+  cv::Mat GetDescriptors() const;
 
-  const cv::Mat &GetDescriptors() const;
+  // Returns view of the descriptors of the `aCount` strongest features (all if there are fewer), nothing is copied.
+  // Keypoints of these rows are the first `aCount` ones of `GetKeypoints`.
+  cv::Mat GetStrongestDescriptors(uint32_t aCount) const;
 
   const cv::Mat &GetHistogram() const;
 
+  // Bag-of-words vector of the descriptors, empty if there was no vocabulary when the description was created.
+  const BowVector &GetBowVector() const;
+
+  // Scale of the working resolution relative to the source image, keypoint coordinates divided by it are source image
+  // coordinates. 1 for descriptions saved before the scale was recorded, they have been extracted at full resolution.
+  float GetScale() const;
+
+  // Memory the histogram, keypoints or descriptors are views of (`nullptr` if they aren't), descriptions made of them
+  // should keep it alive too.
+  const std::shared_ptr<const void> &GetStorage() const;
+
+  // Keypoints mapped back to the source image (position and size divided by the scale), e.g. for drawing over it.
+  std::vector<cv::KeyPoint> GetSourceKeypoints() const;
+
   static void Save(const ImageDescription &aDescription, const std::string &aPath);
 
-  static ImageDescription Load(const std::string &aPath);
+  // Same as above, into the stream (e.g. a journal record).
+  static void Save(const ImageDescription &aDescription, std::ostream &aStream);
 
-private:
-  std::string mId;
-  std::vector<cv::KeyPoint> mKeypoints;
-  cv::Mat mDescriptors;
-  cv::Mat mHistogram;
+  // Descriptions saved in an older format (before feature order was recorded or before keypoints were stored
+  // compactly) are upgraded on load and `aIsMigrated` (if given) is set to true, they should be saved again so that
+  // they don't have to be upgraded at every load.
+  static ImageDescription Load(const std::string &aPath, bool *aIsMigrated = nullptr);
 
-  friend class cereal::access;
+  // Same as above, the description should take the rest of the stream.
+  static ImageDescription Load(std::istream &aStream, bool *aIsMigrated = nullptr);
 
-  template<class Archive>
-  void serialize(Archive &aArchive) {
-    aArchive(mId);
-    aArchive(mKeypoints);
-    aArchive(mDescriptors);
-    aArchive(mHistogram);
+private:
+  // Order of the features recorded in the serialized description.
+  enum class FeatureOrder : uint32_t {
+    // Descriptions saved before the order was recorded, features are in the order ORB has returned them.
+    UNORDERED = 0,
+    // Strongest response first.
+    BY_RESPONSE = 1,
   };
+
+  // Returns order of the keypoints by response, strongest first, or an empty vector if they are in that order already
+  // (or if there are no descriptors for them, those are left as they are).
+  static std::vector<uint32_t> GetResponseOrder(const std::vector<cv::KeyPoint> &aKeypoints, size_t aDescriptorCount);
+
+  std::string mId;
+  KeypointSet mKeypoints;
+  OrbDescriptorSet mDescriptors;
+  cv::Mat mHistogram;
+  BowVector mBowVector;
+  float mScale;
+  // Memory the histogram is a view of, if it is.
+  std::shared_ptr<const void> mStorage;
 };
 
 } // namespace lighthouse
@@ -6,29 +6,118 @@
 //  Copyright © 2016 Lighthouse. All rights reserved.
 //
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <uuid/uuid.h>
 
 #include "image_matcher.hpp"
 #include "exceptions.hpp"
+#include "frame_preprocessor.hpp"
+#include "hamming.hpp"
 
 namespace lighthouse {
 
 ImageMatcher::ImageMatcher(ImageMatchingSettings aSettings)
-    : mSettings(aSettings), mDB(), mKeypointDetector(cv::ORB::create(aSettings.mNumberOfFeatures)),
-      mMatcher(new cv::BFMatcher(cv::NORM_HAMMING)) {
+    : mSettings(aSettings), mSnapshot(std::make_shared<DBSnapshot>(aSettings.mIndexSearchRadius,
+          aSettings.mLshTableCount, aSettings.mLshKeySize, aSettings.mLshProbeRadius)), mWriteMutex(),
+      mThreadPool(std::make_shared<ThreadPool>(aSettings.mThreadCount)),
+      mPayloadCache(std::make_shared<PayloadCache>((size_t) aSettings.mPayloadCacheMegabytes << 20)),
+      mFeatureExtractor(cv::ORB::create(aSettings.mNumberOfFeatures), aSettings.mExtractionGridSize) {
+}
+
+ImageMatcher::ImageMatcher(const ImageMatcher &aOther)
+    : mSettings(aOther.mSettings), mSnapshot(aOther.GetSnapshot()), mWriteMutex(), mThreadPool(aOther.mThreadPool),
+      mPayloadCache(aOther.mPayloadCache), mFeatureExtractor(aOther.mFeatureExtractor) {
 }
 
 ImageDescription ImageMatcher::GetDescription(const cv::Mat &aInputFrame) const {
-  // Use alpha channel as a mask.
-  std::vector<cv::Mat> rgbaChannels(4);
-  cv::split(aInputFrame, rgbaChannels);
-  cv::Mat mask = rgbaChannels[3];
+  cv::Mat frame;
+  const float scale = ToWorkingResolution(aInputFrame, frame);
+
+  // Grayscale image for ORB, alpha channel as a mask and color histogram, all in one pass over the frame.
+  cv::Mat gray, mask, histogram;
+  FramePreprocessor::Process(frame, gray, mask, histogram, mThreadPool.get());
+
+  return CreateDescription(gray, mask, histogram, scale, GetWorkingOffset(aInputFrame, scale));
+}
+
+ImageDescription ImageMatcher::GetDescription(const cv::Mat &aImage, const cv::Mat &aMask) const {
+  cv::Mat image, mask;
+  const float scale = ToWorkingResolution(aImage, image);
+  if (!aMask.empty()) {
+    ToWorkingResolution(aMask, mask);
+  }
+
+  cv::Mat gray, histogram;
+  FramePreprocessor::Process(image, mask, gray, histogram, mThreadPool.get());
+
+  return CreateDescription(gray, mask, histogram, scale, GetWorkingOffset(aImage, scale));
+}
+
+std::vector<cv::KeyPoint> ImageMatcher::DetectKeypoints(const cv::Mat &aInputFrame, float &aScale) const {
+  cv::Mat frame;
+  aScale = ToWorkingResolution(aInputFrame, frame);
+
+  // Histogram comes out of the same pass over the frame, it just isn't needed here.
+  cv::Mat gray, mask, histogram;
+  FramePreprocessor::Process(frame, gray, mask, histogram, mThreadPool.get());
+
+  std::vector<cv::KeyPoint> keypoints;
+  mFeatureExtractor.Detect(gray, mask, keypoints, mThreadPool.get());
+  if (keypoints.size() < mSettings.mMinNumberOfFeatures) {
+    throw ImageQualityException("Image does not have enough keypoints.", ImageQualityExceptionCode::NotEnoughKeyPoints);
+  }
+
+  const cv::Point2f offset = GetWorkingOffset(aInputFrame, aScale);
+  for (cv::KeyPoint &keypoint : keypoints) {
+    keypoint.pt += offset;
+  }
+
+  return keypoints;
+}
+
+float ImageMatcher::ToWorkingResolution(const cv::Mat &aImage, cv::Mat &aResult) const {
+  const double area = (double) aImage.cols * aImage.rows;
+  const int longerSide = std::max(aImage.cols, aImage.rows);
+
+  double scale = 1;
+  if (mSettings.mWorkingMaxSide > 0 && longerSide > (int) mSettings.mWorkingMaxSide) {
+    scale = (double) mSettings.mWorkingMaxSide / longerSide;
+  }
+  if (mSettings.mWorkingMegapixels > 0 && area > mSettings.mWorkingMegapixels * 1e6) {
+    scale = std::min(scale, std::sqrt(mSettings.mWorkingMegapixels * 1e6 / area));
+  }
+
+  const cv::Size size(std::max((int) std::lround(aImage.cols * scale), 1),
+      std::max((int) std::lround(aImage.rows * scale), 1));
+  if (aImage.empty() || size == aImage.size()) {
+    aResult = aImage;
+    return 1;
+  }
+
+  // Area averaging doesn't alias, and it keeps partially covered mask pixels in the mask.
+  cv::resize(aImage, aResult, size, 0, 0, cv::INTER_AREA);
+  return (float) size.width / aImage.cols;
+}
+
+/*static*/ cv::Point2f ImageMatcher::GetWorkingOffset(const cv::Mat &aImage, float aScale) {
+  cv::Size frameSize;
+  cv::Point offset;
+  aImage.locateROI(frameSize, offset);
+  return cv::Point2f(offset.x * aScale, offset.y * aScale);
+}
 
+ImageDescription ImageMatcher::CreateDescription(const cv::Mat &aGray, const cv::Mat &aMask,
+    const cv::Mat &aHistogram, float aScale, const cv::Point2f &aOffset) const {
   // Detect image keypoints and compute descriptors for all of them.
   std::vector<cv::KeyPoint> keypoints;
-  cv::Mat descriptors, histogram;
+  cv::Mat descriptors;
 
-  mKeypointDetector->detectAndCompute(aInputFrame, mask, keypoints, descriptors);
+  mFeatureExtractor.DetectAndCompute(aGray, aMask, keypoints, descriptors, mThreadPool.get());
+  for (cv::KeyPoint &keypoint : keypoints) {
+    keypoint.pt += aOffset;
+  }
 
   uint32_t keypointsCount = keypoints.size();
 
@@ -38,15 +127,14 @@ ImageDescription ImageMatcher::GetDescription(const cv::Mat &aInputFrame) const
     throw ImageQualityException("Image does not have enough keypoints.", ImageQualityExceptionCode::NotEnoughKeyPoints);
   }
 
-  // Calculate color histogram for the image.
-  const int channels[] = {0, 1, 2};
-  const int histogramSize[] = {8, 8, 8};
-  float colorRange[] = {0, 256};
-  const float *ranges[] = {colorRange, colorRange, colorRange};
+  const std::string id = GenerateId();
+  fprintf(stderr, "ImageMatcher::GetImageDescription() created new image description with ID: %s.\n", id.c_str());
 
-  cv::calcHist(&aInputFrame, 1, channels, cv::Mat(), histogram, 3, histogramSize, ranges);
-  cv::normalize(histogram, histogram);
+  return ImageDescription(id, keypoints, descriptors, aHistogram, GetSnapshot()->mVocabulary->Transform(descriptors),
+      aScale);
+}
 
+/*static*/ std::string ImageMatcher::GenerateId() {
   // Generate unique ImageDescription Id.
   uuid_t uuid;
   uuid_generate_random(uuid);
@@ -54,85 +142,744 @@ ImageDescription ImageMatcher::GetDescription(const cv::Mat &aInputFrame) const
   char uuidString[37];
   uuid_unparse(uuid, uuidString);
 
-  fprintf(stderr, "ImageMatcher::GetImageDescription() created new image description with ID: %s.\n", uuidString);
-
-  return ImageDescription(uuidString, keypoints, descriptors, histogram);
+  return uuidString;
 }
 
-const ImageDescription &ImageMatcher::GetDescription(const std::string &id) const {
-  return mDB.find(id)->second;
+ImageDescriptionPtr ImageMatcher::GetDescription(const std::string &id) const {
+  return GetSnapshot()->GetDescription(id);
 }
 
 void ImageMatcher::AddToDB(const ImageDescription &aDescription) {
-  mDB.insert(std::make_pair(aDescription.GetId(), aDescription));
+  AddToDB(std::vector<ImageDescription>(1, aDescription));
+}
+
+void ImageMatcher::AddToDB(const std::vector<ImageDescription> &aDescriptions, const LshIndex *aLshIndex) {
+  std::lock_guard<std::mutex> lock(mWriteMutex);
+
+  // Snapshot shares its storage with the current one, only the added items are copied (see `DBSnapshot`).
+  std::shared_ptr<DBSnapshot> snapshot = std::make_shared<DBSnapshot>(*GetSnapshot());
+
+  // Missing bag-of-words vectors are the bulk of the work when many items are added at once (e.g. the whole DB at
+  // startup), so they're computed up front on all threads. Everything else below has to be done in order.
+  std::vector<BowVector> bowVectors(aDescriptions.size());
+  if (!snapshot->mVocabulary->IsEmpty()) {
+    mThreadPool->ParallelFor(aDescriptions.size(), 1, [&aDescriptions, &bowVectors, &snapshot](size_t aBegin,
+        size_t aEnd) {
+      for (size_t i = aBegin; i < aEnd; ++i) {
+        if (aDescriptions[i].GetBowVector().empty()) {
+          bowVectors[i] = snapshot->mVocabulary->Transform(aDescriptions[i].GetDescriptors());
+        }
+      }
+    });
+  }
+
+  for (size_t i = 0; i < aDescriptions.size(); ++i) {
+    const ImageDescription &description = aDescriptions[i];
+    if (snapshot->mArena.GetItemIndex(description.GetId()) >= 0) {
+      continue;
+    }
+
+    // Items are stored by their arena index.
+    snapshot->mDescriptions.PushBack(AddToInvertedFile(*snapshot, bowVectors[i].empty() ? description :
+        ImageDescription(description.GetId(), description.GetKeypoints(), description.GetDescriptorSet(),
+        description.GetHistogram(), bowVectors[i], description.GetScale(), description.GetStorage())));
+    snapshot->mArena.Add(description.GetId(), description.GetDescriptorSet());
+    if (mSettings.mMatcherBackend == MatcherBackend::MULTI_INDEX_HASH) {
+      snapshot->mIndex.Add(snapshot->mArena);
+    }
+
+    // Arena has its own copy of the descriptors, the payload isn't needed until the item is matched one to one.
+    mPayloadCache->Evict(description);
+  }
+
+  if (mSettings.mMatcherBackend == MatcherBackend::LSH) {
+    if (aLshIndex != nullptr) {
+      if (aLshIndex->HasParameters(mSettings.mLshTableCount, mSettings.mLshKeySize, mSettings.mLshProbeRadius)) {
+        snapshot->mLshIndex = *aLshIndex;
+      } else {
+        fprintf(stderr, "ImageMatcher::AddToDB() LSH index parameters don't match the settings. Skipping...\n");
+      }
+    }
+
+    snapshot->mLshIndex.Sync(snapshot->mArena);
+  }
+
+  SetSnapshot(snapshot);
+}
+
+std::vector<ImageDescriptionPtr> ImageMatcher::GetDescriptions() const {
+  const std::shared_ptr<const DBSnapshot> snapshot = GetSnapshot();
+
+  return snapshot->mDescriptions.ToVector();
+}
+
+void ImageMatcher::SetVocabulary(const Vocabulary &aVocabulary) {
+  std::lock_guard<std::mutex> lock(mWriteMutex);
+
+  std::shared_ptr<DBSnapshot> snapshot = std::make_shared<DBSnapshot>(*GetSnapshot());
+  snapshot->mVocabulary = std::make_shared<const Vocabulary>(aVocabulary);
+  snapshot->mInvertedFile = InvertedFile(aVocabulary.GetWordCount());
+
+  // Vectors computed with the previous vocabulary are meaningless now, so every item is replaced: the only write that
+  // costs as much as the whole DB.
+  const AppendOnlyVector<ImageDescriptionPtr> descriptions = snapshot->mDescriptions;
+  snapshot->mDescriptions.Clear();
+  for (size_t item = 0; item < descriptions.Size(); ++item) {
+    const ImageDescription &description = *descriptions[item];
+    snapshot->mDescriptions.PushBack(AddToInvertedFile(*snapshot, ImageDescription(description.GetId(),
+        description.GetKeypoints(), description.GetDescriptorSet(), description.GetHistogram(), BowVector(),
+        description.GetScale(), description.GetStorage())));
+  }
+
+  SetSnapshot(snapshot);
+}
+
+std::shared_ptr<const Vocabulary> ImageMatcher::GetVocabulary() const {
+  return GetSnapshot()->mVocabulary;
+}
+
+LshIndex ImageMatcher::GetLshIndex() const {
+  return GetSnapshot()->mLshIndex;
+}
+
+PayloadCacheStats ImageMatcher::GetPayloadCacheStats() const {
+  return mPayloadCache->GetStats();
+}
+
+void ImageMatcher::ReleasePayloads() {
+  mPayloadCache->Clear();
+}
+
+void ImageMatcher::ReleasePayload(const ImageDescription &aDescription) const {
+  mPayloadCache->Release(aDescription);
+}
+
+void ImageMatcher::AddPayloadChecksums(const std::unordered_map<std::string, uint32_t> &aChecksums) {
+  mPayloadCache->AddChecksums(aChecksums);
+}
+
+bool ImageMatcher::CheckPayload(const ImageDescription &aDescription) const {
+  return mPayloadCache->Check(aDescription);
+}
+
+const ImageMatchingSettings &ImageMatcher::GetSettings() const {
+  return mSettings;
+}
+
+std::shared_ptr<const DBSnapshot> ImageMatcher::GetSnapshot() const {
+  return std::atomic_load(&mSnapshot);
+}
+
+void ImageMatcher::SetSnapshot(const std::shared_ptr<const DBSnapshot> &aSnapshot) {
+  std::atomic_store(&mSnapshot, aSnapshot);
+}
+
+ImageDescriptionPtr ImageMatcher::AddToInvertedFile(DBSnapshot &aSnapshot, const ImageDescription &aDescription) const {
+  if (aSnapshot.mVocabulary->IsEmpty()) {
+    return std::make_shared<const ImageDescription>(aDescription);
+  }
+
+  if (aDescription.GetBowVector().empty()) {
+    ImageDescriptionPtr description = std::make_shared<const ImageDescription>(aDescription.GetId(),
+        aDescription.GetKeypoints(), aDescription.GetDescriptorSet(), aDescription.GetHistogram(),
+        aSnapshot.mVocabulary->Transform(aDescription.GetDescriptors()), aDescription.GetScale(),
+        aDescription.GetStorage());
+    aSnapshot.mInvertedFile.Add(description->GetId(), description->GetBowVector());
+    return description;
+  }
+
+  aSnapshot.mInvertedFile.Add(aDescription.GetId(), aDescription.GetBowVector());
+  return std::make_shared<const ImageDescription>(aDescription);
 }
 
 std::tuple<std::vector<std::vector<cv::DMatch>>, std::vector<std::vector<cv::DMatch>>> ImageMatcher::Match(
     const ImageDescription &aFirstDescription, const ImageDescription &aSecondDescription) const {
+  // Corrupt item matches nothing.
   std::vector<std::vector<cv::DMatch>> matches;
-  mMatcher->knnMatch(aFirstDescription.GetDescriptors(), aSecondDescription.GetDescriptors(), matches, 2);
+  if (!mPayloadCache->Touch(aFirstDescription) || !mPayloadCache->Touch(aSecondDescription)) {
+    return PartitionMatches(matches);
+  }
+
+  // Descriptors are always ORB ones, so they go straight to the kernel specialised for their width.
+  HammingMatcher<DescriptorArena::kDescriptorBytes>::KnnMatch(aFirstDescription.GetDescriptorSet(),
+      aSecondDescription.GetDescriptorSet(), matches);
+
+  return PartitionMatches(matches);
+}
 
+std::tuple<std::vector<std::vector<cv::DMatch>>, std::vector<std::vector<cv::DMatch>>> ImageMatcher::PartitionMatches(
+    std::vector<std::vector<cv::DMatch>> &aMatches) const {
   // Partition matches collection in "good" and "bad" matches.
   float ratioTestK = mSettings.mRatioTestK;
-  auto matchSplitIterator = std::partition(matches.begin(), matches.end(),
-      [&ratioTestK](std::vector<cv::DMatch> matchPair) {
+  auto matchSplitIterator = std::partition(aMatches.begin(), aMatches.end(),
+      [&ratioTestK](const std::vector<cv::DMatch> &matchPair) {
         return matchPair.size() == 2 && matchPair[0].distance < ratioTestK * matchPair[1].distance;
       });
 
-  std::vector<std::vector<cv::DMatch>> goodMatches(matches.begin(), matchSplitIterator);
-  std::vector<std::vector<cv::DMatch>> badMatches(matchSplitIterator, matches.end());
+  std::vector<std::vector<cv::DMatch>> goodMatches(aMatches.begin(), matchSplitIterator);
+  std::vector<std::vector<cv::DMatch>> badMatches(matchSplitIterator, aMatches.end());
 
   return std::make_tuple(goodMatches, badMatches);
 }
 
-std::vector<std::tuple<float, ImageDescription>> ImageMatcher::FindMatches(const ImageDescription &aDescription) const {
-  std::vector<std::tuple<float, ImageDescription>> matchedDescriptions;
+float ImageMatcher::GetMatchingScore(const ImageDescription &aFirstDescription,
+    const ImageDescription &aSecondDescription, uint32_t aGoodMatchesCount, uint32_t aTotalMatchesCount) const {
+  return GetMatchingScore(aGoodMatchesCount, aTotalMatchesCount,
+      GetHistogramCorrelation(aFirstDescription, aSecondDescription));
+}
 
-  for (const auto &descriptionPair : mDB) {
-    const ImageDescription &description = descriptionPair.second;
+float ImageMatcher::GetMatchingScore(uint32_t aGoodMatchesCount, uint32_t aTotalMatchesCount,
+    double aHistogramCorrelation) const {
+  // If the two images have similar numbers of keypoints this number will be high and will increase the score.
+  // featureRatio = 1 - abs(aDescription.GetDescriptors.size() - description.GetDescriptors().size()) /
+  // description.GetDescriptors().size();
 
-    auto matchesTuple = Match(aDescription, description);
+  // If most of the feature matches are good ones this ratio will be high and will increase the score.
+  const float goodMatchRatio = (float) aGoodMatchesCount / (float) aTotalMatchesCount;
 
-    uint32_t goodMatchesCount = std::get<0>(matchesTuple).size();
-    uint32_t totalMatchesCount = goodMatchesCount + std::get<1>(matchesTuple).size();
+  // Both of the numbers above are between 0 and 1. We take their product and multiply by 100 to create a score
+  // between 0 and 100. Kind of a match percentage.
+  float score = goodMatchRatio * 100; // featureRatio * goodMatchRatio * 100
 
-    if (goodMatchesCount == 0) {
-      continue;
+  // Now boost the score based on how well the histograms match.
+  if (mSettings.mHistogramWeight > 0) {
+    score += mSettings.mHistogramWeight * aHistogramCorrelation;
+  }
+
+  return score;
+}
+
+double ImageMatcher::GetHistogramCorrelation(const ImageDescription &aFirstDescription,
+    const ImageDescription &aSecondDescription) const {
+  if (mSettings.mHistogramWeight <= 0) {
+    return 0;
+  }
+
+  return cv::compareHist(aFirstDescription.GetHistogram(), aSecondDescription.GetHistogram(), cv::HISTCMP_CORREL);
+}
+
+std::vector<uint8_t> ImageMatcher::GetHistogramCascade(const DBSnapshot &aSnapshot,
+    const ImageDescription &aDescription) const {
+  // Score can't exceed the one with every match being good, so if even that one doesn't reach the threshold for the
+  // worst possible correlation, some items may be rejected by their histogram alone. It's the same float arithmetic
+  // as the real score, so the bound holds exactly rather than up to rounding.
+  const bool canPruneByBound = mSettings.mHistogramWeight > 0 &&
+      GetMatchingScore(1, 1, -1.0) < mSettings.mMatchingScoreThreshold;
+  const bool isShortlisting = mSettings.mHistogramShortlistSize > 0 &&
+      mSettings.mHistogramShortlistSize < aSnapshot.mArena.GetItemCount();
+  if (!canPruneByBound && !isShortlisting) {
+    return std::vector<uint8_t>();
+  }
+
+  const size_t itemCount = aSnapshot.mArena.GetItemCount();
+  std::vector<double> correlations(itemCount);
+  std::vector<uint8_t> itemFilter(itemCount, 1);
+  auto scoreHistograms = [&](size_t aBegin, size_t aEnd) {
+    for (size_t item = aBegin; item < aEnd; ++item) {
+      const ImageDescription &description = *aSnapshot.mDescriptions[item];
+      correlations[item] = cv::compareHist(aDescription.GetHistogram(), description.GetHistogram(), cv::HISTCMP_CORREL);
+      if (canPruneByBound && GetMatchingScore(1, 1, correlations[item]) < mSettings.mMatchingScoreThreshold) {
+        itemFilter[item] = 0;
+      }
+    }
+  };
+  mThreadPool->ParallelFor(itemCount, 256, scoreHistograms);
+
+  // Aggressive mode: keep only the best correlating items, this one may throw away the true match.
+  if (isShortlisting) {
+    std::vector<uint32_t> items;
+    for (uint32_t item = 0; item < itemCount; ++item) {
+      if (itemFilter[item]) {
+        items.push_back(item);
+      }
+    }
+
+    if (items.size() > mSettings.mHistogramShortlistSize) {
+      std::nth_element(items.begin(), items.begin() + mSettings.mHistogramShortlistSize, items.end(),
+          [&correlations](uint32_t a, uint32_t b) {
+            return correlations[a] > correlations[b] || (correlations[a] == correlations[b] && a < b);
+          });
+
+      for (auto item = items.begin() + mSettings.mHistogramShortlistSize; item != items.end(); ++item) {
+        itemFilter[*item] = 0;
+      }
+    }
+  }
+
+  fprintf(stderr, "ImageMatcher::GetHistogramCascade() %li of %lu items passed.\n",
+      std::count(itemFilter.begin(), itemFilter.end(), 1), itemCount);
+
+  return itemFilter;
+}
+
+std::vector<std::tuple<float, ImageDescriptionPtr>> ImageMatcher::FindMatches(
+    const ImageDescription &aDescription) const {
+  const std::shared_ptr<const DBSnapshot> snapshot = GetSnapshot();
+  CandidateMatches candidates = GetCandidates(*snapshot, aDescription);
+
+  std::vector<std::tuple<float, ImageDescriptionPtr>> matches = ScoreCandidates(*snapshot, aDescription, candidates);
+  std::sort(matches.begin(), matches.end(), IsBetterMatch);
+  VerifyMatches(*snapshot, aDescription, matches);
+  return matches;
+}
+
+std::vector<std::tuple<float, ImageDescriptionPtr>> ImageMatcher::FindTopMatches(const ImageDescription &aDescription,
+    uint32_t aCount, const TopMatchesOptions &aOptions) const {
+  std::vector<std::tuple<float, ImageDescriptionPtr>> topMatches = ScanTopMatches(*GetSnapshot(), aDescription,
+      aCount, aOptions);
+
+  if (aOptions.mPrior && !topMatches.empty()) {
+    aOptions.mPrior->OnMatched(std::get<1>(topMatches[0])->GetId());
+  }
+
+  return topMatches;
+}
+
+std::vector<std::tuple<float, ImageDescriptionPtr>> ImageMatcher::Identify(const cv::Mat &aInputFrame, uint32_t aCount,
+    const TopMatchesOptions &aOptions, ImageDescription &aDescription,
+    std::vector<IdentificationStage> *aStages) const {
+  // All stages match against the same snapshot.
+  const std::shared_ptr<const DBSnapshot> snapshot = GetSnapshot();
+
+  auto start = std::chrono::high_resolution_clock::now();
+  cv::Mat frame;
+  const float scale = ToWorkingResolution(aInputFrame, frame);
+  const cv::Point2f offset = GetWorkingOffset(aInputFrame, scale);
+
+  cv::Mat gray, mask, histogram;
+  FramePreprocessor::Process(frame, gray, mask, histogram, mThreadPool.get());
+
+  // Keypoints come strongest first, so every stage extends the previous one.
+  std::vector<cv::KeyPoint> keypoints;
+  mFeatureExtractor.Detect(gray, mask, keypoints, mThreadPool.get());
+  if (keypoints.size() < mSettings.mMinNumberOfFeatures) {
+    throw ImageQualityException("Image does not have enough keypoints.", ImageQualityExceptionCode::NotEnoughKeyPoints);
+  }
+
+  std::vector<size_t> stageEnds;
+  if (mSettings.mProgressiveFeatureCount > 0 && mSettings.mProgressiveFeatureCount < keypoints.size()) {
+    stageEnds.push_back(mSettings.mProgressiveFeatureCount);
+  }
+  stageEnds.push_back(keypoints.size());
+
+  const std::string id = GenerateId();
+  std::vector<cv::KeyPoint> stageKeypoints;
+  cv::Mat descriptors;
+  std::vector<std::tuple<float, ImageDescriptionPtr>> matches;
+  for (size_t stage = 0; stage < stageEnds.size(); ++stage) {
+    // Descriptors of the previous stages are kept, only the new keypoints are computed.
+    std::vector<cv::KeyPoint> newKeypoints(keypoints.begin() + (stage > 0 ? stageEnds[stage - 1] : 0),
+        keypoints.begin() + stageEnds[stage]);
+    cv::Mat newDescriptors;
+    mFeatureExtractor.Compute(gray, newKeypoints, newDescriptors, mThreadPool.get());
+    // Once described, keypoints are moved out of the view into the frame.
+    for (cv::KeyPoint &keypoint : newKeypoints) {
+      keypoint.pt += offset;
+    }
+    stageKeypoints.insert(stageKeypoints.end(), newKeypoints.begin(), newKeypoints.end());
+    descriptors.push_back(newDescriptors);
+
+    aDescription = ImageDescription(id, stageKeypoints, descriptors, histogram,
+        snapshot->mVocabulary->Transform(descriptors), scale);
+
+    auto matchingStart = std::chrono::high_resolution_clock::now();
+    // Certainty of the stage needs the runner-up.
+    matches = ScanTopMatches(*snapshot, aDescription, std::max<uint32_t>(aCount, 2), aOptions);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    IdentificationStage report;
+    report.mFeatureCount = stageKeypoints.size();
+    report.mExtractionTime = std::chrono::duration<double, std::milli>(matchingStart - start).count();
+    report.mMatchingTime = std::chrono::duration<double, std::milli>(end - matchingStart).count();
+    report.mBestMatch = matches.empty() ? nullptr : std::get<1>(matches[0]);
+    report.mBestScore = matches.empty() ? 0 : std::get<0>(matches[0]);
+    report.mMargin = 0;
+    if (!matches.empty()) {
+      report.mMargin = report.mBestScore - (matches.size() > 1 ?
+          std::max(std::get<0>(matches[1]), mSettings.mMatchingScoreThreshold) : mSettings.mMatchingScoreThreshold);
+    }
+    if (aStages != nullptr) {
+      aStages->push_back(report);
+    }
+
+    fprintf(stderr, "ImageMatcher::Identify() stage %lu: %u feature(s), %f ms extraction, %f ms matching, best score "
+        "(%f), margin (%f).\n", stage, report.mFeatureCount, report.mExtractionTime, report.mMatchingTime,
+        report.mBestScore, report.mMargin);
+
+    if (report.mBestMatch && report.mBestScore >= mSettings.mProgressiveCertaintyScore &&
+        report.mMargin >= mSettings.mProgressiveCertaintyMargin) {
+      break;
+    }
+    start = end;
+  }
+
+  if (matches.size() > aCount) {
+    matches.resize(aCount);
+  }
+
+  if (aOptions.mPrior && !matches.empty()) {
+    aOptions.mPrior->OnMatched(std::get<1>(matches[0])->GetId());
+  }
+
+  return matches;
+}
+
+std::vector<std::tuple<float, ImageDescriptionPtr>> ImageMatcher::ScanTopMatches(const DBSnapshot &aSnapshot,
+    const ImageDescription &aDescription, uint32_t aCount, const TopMatchesOptions &aOptions) const {
+  // Bounded heap with the worst of the best `keptCount` matches on top, verification may reorder them.
+  const uint32_t keptCount = aCount > 0 ? std::max(aCount, mSettings.mVerificationCount) : 0;
+  std::vector<std::tuple<float, ImageDescriptionPtr>> topMatches;
+  float bestScore = -std::numeric_limits<float>::infinity(), runnerUpScore = bestScore;
+  auto addMatches = [&](const std::vector<std::tuple<float, ImageDescriptionPtr>> &aMatches) {
+    for (const auto &match : aMatches) {
+      const float score = std::get<0>(match);
+      if (score > bestScore) {
+        runnerUpScore = bestScore;
+        bestScore = score;
+      } else if (score > runnerUpScore) {
+        runnerUpScore = score;
+      }
+
+      if (keptCount == 0) {
+        continue;
+      }
+
+      if (topMatches.size() < keptCount) {
+        topMatches.push_back(match);
+        std::push_heap(topMatches.begin(), topMatches.end(), IsBetterMatch);
+      } else if (IsBetterMatch(match, topMatches.front())) {
+        std::pop_heap(topMatches.begin(), topMatches.end(), IsBetterMatch);
+        topMatches.back() = match;
+        std::push_heap(topMatches.begin(), topMatches.end(), IsBetterMatch);
+      }
+    }
+  };
+
+  if (aOptions.mCertaintyScore == std::numeric_limits<float>::infinity()) {
+    CandidateMatches candidates = GetCandidates(aSnapshot, aDescription);
+    addMatches(ScoreCandidates(aSnapshot, aDescription, candidates));
+  } else {
+    // A sweep (brute force, vocabulary shortlist) costs per item, so every batch is swept only once it's reached. An
+    // index probes every query row once whatever the number of items, so its k-NN lists are collected upfront and only
+    // scoring (with its payload checks) stops early.
+    const bool isSwept = UsesShortlist(aSnapshot) || mSettings.mMatcherBackend == MatcherBackend::BRUTE_FORCE;
+    CandidateMatches indexCandidates;
+    std::vector<std::string> candidateIds;
+    if (isSwept) {
+      candidateIds = GetCandidateIds(aSnapshot, aDescription);
+    } else {
+      indexCandidates = GetCandidates(aSnapshot, aDescription);
+      for (size_t slot = 0; slot < indexCandidates.Size(); ++slot) {
+        candidateIds.push_back(aSnapshot.mArena.GetItemId(indexCandidates.GetItem(slot)));
+      }
+    }
+    if (aOptions.mPrior) {
+      aOptions.mPrior->Order(candidateIds);
+    }
+
+    const size_t batchSize = std::max<uint32_t>(aOptions.mBatchSize, 1);
+    for (size_t batchStart = 0; batchStart < candidateIds.size(); batchStart += batchSize) {
+      const std::vector<std::string> batchIds(candidateIds.begin() + batchStart,
+          candidateIds.begin() + std::min(batchStart + batchSize, candidateIds.size()));
+      if (isSwept) {
+        CandidateMatches candidates = aSnapshot.mArena.KnnMatch(aDescription.GetDescriptors(), batchIds,
+            mThreadPool.get());
+        addMatches(ScoreCandidates(aSnapshot, aDescription, candidates));
+      } else {
+        std::vector<size_t> batchSlots;
+        for (const std::string &id : batchIds) {
+          batchSlots.push_back(indexCandidates.FindSlot(aSnapshot.mArena.GetItemIndex(id)));
+        }
+        addMatches(ScoreCandidates(aSnapshot, aDescription, indexCandidates, &batchSlots));
+      }
+
+      const float margin = bestScore - std::max(runnerUpScore, mSettings.mMatchingScoreThreshold);
+      if (bestScore >= aOptions.mCertaintyScore && margin >= aOptions.mCertaintyMargin) {
+        fprintf(stderr, "ImageMatcher::FindTopMatches() stopped after %lu of %lu candidate(s), best score (%f), "
+            "margin (%f).\n", batchStart + batchIds.size(), candidateIds.size(), bestScore, margin);
+        break;
+      }
     }
+  }
 
-    // If the two images have similar numbers of keypoints this number will be high and will increase the score.
-    // featureRatio = 1 - abs(aDescription.GetDescriptors.size() - description.GetDescriptors().size()) /
-    // description.GetDescriptors().size();
+  std::sort_heap(topMatches.begin(), topMatches.end(), IsBetterMatch);
+  VerifyMatches(aSnapshot, aDescription, topMatches);
+  if (topMatches.size() > aCount) {
+    topMatches.resize(aCount);
+  }
 
-    // If most of the feature matches are good ones this ratio will be high and will increase the score.
-    const float goodMatchRatio = (float) goodMatchesCount / (float) totalMatchesCount;
+  return topMatches;
+}
+
+std::vector<std::tuple<float, ImageDescriptionPtr>> ImageMatcher::FindMatchesExhaustive(
+    const ImageDescription &aDescription) const {
+  const std::shared_ptr<const DBSnapshot> snapshot = GetSnapshot();
+  // One sweep over the whole arena instead of a `knnMatch` call per item.
+  CandidateMatches candidates = snapshot->mArena.KnnMatch(aDescription.GetDescriptors(), mThreadPool.get());
+
+  std::vector<std::tuple<float, ImageDescriptionPtr>> matches = ScoreCandidates(*snapshot, aDescription, candidates);
+  std::sort(matches.begin(), matches.end(), IsBetterMatch);
+  VerifyMatches(*snapshot, aDescription, matches);
+  return matches;
+}
 
-    // Both of the numbers above are between 0 and 1. We take their product and multiply by 100 to create a score
-    // between 0 and 100. Kind of a match percentage.
-    float score = goodMatchRatio * 100; // featureRatio * goodMatchRatio * 100
+CandidateMatches ImageMatcher::GetCandidates(const DBSnapshot &aSnapshot, const ImageDescription &aDescription) const {
+  // Items whose histograms rule them out are never matched by descriptors.
+  const std::vector<uint8_t> itemFilter = GetHistogramCascade(aSnapshot, aDescription);
 
-    // Now boost the score based on how well the histograms match.
-    if (mSettings.mHistogramWeight > 0) {
-      double histogramCorrelation = cv::compareHist(aDescription.GetHistogram(), description.GetHistogram(),
-          cv::HISTCMP_CORREL);
-      score += mSettings.mHistogramWeight * histogramCorrelation;
+  if (UsesShortlist(aSnapshot)) {
+    return aSnapshot.mArena.KnnMatch(aDescription.GetDescriptors(), GetShortlist(aSnapshot, aDescription, itemFilter),
+        mThreadPool.get());
+  }
+
+  switch (mSettings.mMatcherBackend) {
+    case MatcherBackend::BRUTE_FORCE: {
+      if (itemFilter.empty()) {
+        return aSnapshot.mArena.KnnMatch(aDescription.GetDescriptors(), mThreadPool.get());
+      }
+
+      std::vector<std::string> itemIds;
+      for (uint32_t item = 0; item < aSnapshot.mArena.GetItemCount(); ++item) {
+        if (itemFilter[item]) {
+          itemIds.push_back(aSnapshot.mArena.GetItemId(item));
+        }
+      }
+      return aSnapshot.mArena.KnnMatch(aDescription.GetDescriptors(), itemIds, mThreadPool.get());
     }
+    case MatcherBackend::LSH:
+      return aSnapshot.mLshIndex.KnnMatch(aSnapshot.mArena, aDescription.GetDescriptors(), mThreadPool.get(),
+          itemFilter.empty() ? nullptr : &itemFilter);
+    case MatcherBackend::MULTI_INDEX_HASH:
+    default:
+      // The index gives us k-NN lists only for the items that have at least one descriptor close enough to the query,
+      // any other item can't have good matches and would be skipped anyway.
+      return aSnapshot.mIndex.KnnMatch(aSnapshot.mArena, aDescription.GetDescriptors(), mThreadPool.get(),
+          itemFilter.empty() ? nullptr : &itemFilter);
+  }
+}
+
+bool ImageMatcher::UsesShortlist(const DBSnapshot &aSnapshot) const {
+  return mSettings.mShortlistSize > 0 && !aSnapshot.mVocabulary->IsEmpty();
+}
+
+std::vector<std::string> ImageMatcher::GetCandidateIds(const DBSnapshot &aSnapshot,
+    const ImageDescription &aDescription) const {
+  const std::vector<uint8_t> itemFilter = GetHistogramCascade(aSnapshot, aDescription);
+
+  if (UsesShortlist(aSnapshot)) {
+    return GetShortlist(aSnapshot, aDescription, itemFilter);
+  }
+
+  std::vector<std::string> candidateIds;
+  for (uint32_t item = 0; item < aSnapshot.mArena.GetItemCount(); ++item) {
+    if (itemFilter.empty() || itemFilter[item]) {
+      candidateIds.push_back(aSnapshot.mArena.GetItemId(item));
+    }
+  }
+
+  return candidateIds;
+}
+
+std::vector<std::string> ImageMatcher::GetShortlist(const DBSnapshot &aSnapshot, const ImageDescription &aDescription,
+    const std::vector<uint8_t> &aItemFilter) const {
+  // Descriptions that have been created before vocabulary was available don't have bag-of-words vector.
+  const BowVector &bowVector = aDescription.GetBowVector().empty() ?
+      aSnapshot.mVocabulary->Transform(aDescription.GetDescriptors()) : aDescription.GetBowVector();
+
+  // Run the full matching only against the items that share the most visual words with the query.
+  std::vector<std::string> shortlistedIds;
+  for (const auto &shortlisted : aSnapshot.mInvertedFile.Query(bowVector, mSettings.mShortlistSize)) {
+    const int32_t item = aSnapshot.mArena.GetItemIndex(std::get<1>(shortlisted));
+    if (item >= 0 && (aItemFilter.empty() || aItemFilter[item])) {
+      shortlistedIds.push_back(std::get<1>(shortlisted));
+    }
+  }
+
+  return shortlistedIds;
+}
+
+std::vector<std::tuple<float, ImageDescriptionPtr>> ImageMatcher::ScoreCandidates(const DBSnapshot &aSnapshot,
+    const ImageDescription &aDescription, const CandidateMatches &aCandidates,
+    const std::vector<size_t> *aSlots) const {
+  // Visit candidates in id order rather than in the order they have been selected in.
+  std::vector<size_t> candidates;
+  if (aSlots != nullptr) {
+    candidates = *aSlots;
+  } else {
+    for (size_t slot = 0; slot < aCandidates.Size(); ++slot) {
+      candidates.push_back(slot);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+    return aSnapshot.mArena.GetItemId(aCandidates.GetItem(a)) < aSnapshot.mArena.GetItemId(aCandidates.GetItem(b));
+  });
+
+  // Every candidate is scored independently into its own slot: (score, good matches, total matches).
+  std::vector<std::tuple<float, uint32_t, uint32_t>> scores(candidates.size(), std::make_tuple(0.0f, 0, 0));
+  auto scoreCandidates = [&](size_t aBegin, size_t aEnd) {
+    for (size_t i = aBegin; i < aEnd; ++i) {
+      // Every query row has a k-NN list for the item, rows the candidate selection hasn't found anything for count as
+      // bad matches.
+      const uint32_t goodMatchesCount = aCandidates.CountGoodMatches(candidates[i], mSettings.mRatioTestK);
+      const uint32_t totalMatchesCount = aCandidates.GetRowCount();
+
+      if (goodMatchesCount == 0) {
+        continue;
+      }
+
+      // Arena has matched the item's descriptors as they are, a corrupt item must not be scored on them.
+      const ImageDescriptionPtr &description = aSnapshot.mDescriptions[aCandidates.GetItem(candidates[i])];
+      if (!mPayloadCache->Check(*description)) {
+        continue;
+      }
+      scores[i] = std::make_tuple(GetMatchingScore(aDescription, *description, goodMatchesCount, totalMatchesCount),
+          goodMatchesCount, totalMatchesCount);
+    }
+  };
+
+  const size_t chunkSize = std::max<size_t>(candidates.size() / (mThreadPool->GetThreadCount() * 4), 1);
+  mThreadPool->ParallelFor(candidates.size(), chunkSize, scoreCandidates);
+
+  std::vector<std::tuple<float, ImageDescriptionPtr>> matchedDescriptions;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const uint32_t goodMatchesCount = std::get<1>(scores[i]), totalMatchesCount = std::get<2>(scores[i]);
+    if (goodMatchesCount == 0) {
+      continue;
+    }
+
+    const ImageDescriptionPtr &description = aSnapshot.mDescriptions[aCandidates.GetItem(candidates[i])];
+    const float score = std::get<0>(scores[i]);
 
     fprintf(stderr, "ImageMatcher::FindMatches() %s vs %s: total matches (%i), good matches (%i), score (%f).\n",
-        aDescription.GetId().c_str(), description.GetId().c_str(), totalMatchesCount, goodMatchesCount, score);
+        aDescription.GetId().c_str(), description->GetId().c_str(), totalMatchesCount, goodMatchesCount, score);
 
     if (score >= mSettings.mMatchingScoreThreshold) {
       matchedDescriptions.push_back(std::make_tuple(score, description));
     }
   }
 
-  // Sort matched description by score (first element of the tuple).
-  std::sort(std::begin(matchedDescriptions), std::end(matchedDescriptions),
-      [](const std::tuple<float, ImageDescription> &a, const std::tuple<float, ImageDescription> &b) {
-        return std::get<0>(b) < std::get<0>(a);
-      });
-
   return matchedDescriptions;
 }
 
+void ImageMatcher::VerifyMatches(const DBSnapshot &aSnapshot, const ImageDescription &aDescription,
+    std::vector<std::tuple<float, ImageDescriptionPtr>> &aMatches) const {
+  if (mSettings.mVerificationCount == 0 || aMatches.empty()) {
+    return;
+  }
+
+  if (aMatches.size() > mSettings.mVerificationCount) {
+    aMatches.resize(mSettings.mVerificationCount);
+  }
+
+  // Exact k-NN lists, whatever backend has selected the candidates. There are only a few of them to match.
+  std::vector<std::string> itemIds;
+  for (const auto &match : aMatches) {
+    itemIds.push_back(std::get<1>(match)->GetId());
+  }
+  CandidateMatches candidates = aSnapshot.mArena.KnnMatch(aDescription.GetDescriptors(), itemIds, mThreadPool.get());
+
+  // Every match is verified independently into its own slot: (score, inliers, total matches).
+  std::vector<std::tuple<float, uint32_t, uint32_t>> scores(aMatches.size(), std::make_tuple(0.0f, 0, 0));
+  auto verifyMatches = [&](size_t aBegin, size_t aEnd) {
+    for (size_t i = aBegin; i < aEnd; ++i) {
+      const ImageDescription &description = *std::get<1>(aMatches[i]);
+      const int32_t slot = candidates.FindSlot(aSnapshot.mArena.GetItemIndex(description.GetId()));
+      if (slot < 0) {
+        continue;
+      }
+
+      // Only the good matches are bucketed into lists, RANSAC needs them.
+      std::vector<std::vector<cv::DMatch>> goodMatches = candidates.GetGoodMatches(slot, mSettings.mRatioTestK);
+      const uint32_t totalMatchesCount = candidates.GetRowCount();
+      const uint32_t inliersCount = CountInliers(aDescription, description, goodMatches);
+      if (inliersCount > 0) {
+        scores[i] = std::make_tuple(GetMatchingScore(aDescription, description, inliersCount, totalMatchesCount),
+            inliersCount, totalMatchesCount);
+      }
+    }
+  };
+  mThreadPool->ParallelFor(aMatches.size(), 1, verifyMatches);
+
+  std::vector<std::tuple<float, ImageDescriptionPtr>> verifiedMatches;
+  for (size_t i = 0; i < aMatches.size(); ++i) {
+    const float score = std::get<0>(scores[i]);
+
+    fprintf(stderr, "ImageMatcher::VerifyMatches() %s vs %s: total matches (%i), inliers (%i), score (%f -> %f).\n",
+        aDescription.GetId().c_str(), std::get<1>(aMatches[i])->GetId().c_str(), std::get<2>(scores[i]),
+        std::get<1>(scores[i]), std::get<0>(aMatches[i]), score);
+
+    if (std::get<1>(scores[i]) > 0 && score >= mSettings.mMatchingScoreThreshold) {
+      verifiedMatches.push_back(std::make_tuple(score, std::get<1>(aMatches[i])));
+    }
+  }
+
+  std::sort(verifiedMatches.begin(), verifiedMatches.end(), IsBetterMatch);
+  aMatches.swap(verifiedMatches);
+}
+
+uint32_t ImageMatcher::CountInliers(const ImageDescription &aFirstDescription,
+    const ImageDescription &aSecondDescription, std::vector<std::vector<cv::DMatch>> &aGoodMatches) const {
+  const bool isHomography = mSettings.mVerificationModel == GeometricModel::HOMOGRAPHY;
+  if (aGoodMatches.size() < (isHomography ? 4 : 3)) {
+    return 0;
+  }
+
+  // PROSAC draws its samples from the most confident matches first.
+  std::sort(aGoodMatches.begin(), aGoodMatches.end(),
+      [](const std::vector<cv::DMatch> &a, const std::vector<cv::DMatch> &b) { return a[0].distance < b[0].distance; });
+
+  if (!mPayloadCache->Touch(aFirstDescription) || !mPayloadCache->Touch(aSecondDescription)) {
+    return 0;
+  }
+
+  const KeypointSet &firstKeypoints = aFirstDescription.GetKeypoints();
+  const KeypointSet &secondKeypoints = aSecondDescription.GetKeypoints();
+  std::vector<cv::Point2f> firstPoints, secondPoints;
+  for (const std::vector<cv::DMatch> &matchPair : aGoodMatches) {
+    const cv::DMatch &match = matchPair[0];
+    if ((size_t) match.queryIdx < firstKeypoints.Size() && (size_t) match.trainIdx < secondKeypoints.Size()) {
+      firstPoints.push_back(firstKeypoints.GetPoint(match.queryIdx));
+      secondPoints.push_back(secondKeypoints.GetPoint(match.trainIdx));
+    }
+  }
+
+  if (firstPoints.size() < (isHomography ? 4 : 3)) {
+    return 0;
+  }
+
+  if (isHomography) {
+    // RHO is OpenCV's PROSAC-based estimator.
+    cv::Mat inliersMask;
+    const cv::Mat homography = cv::findHomography(firstPoints, secondPoints, cv::RHO,
+        mSettings.mVerificationReprojectionError, inliersMask);
+    return homography.empty() ? 0 : cv::countNonZero(inliersMask);
+  }
+
+  // OpenCV 3.1 has no robust affine estimator that reports inliers, so they're counted by reprojection.
+  const cv::Mat affine = cv::estimateRigidTransform(firstPoints, secondPoints, true /* fullAffine */);
+  if (affine.empty()) {
+    return 0;
+  }
+
+  const double maxSquaredError = mSettings.mVerificationReprojectionError * mSettings.mVerificationReprojectionError;
+  uint32_t inliersCount = 0;
+  for (size_t i = 0; i < firstPoints.size(); ++i) {
+    const double dx = affine.at<double>(0, 0) * firstPoints[i].x + affine.at<double>(0, 1) * firstPoints[i].y +
+        affine.at<double>(0, 2) - secondPoints[i].x;
+    const double dy = affine.at<double>(1, 0) * firstPoints[i].x + affine.at<double>(1, 1) * firstPoints[i].y +
+        affine.at<double>(1, 2) - secondPoints[i].y;
+    if (dx * dx + dy * dy <= maxSquaredError) {
+      inliersCount++;
+    }
+  }
+
+  return inliersCount;
+}
+
+/*static*/ bool ImageMatcher::IsBetterMatch(const std::tuple<float, ImageDescriptionPtr> &aFirstMatch,
+    const std::tuple<float, ImageDescriptionPtr> &aSecondMatch) {
+  return std::get<0>(aFirstMatch) > std::get<0>(aSecondMatch) || (std::get<0>(aFirstMatch) ==
+      std::get<0>(aSecondMatch) && std::get<1>(aFirstMatch)->GetId() < std::get<1>(aSecondMatch)->GetId());
+}
+
 } // namespace lighthouse
@@ -10,15 +10,41 @@
 #define image_matcher_hpp
 
 #include <stdio.h>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <opencv2/opencv.hpp>
 #include <opencv2/features2d.hpp>
 
-#include "image_description.hpp"
+#include "db_snapshot.hpp"
+#include "payload_cache.hpp"
+#include "scan_prior.hpp"
+#include "thread_pool.hpp"
+#include "tiled_orb_extractor.hpp"
 
 namespace lighthouse {
 
+// Strategy that selects DB descriptors the query descriptors are matched against (when there is no vocabulary
+// shortlist).
+enum class MatcherBackend {
+  // Multi-index hash: finds every DB descriptor within the guaranteed search distance.
+  MULTI_INDEX_HASH = 0,
+  // Exact: every query descriptor is matched against every DB descriptor, same as `cv::BFMatcher` would.
+  BRUTE_FORCE = 1,
+  // Locality-sensitive hash: approximate, nothing is guaranteed to be found.
+  LSH = 2,
+};
+
+// Transform fitted to the good matches of a candidate during geometric verification.
+enum class GeometricModel {
+  // Perspective transform, the object is assumed to be planar.
+  HOMOGRAPHY = 0,
+  // Full 6-DOF affine transform, cheaper and more forgiving for non-planar objects seen from about the same angle.
+  AFFINE = 1,
+};
+
 // Describes all possible configurable values that can be passed to the ImageMatcher.
 struct ImageMatchingSettings {
   // Number of features to extract used in ORB detector.
@@ -31,27 +57,279 @@ struct ImageMatchingSettings {
   float mRatioTestK;
   // How much weight to give to histogram correlation when matching images.
   float mHistogramWeight;
+  // Radius (in bits) probed within every 16-bit descriptor substring of the multi-index hash. All DB descriptors that
+  // are closer than 16 * (radius + 1) bits to the query descriptor are guaranteed to be found.
+  uint32_t mIndexSearchRadius;
+  // Number of items with the best bag-of-words score that are matched against the query, the rest of the DB is
+  // skipped. Used only if there is a vocabulary, 0 disables shortlisting.
+  uint32_t mShortlistSize;
+  // Number of threads (including the calling one) the query is matched against DB items on, 0 means one per core.
+  uint32_t mThreadCount;
+  // Aggressive histogram cascade: only this many items whose color histograms correlate best with the query are
+  // matched by descriptors. Unlike the always-on threshold bound it may drop the true match, 0 disables.
+  uint32_t mHistogramShortlistSize;
+  // How query descriptors are matched against the DB, only the index of the selected backend is built.
+  MatcherBackend mMatcherBackend;
+  // Parameters of the `MatcherBackend::LSH` index: number of hash tables, number of sampled bits per key (up to 32) and
+  // the number of key bits that are flipped when probing neighbouring buckets.
+  uint32_t mLshTableCount;
+  uint32_t mLshKeySize;
+  uint32_t mLshProbeRadius;
+  // Number of best matches that are verified geometrically, 0 disables verification. Verified matches are re-scored
+  // with only their good matches that agree with a single transform (inliers) counted as good ones, and the rest of
+  // the matches is dropped, as their scores aren't comparable anymore.
+  uint32_t mVerificationCount;
+  // Transform fitted to the good matches of verified candidates.
+  GeometricModel mVerificationModel;
+  // Max reprojection error (in pixels) of an inlier.
+  float mVerificationReprojectionError;
+  // Features are extracted in parallel from a grid of this many tiles per side that share the `mNumberOfFeatures`
+  // budget, 0 or 1 extracts them from the whole image at once.
+  uint32_t mExtractionGridSize;
+  // Anytime identification (`ImageMatcher::Identify`): the query is first matched with only this many strongest
+  // features and is answered right away if the best match scores at least `mProgressiveCertaintyScore` and is at least
+  // `mProgressiveCertaintyMargin` ahead of the runner-up (or the threshold). Otherwise descriptors of the rest of the
+  // `mNumberOfFeatures` keypoints are computed and the query is matched again with all of them. 0 disables the first
+  // stage.
+  uint32_t mProgressiveFeatureCount;
+  float mProgressiveCertaintyScore;
+  float mProgressiveCertaintyMargin;
+  // Working resolution: images are downsampled (by area averaging) before anything is extracted from them, so that
+  // the longer side is at most `mWorkingMaxSide` pixels and there are at most `mWorkingMegapixels` million pixels, 0
+  // disables either limit. Images are never upsampled. Scale of the working resolution is recorded in the description.
+  uint32_t mWorkingMaxSide;
+  float mWorkingMegapixels;
+  // Budget (in MB) for the pages of keypoints and descriptors of the items loaded from the description DB kept resident
+  // between one to one matches (see `PayloadCache`), 0 means no limit. It covers only that: descriptor arena and the
+  // other indexes have their own copies, which are resident whatever the budget.
+  uint32_t mPayloadCacheMegabytes;
+};
+
+// Tunes `ImageMatcher::FindTopMatches`.
+struct TopMatchesOptions {
+  TopMatchesOptions()
+      : mCertaintyScore(std::numeric_limits<float>::infinity()), mCertaintyMargin(0), mBatchSize(4), mPrior() {
+  }
+
+  // Candidates are matched in the prior's order, batch by batch, and the scan stops as soon as the best score so far
+  // is at least `mCertaintyScore` and exceeds the runner-up (or the matching threshold, if there is no runner-up yet)
+  // by at least `mCertaintyMargin`. Infinite certainty score disables early exit: every candidate is matched at once.
+  float mCertaintyScore;
+  float mCertaintyMargin;
+  // Number of candidates matched between early exit checks, they are matched in parallel.
+  uint32_t mBatchSize;
+  // Order in which candidates are scanned, candidate selection order if not set. Prior learns about the best match of
+  // every query.
+  std::shared_ptr<ScanPrior> mPrior;
+};
+
+// What one stage of `ImageMatcher::Identify` has done and found.
+struct IdentificationStage {
+  // Number of query features matched at this stage.
+  uint32_t mFeatureCount;
+  // Time (in ms) spent on the frame and features (descriptors of this stage's features only, except for the first
+  // stage that also covers frame preprocessing and keypoint detection) and on matching.
+  double mExtractionTime;
+  double mMatchingTime;
+  // Best match of this stage (`nullptr` if nothing has matched), its score and how far it's ahead of the runner-up
+  // (or the threshold, if there is no runner-up).
+  ImageDescriptionPtr mBestMatch;
+  float mBestScore;
+  float mMargin;
 };
 
+// Matches image descriptions against the DB of known items. The DB is an immutable `DBSnapshot` that is replaced as a
+// whole by `AddToDB`/`SetVocabulary`, so matching can run on any number of threads while items are being added: every
+// query works with the snapshot that was current when it started and never takes a lock.
 class ImageMatcher {
 public:
   ImageMatcher(ImageMatchingSettings aSettings);
 
+  // Copy shares the current snapshot and the thread pool, but gets its own write lock.
+  ImageMatcher(const ImageMatcher &aOther);
+
+  ImageMatcher &operator=(const ImageMatcher&) = delete;
+
+  // Describes BGRA frame, alpha channel is used as a mask. Frame may be a view into a larger one (e.g. the object crop
+  // `Camera` captures): only the view is processed, but keypoints are in the coordinates of the larger frame.
   ImageDescription GetDescription(const cv::Mat &aInputFrame) const;
 
-  const ImageDescription &GetDescription(const std::string &id) const;
+  // Describes BGR or grayscale image, features are extracted only where the one-channel mask (may be empty) is
+  // non-zero. Image may be a view, same as the frame above.
+  ImageDescription GetDescription(const cv::Mat &aImage, const cv::Mat &aMask) const;
+
+  // Detects keypoints of the BGRA frame the way `Identify` does, strongest first, without computing descriptors or
+  // anything else they're described with, e.g. for tracking. Keypoints are in the working resolution coordinates of the
+  // frame (or the larger one it's a view into), their scale is returned in `aScale`. Throws `ImageQualityException` if
+  // the frame doesn't have enough keypoints.
+  std::vector<cv::KeyPoint> DetectKeypoints(const cv::Mat &aInputFrame, float &aScale) const;
+
+  // Returns the DB item with the specified id or `nullptr` if there is no such item.
+  ImageDescriptionPtr GetDescription(const std::string &id) const;
 
   std::tuple<std::vector<std::vector<cv::DMatch>>, std::vector<std::vector<cv::DMatch>>> Match(
       const ImageDescription &aFirstDescription, const ImageDescription &aSecondDescription) const;
 
-  std::vector<std::tuple<float, ImageDescription>> FindMatches(const ImageDescription &aDescription) const;
+  std::vector<std::tuple<float, ImageDescriptionPtr>> FindMatches(const ImageDescription &aDescription) const;
+
+  // Returns up to `aCount` best matches, best first: same as the head of `FindMatches`, unless the scan has stopped
+  // early as allowed by the options. Candidates are scored batch by batch and only `aCount` best scored ones (or
+  // `mVerificationCount` if it's more, early exit looks at the scores before verification) are kept for verification.
+  // Without early exit all candidates are matched and scored at once, same as with `FindMatches`.
+  std::vector<std::tuple<float, ImageDescriptionPtr>> FindTopMatches(const ImageDescription &aDescription,
+      uint32_t aCount, const TopMatchesOptions &aOptions = TopMatchesOptions()) const;
+
+  // Describes the BGRA frame and returns up to `aCount` best matches, same as `GetDescription` followed by
+  // `FindTopMatches`, but in stages (see `mProgressiveFeatureCount`): descriptors of the strongest features are
+  // computed and matched first, and the rest only if the first stage isn't certain enough. Description of the last
+  // stage is returned in `aDescription`, and if `aStages` is given, what every stage has done is appended to it.
+  // Throws `ImageQualityException` if the frame doesn't have enough keypoints.
+  std::vector<std::tuple<float, ImageDescriptionPtr>> Identify(const cv::Mat &aInputFrame, uint32_t aCount,
+      const TopMatchesOptions &aOptions, ImageDescription &aDescription,
+      std::vector<IdentificationStage> *aStages = nullptr) const;
 
+  // Reference implementation of `FindMatches` that matches the description against every item in the DB. It's as slow
+  // as it gets and is meant only for benchmarking candidate selection strategies against.
+  std::vector<std::tuple<float, ImageDescriptionPtr>> FindMatchesExhaustive(const ImageDescription &aDescription) const;
+
+  // Adds description to the DB. Every call costs only as much as the added item (the new snapshot shares everything
+  // else with the current one), but the batch version computes bag-of-words vectors of many items on all threads.
   void AddToDB(const ImageDescription &aDescription);
 
+  // Adds all descriptions to the DB at once, descriptions with ids that are already in the DB are skipped. Missing
+  // bag-of-words vectors are computed on the thread pool. If an LSH index that has been built over the DB before (e.g.
+  // loaded from disk) is given, it replaces the current one, so that items it has already indexed aren't hashed again.
+  // Index built with parameters other than the ones in the settings is ignored.
+  void AddToDB(const std::vector<ImageDescription> &aDescriptions, const LshIndex *aLshIndex = nullptr);
+
+  // Returns handles to all descriptions in the DB, in the order they've been added.
+  std::vector<ImageDescriptionPtr> GetDescriptions() const;
+
+  // Replaces the vocabulary and re-computes bag-of-words vectors for all descriptions in the DB.
+  void SetVocabulary(const Vocabulary &aVocabulary);
+
+  std::shared_ptr<const Vocabulary> GetVocabulary() const;
+
+  // Copy is cheap, it shares the tables with the index of the current snapshot.
+  LshIndex GetLshIndex() const;
+
+  // Returns counters of the cache of DB items' keypoints and descriptors.
+  PayloadCacheStats GetPayloadCacheStats() const;
+
+  // Drops keypoints and descriptors of all DB items from memory, they're read again once they're needed.
+  void ReleasePayloads();
+
+  // Drops keypoints and descriptors of the DB item from memory unless they're kept for one to one matching, e.g. once
+  // they have been read to save the DB.
+  void ReleasePayload(const ImageDescription &aDescription) const;
+
+  // Keypoints and descriptors of the DB items with the specified ids are checked against the checksums (see
+  // `DescriptionDatabase::GetPayloadChecksum`) once they're needed, items whose payload doesn't match are never
+  // matched.
+  void AddPayloadChecksums(const std::unordered_map<std::string, uint32_t> &aChecksums);
+
+  // Checks keypoints and descriptors of the description against its checksum, if there is one that hasn't been checked
+  // yet. Returns false if they're corrupt.
+  bool CheckPayload(const ImageDescription &aDescription) const;
+
+  const ImageMatchingSettings &GetSettings() const;
+
 private:
-  cv::Ptr<cv::Feature2D> mKeypointDetector;
-  cv::Ptr<cv::DescriptorMatcher> mMatcher;
-  std::unordered_map<std::string, ImageDescription> mDB;
+  // Returns the current DB snapshot. Never blocks on writers.
+  std::shared_ptr<const DBSnapshot> GetSnapshot() const;
+
+  // Makes the snapshot current. Must be called with `mWriteMutex` held.
+  void SetSnapshot(const std::shared_ptr<const DBSnapshot> &aSnapshot);
+
+  // Returns the image downsampled to the working resolution (or the image itself, without a copy, if it's small
+  // enough already) and its scale relative to the image.
+  float ToWorkingResolution(const cv::Mat &aImage, cv::Mat &aResult) const;
+
+  // Returns position of the image within the frame it's a view into (zero if it isn't a view) at the working resolution
+  // of the specified scale.
+  static cv::Point2f GetWorkingOffset(const cv::Mat &aImage, float aScale);
+
+  // Extracts features from the grayscale image within the mask and creates a new description with the histogram and
+  // the scale of the working resolution. Keypoints are moved by the offset once their descriptors are computed.
+  ImageDescription CreateDescription(const cv::Mat &aGray, const cv::Mat &aMask, const cv::Mat &aHistogram,
+      float aScale, const cv::Point2f &aOffset) const;
+
+  // Generates a new unique description id.
+  static std::string GenerateId();
+
+  // `FindTopMatches` against the specified snapshot, the prior isn't notified of the best match.
+  std::vector<std::tuple<float, ImageDescriptionPtr>> ScanTopMatches(const DBSnapshot &aSnapshot,
+      const ImageDescription &aDescription, uint32_t aCount, const TopMatchesOptions &aOptions) const;
+
+  // Selects DB items that may match the description and returns their k-NN lists.
+  CandidateMatches GetCandidates(const DBSnapshot &aSnapshot, const ImageDescription &aDescription) const;
+
+  // Returns true if candidates are selected by the vocabulary shortlist rather than by the matcher backend.
+  bool UsesShortlist(const DBSnapshot &aSnapshot) const;
+
+  // Returns ids of the DB items that may match the description, in candidate selection order: vocabulary shortlist if
+  // there is one, otherwise all items that have passed the histogram cascade.
+  std::vector<std::string> GetCandidateIds(const DBSnapshot &aSnapshot, const ImageDescription &aDescription) const;
+
+  // Returns ids of the vocabulary shortlist items that pass the item filter (see `GetHistogramCascade`).
+  std::vector<std::string> GetShortlist(const DBSnapshot &aSnapshot, const ImageDescription &aDescription,
+      const std::vector<uint8_t> &aItemFilter) const;
+
+  // Scores candidates (only the ones in `aSlots`, if it's given) and returns the ones that pass the threshold in id
+  // order, so that the result is the same whatever the number of threads.
+  std::vector<std::tuple<float, ImageDescriptionPtr>> ScoreCandidates(const DBSnapshot &aSnapshot,
+      const ImageDescription &aDescription, const CandidateMatches &aCandidates,
+      const std::vector<size_t> *aSlots = nullptr) const;
+
+  // Verifies up to `mVerificationCount` first matches (ordered best first) geometrically and replaces all matches with
+  // the re-scored verified ones that still pass the threshold, best first. No-op if verification is disabled.
+  void VerifyMatches(const DBSnapshot &aSnapshot, const ImageDescription &aDescription,
+      std::vector<std::tuple<float, ImageDescriptionPtr>> &aMatches) const;
+
+  // Fits the verification model to the good matches between the two descriptions and returns the number of inliers,
+  // 0 if there are too few matches to fit the model. Good matches are reordered, the closest first.
+  uint32_t CountInliers(const ImageDescription &aFirstDescription, const ImageDescription &aSecondDescription,
+      std::vector<std::vector<cv::DMatch>> &aGoodMatches) const;
+
+  // Orders matches best first, equally scored ones are ordered by id.
+  static bool IsBetterMatch(const std::tuple<float, ImageDescriptionPtr> &aFirstMatch,
+      const std::tuple<float, ImageDescriptionPtr> &aSecondMatch);
+
+  // Adds description to the snapshot's inverted file, computing its bag-of-words vector first if needed. Returns the
+  // description that should be stored in the snapshot.
+  ImageDescriptionPtr AddToInvertedFile(DBSnapshot &aSnapshot, const ImageDescription &aDescription) const;
+
+  // Partitions k-NN matches into "good" and "bad" ones using ratio test.
+  std::tuple<std::vector<std::vector<cv::DMatch>>, std::vector<std::vector<cv::DMatch>>> PartitionMatches(
+      std::vector<std::vector<cv::DMatch>> &aMatches) const;
+
+  // Calculates matching score for the two descriptions given their partitioned matches.
+  float GetMatchingScore(const ImageDescription &aFirstDescription, const ImageDescription &aSecondDescription,
+      uint32_t aGoodMatchesCount, uint32_t aTotalMatchesCount) const;
+
+  // Same as above given the histogram correlation of the two descriptions. Never decreases as the number of good
+  // matches grows, so `GetMatchingScore(1, 1, correlation)` is an upper bound for any descriptor matching outcome.
+  float GetMatchingScore(uint32_t aGoodMatchesCount, uint32_t aTotalMatchesCount, double aHistogramCorrelation) const;
+
+  // Returns correlation of the color histograms, or 0 if histograms don't contribute to the score.
+  double GetHistogramCorrelation(const ImageDescription &aFirstDescription,
+      const ImageDescription &aSecondDescription) const;
+
+  // First stage of the matching cascade: correlates histogram of the query with histograms of all arena items and
+  // flags (by arena item index) the ones that are still worth descriptor matching. An item is rejected if even a
+  // perfect descriptor match couldn't lift its score to the threshold, and, in the aggressive mode, if it's not among
+  // the best correlating ones. Returns an empty vector if nothing can be rejected, histograms aren't compared then.
+  std::vector<uint8_t> GetHistogramCascade(const DBSnapshot &aSnapshot, const ImageDescription &aDescription) const;
+
+  TiledOrbExtractor mFeatureExtractor;
+  // Current DB snapshot, accessed only through `std::atomic_load`/`std::atomic_store`.
+  std::shared_ptr<const DBSnapshot> mSnapshot;
+  // Serializes writers: every one of them builds the next snapshot out of the current one.
+  std::mutex mWriteMutex;
+  // Shared by all copies of the matcher, the pool is safe to use from several threads at once.
+  std::shared_ptr<ThreadPool> mThreadPool;
+  // Shared by all copies of the matcher, same as the DB items whose payloads it manages.
+  std::shared_ptr<PayloadCache> mPayloadCache;
   ImageMatchingSettings mSettings;
 };
 
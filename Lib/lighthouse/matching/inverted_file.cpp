@@ -0,0 +1,67 @@
+//
+//  inverted_file.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "inverted_file.hpp"
+
+namespace lighthouse {
+
+InvertedFile::InvertedFile(uint32_t aWordCount) : mItemIds(), mWords(std::max<uint32_t>(aWordCount, 1)), mPostings() {
+}
+
+void InvertedFile::Add(const std::string &aId, const BowVector &aBowVector) {
+  const uint32_t itemIndex = mItemIds.Size();
+  mItemIds.PushBack(aId);
+
+  for (const auto &entry : aBowVector) {
+    if (entry.first < mWords.GetBucketCount()) {
+      mWords.Add(entry.first);
+      mPostings.PushBack(std::make_pair(itemIndex, entry.second));
+    }
+  }
+}
+
+std::vector<std::tuple<float, std::string>> InvertedFile::Query(const BowVector &aBowVector,
+    uint32_t aMaxResults) const {
+  // Accumulate |a_i| + |b_i| - |a_i - b_i| over the common words only, see `Vocabulary::Score`.
+  std::vector<float> scores(mItemIds.Size(), 0);
+  // Score of an item may stay 0 after a visit (e.g. words with 0 weight), so visits are flagged on their own.
+  std::vector<uint8_t> isTouched(mItemIds.Size(), 0);
+  std::vector<uint32_t> touchedItems;
+  for (const auto &entry : aBowVector) {
+    if (entry.first >= mWords.GetBucketCount()) {
+      continue;
+    }
+
+    mWords.ForEach(entry.first, [&](uint32_t aPosting) {
+      const std::pair<uint32_t, float> &posting = mPostings[aPosting];
+      if (!isTouched[posting.first]) {
+        isTouched[posting.first] = 1;
+        touchedItems.push_back(posting.first);
+      }
+      scores[posting.first] += entry.second + posting.second - std::fabs(entry.second - posting.second);
+    });
+  }
+
+  const size_t resultCount = std::min<size_t>(aMaxResults, touchedItems.size());
+  std::partial_sort(touchedItems.begin(), touchedItems.begin() + resultCount, touchedItems.end(),
+      [&scores](uint32_t a, uint32_t b) {
+        return scores[b] < scores[a];
+      });
+
+  std::vector<std::tuple<float, std::string>> results;
+  for (size_t i = 0; i < resultCount; ++i) {
+    results.push_back(std::make_tuple(scores[touchedItems[i]] / 2, mItemIds[touchedItems[i]]));
+  }
+
+  return results;
+}
+
+} // namespace lighthouse
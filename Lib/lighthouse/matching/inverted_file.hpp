@@ -0,0 +1,45 @@
+//
+//  inverted_file.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef inverted_file_hpp
+#define inverted_file_hpp
+
+#include <stdio.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "append_only_vector.hpp"
+#include "vocabulary.hpp"
+
+namespace lighthouse {
+
+// Maps every visual word to the items that contain it, so that bag-of-words scores for the whole DB can be computed
+// by visiting only the items that share at least one word with the query. Postings are append-only and shared between
+// copies (see `AppendOnlyBuckets`), so every DB snapshot has its own copy.
+class InvertedFile {
+public:
+  // Words of the vocabulary the vectors are made with are in [0, aWordCount), others are ignored.
+  explicit InvertedFile(uint32_t aWordCount = 0);
+
+  void Add(const std::string &aId, const BowVector &aBowVector);
+
+  // Returns up to `aMaxResults` items with the highest L1 score (see `Vocabulary::Score`), best first.
+  std::vector<std::tuple<float, std::string>> Query(const BowVector &aBowVector, uint32_t aMaxResults) const;
+
+private:
+  // Ids of the added items, position in this vector is used as a compact item index.
+  AppendOnlyVector<std::string> mItemIds;
+  // Bucket per word id, entries are indices into `mPostings`: (item index, word weight in the item's vector).
+  AppendOnlyBuckets mWords;
+  AppendOnlyVector<std::pair<uint32_t, float>> mPostings;
+};
+
+} // namespace lighthouse
+
+#endif /* inverted_file_hpp */
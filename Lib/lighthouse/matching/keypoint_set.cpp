@@ -0,0 +1,118 @@
+//
+//  keypoint_set.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "keypoint_set.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Keypoint size is stored in 1/16 px (up to 4096 px) and angle in 1/256 of a full turn (~1.4 degrees).
+const float kSizeScale = 16.0f;
+const float kAngleScale = 256.0f / 360.0f;
+
+} // namespace
+
+KeypointSet::KeypointSet() : mX(), mY(), mSizes(), mAngles(), mPacked(nullptr), mPackedCount(0), mStorage() {
+}
+
+KeypointSet::KeypointSet(const std::vector<cv::KeyPoint> &aKeypoints) : KeypointSet() {
+  mX.reserve(aKeypoints.size());
+  mY.reserve(aKeypoints.size());
+  mSizes.reserve(aKeypoints.size());
+  mAngles.reserve(aKeypoints.size());
+
+  for (const cv::KeyPoint &keypoint : aKeypoints) {
+    mX.push_back(keypoint.pt.x);
+    mY.push_back(keypoint.pt.y);
+    mSizes.push_back((uint16_t) std::min(std::lround(std::max(keypoint.size, 0.0f) * kSizeScale), 65535L));
+    // ORB angles are within [0, 360), anything else (e.g. -1 for "not computed") wraps around.
+    mAngles.push_back((uint8_t) (std::lround(keypoint.angle * kAngleScale) & 0xFF));
+  }
+}
+
+KeypointSet::KeypointSet(const uint8_t *aPacked, size_t aCount, std::shared_ptr<const void> aStorage)
+    : KeypointSet() {
+  mPacked = aPacked;
+  mPackedCount = aCount;
+  mStorage = aStorage;
+}
+
+float KeypointSet::GetSize(size_t aIndex) const {
+  return GetSizes()[aIndex] / kSizeScale;
+}
+
+float KeypointSet::GetAngle(size_t aIndex) const {
+  return GetAngles()[aIndex] / kAngleScale;
+}
+
+void KeypointSet::PushBack(const KeypointSet &aSet, size_t aIndex) {
+  Detach();
+  mX.push_back(aSet.GetX()[aIndex]);
+  mY.push_back(aSet.GetY()[aIndex]);
+  mSizes.push_back(aSet.GetSizes()[aIndex]);
+  mAngles.push_back(aSet.GetAngles()[aIndex]);
+}
+
+KeypointSet KeypointSet::Head(size_t aCount) const {
+  KeypointSet head;
+  const size_t count = std::min(aCount, Size());
+  head.mX.assign(GetX(), GetX() + count);
+  head.mY.assign(GetY(), GetY() + count);
+  head.mSizes.assign(GetSizes(), GetSizes() + count);
+  head.mAngles.assign(GetAngles(), GetAngles() + count);
+  return head;
+}
+
+size_t KeypointSet::GetByteSize() const {
+  return GetPackedSize(Size());
+}
+
+cv::KeyPoint KeypointSet::GetKeypoint(size_t aIndex) const {
+  return cv::KeyPoint(GetX()[aIndex], GetY()[aIndex], GetSize(aIndex), GetAngle(aIndex));
+}
+
+std::vector<cv::KeyPoint> KeypointSet::ToKeypoints() const {
+  std::vector<cv::KeyPoint> keypoints;
+  keypoints.reserve(Size());
+  for (size_t i = 0; i < Size(); ++i) {
+    keypoints.push_back(GetKeypoint(i));
+  }
+  return keypoints;
+}
+
+void KeypointSet::WritePacked(std::ostream &aStream) const {
+  const size_t count = Size();
+  aStream.write(reinterpret_cast<const char *>(GetX()), count * sizeof(float));
+  aStream.write(reinterpret_cast<const char *>(GetY()), count * sizeof(float));
+  aStream.write(reinterpret_cast<const char *>(GetSizes()), count * sizeof(uint16_t));
+  aStream.write(reinterpret_cast<const char *>(GetAngles()), count * sizeof(uint8_t));
+}
+
+/*static*/ size_t KeypointSet::GetPackedSize(size_t aCount) {
+  return aCount * (sizeof(float) * 2 + sizeof(uint16_t) + sizeof(uint8_t));
+}
+
+void KeypointSet::Detach() {
+  if (mPacked == nullptr) {
+    return;
+  }
+
+  mX.assign(GetX(), GetX() + mPackedCount);
+  mY.assign(GetY(), GetY() + mPackedCount);
+  mSizes.assign(GetSizes(), GetSizes() + mPackedCount);
+  mAngles.assign(GetAngles(), GetAngles() + mPackedCount);
+  mPacked = nullptr;
+  mPackedCount = 0;
+  mStorage.reset();
+}
+
+} // namespace lighthouse
@@ -0,0 +1,138 @@
+//
+//  keypoint_set.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef keypoint_set_hpp
+#define keypoint_set_hpp
+
+#include <stdio.h>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <cereal/access.hpp>
+#include <cereal/types/vector.hpp>
+
+namespace lighthouse {
+
+// Compact structure-of-arrays storage for the keypoints of a description. Only what's used after extraction is kept:
+// position as floats, size in 1/16 px as `uint16_t` and angle in 1/256 of a full turn as `uint8_t`, 11 bytes per
+// keypoint instead of 28 of `cv::KeyPoint`. Response, octave and class id are dropped, so keypoints should be ordered
+// (see `ImageDescription`) before they get here. Coordinates are stored in separate contiguous arrays, so that
+// geometric checks can process them with vector instructions. The set can also be a view of packed arrays stored
+// elsewhere (e.g. in the memory-mapped description DB), it takes its own copy only once it's changed.
+class KeypointSet {
+public:
+  KeypointSet();
+
+  explicit KeypointSet(const std::vector<cv::KeyPoint> &aKeypoints);
+
+  // View of `aCount` keypoints packed as `WritePacked` writes them, at least 4-byte aligned. `aStorage` keeps them
+  // alive, nothing is copied.
+  KeypointSet(const uint8_t *aPacked, size_t aCount, std::shared_ptr<const void> aStorage);
+
+  // Number of keypoints.
+  size_t Size() const {
+    return mPacked != nullptr ? mPackedCount : mX.size();
+  }
+
+  bool Empty() const {
+    return Size() == 0;
+  }
+
+  // Whether the set is a view of packed keypoints stored elsewhere, they start at `GetX()` then.
+  bool IsView() const {
+    return mPacked != nullptr;
+  }
+
+  // Coordinates of all keypoints, `Size()` of each.
+  const float *GetX() const {
+    return mPacked != nullptr ? reinterpret_cast<const float *>(mPacked) : mX.data();
+  }
+
+  const float *GetY() const {
+    return mPacked != nullptr ? reinterpret_cast<const float *>(mPacked) + mPackedCount : mY.data();
+  }
+
+  cv::Point2f GetPoint(size_t aIndex) const {
+    return cv::Point2f(GetX()[aIndex], GetY()[aIndex]);
+  }
+
+  // Diameter of the keypoint neighbourhood, in pixels.
+  float GetSize(size_t aIndex) const;
+
+  // Orientation of the keypoint, in degrees within [0, 360).
+  float GetAngle(size_t aIndex) const;
+
+  // Appends keypoint `aIndex` of the other set as it's stored there, without quantizing it again.
+  void PushBack(const KeypointSet &aSet, size_t aIndex);
+
+  // Returns the first `aCount` keypoints (all if there are fewer).
+  KeypointSet Head(size_t aCount) const;
+
+  // Number of bytes the keypoints take in memory.
+  size_t GetByteSize() const;
+
+  // Converts keypoints back to `cv::KeyPoint` (response and octave are 0), e.g. for drawing.
+  cv::KeyPoint GetKeypoint(size_t aIndex) const;
+
+  std::vector<cv::KeyPoint> ToKeypoints() const;
+
+  // Writes the arrays one after another (x, y, sizes, angles), `GetPackedSize(Size())` bytes.
+  void WritePacked(std::ostream &aStream) const;
+
+  static size_t GetPackedSize(size_t aCount);
+
+private:
+  const uint16_t *GetSizes() const {
+    return mPacked != nullptr ? reinterpret_cast<const uint16_t *>(mPacked + mPackedCount * 2 * sizeof(float)) :
+        mSizes.data();
+  }
+
+  const uint8_t *GetAngles() const {
+    return mPacked != nullptr ? mPacked + mPackedCount * (2 * sizeof(float) + sizeof(uint16_t)) : mAngles.data();
+  }
+
+  // Copies viewed keypoints into the set's own arrays, so that they can be changed.
+  void Detach();
+
+  std::vector<float> mX;
+  std::vector<float> mY;
+  std::vector<uint16_t> mSizes;
+  std::vector<uint8_t> mAngles;
+
+  // Packed keypoints the set is a view of, `nullptr` if it has its own arrays.
+  const uint8_t *mPacked;
+  size_t mPackedCount;
+  std::shared_ptr<const void> mStorage;
+
+  friend class cereal::access;
+
+  // Same as the four vectors would be serialized.
+  template<class Archive>
+  void save(Archive &aArchive) const {
+    const size_t count = Size();
+    aArchive(cereal::make_size_tag((cereal::size_type) count), cereal::binary_data(GetX(), count * sizeof(float)));
+    aArchive(cereal::make_size_tag((cereal::size_type) count), cereal::binary_data(GetY(), count * sizeof(float)));
+    aArchive(cereal::make_size_tag((cereal::size_type) count),
+        cereal::binary_data(GetSizes(), count * sizeof(uint16_t)));
+    aArchive(cereal::make_size_tag((cereal::size_type) count),
+        cereal::binary_data(GetAngles(), count * sizeof(uint8_t)));
+  }
+
+  template<class Archive>
+  void load(Archive &aArchive) {
+    mPacked = nullptr;
+    mPackedCount = 0;
+    mStorage.reset();
+    aArchive(mX, mY, mSizes, mAngles);
+  }
+};
+
+} // namespace lighthouse
+
+#endif /* keypoint_set_hpp */
@@ -0,0 +1,309 @@
+//
+//  lsh_index.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+#include "candidate_collector.hpp"
+#include "file_sync.hpp"
+#include "lsh_index.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Bit positions are sampled with a fixed seed, so that indices built with the same parameters are the same.
+const uint32_t kBitSamplingSeed = 5489;
+
+// Saved index starts with "LHLS" and the format version. Indices saved before the format was versioned start with the
+// table count instead, they're rejected and rebuilt.
+const uint32_t kFormatMagic = 0x534C484C;
+const uint32_t kFormatVersion = 2;
+
+} // namespace
+
+LshIndex::LshIndex(uint32_t aTableCount, uint32_t aKeySize, uint32_t aProbeRadius)
+    : mTableCount(aTableCount), mKeySize(std::min<uint32_t>(std::max<uint32_t>(aKeySize, 1), 32)),
+      mProbeRadius(std::min(aProbeRadius, mKeySize)),
+      mMaxDistance(ComputeMaxDistance(mTableCount, mKeySize, mProbeRadius)),
+      mFlipMasks(BuildFlipMasks(mKeySize, mProbeRadius)),
+      mBitPositions(), mTables(), mKeys(), mItemIds(), mItemOffsets() {
+  // Every table samples distinct bits. `std::mt19937` output is fixed by the standard, unlike the distributions.
+  std::mt19937 generator(kBitSamplingSeed);
+  std::vector<uint16_t> positions(DescriptorArena::kDescriptorBytes * 8);
+  for (uint32_t table = 0; table < mTableCount; ++table) {
+    std::iota(positions.begin(), positions.end(), 0);
+    for (uint32_t i = 0; i < mKeySize; ++i) {
+      std::swap(positions[i], positions[i + generator() % (positions.size() - i)]);
+    }
+    mBitPositions.insert(mBitPositions.end(), positions.begin(), positions.begin() + mKeySize);
+  }
+
+  Clear();
+}
+
+void LshIndex::Sync(const DescriptorArena &aArena) {
+  // Number of leading items that are indexed exactly as they are stored in the arena.
+  uint32_t syncedItemCount = 0;
+  while (syncedItemCount < mItemIds.Size() && syncedItemCount < aArena.GetItemCount() &&
+      mItemIds[syncedItemCount] == aArena.GetItemId(syncedItemCount) &&
+      mItemOffsets[syncedItemCount + 1] == aArena.GetItemOffset(syncedItemCount + 1)) {
+    syncedItemCount++;
+  }
+
+  if (syncedItemCount < mItemIds.Size()) {
+    fprintf(stderr, "LshIndex::Sync() only %u of %lu indexed item(s) match the DB, rebuilding the index.\n",
+        syncedItemCount, mItemIds.Size());
+    Clear();
+    syncedItemCount = 0;
+  }
+
+  std::vector<uint32_t> keys(mTableCount);
+  for (uint32_t item = syncedItemCount; item < aArena.GetItemCount(); ++item) {
+    for (uint32_t descriptorIndex = aArena.GetItemOffset(item); descriptorIndex < aArena.GetItemOffset(item + 1);
+        ++descriptorIndex) {
+      const uint8_t *descriptor = aArena.GetDescriptor(descriptorIndex);
+      for (uint32_t table = 0; table < mTableCount; ++table) {
+        keys[table] = GetKey(descriptor, table);
+      }
+      AddKeys(keys.data());
+    }
+
+    mItemIds.PushBack(aArena.GetItemId(item));
+    mItemOffsets.PushBack(aArena.GetItemOffset(item + 1));
+  }
+}
+
+CandidateMatches LshIndex::KnnMatch(const DescriptorArena &aArena, const cv::Mat &aQueryDescriptors,
+    ThreadPool *aThreadPool, const std::vector<uint8_t> *aItemFilter) const {
+  if (mItemIds.Size() != aArena.GetItemCount()) {
+    throw std::invalid_argument("LSH index is out of sync with the descriptor arena!");
+  }
+
+  auto enumerate = [this](const uint8_t *aQuery, std::vector<uint32_t> &aCandidates) {
+    for (uint32_t table = 0; table < mTableCount; ++table) {
+      const AppendOnlyBuckets &buckets = mTables[table];
+      const uint32_t bucketMask = buckets.GetBucketCount() - 1;
+      const AppendOnlyVector<uint32_t> &keys = mKeys[table];
+      const uint32_t key = GetKey(aQuery, table);
+
+      for (const uint32_t flipMask : mFlipMasks) {
+        const uint32_t probedKey = key ^ flipMask;
+        buckets.ForEach(probedKey & bucketMask, [&](uint32_t aDescriptorIndex) {
+          if (keys.Empty() || keys[aDescriptorIndex] == probedKey) {
+            aCandidates.push_back(aDescriptorIndex);
+          }
+        });
+      }
+    }
+  };
+
+  return CandidateCollector::KnnMatch(aArena, aQueryDescriptors, GetMaxDistance(), enumerate, aThreadPool,
+      aItemFilter);
+}
+
+uint32_t LshIndex::GetMaxDistance() const {
+  return mMaxDistance;
+}
+
+bool LshIndex::HasParameters(uint32_t aTableCount, uint32_t aKeySize, uint32_t aProbeRadius) const {
+  // Same clamping as in the constructor.
+  const uint32_t keySize = std::min<uint32_t>(std::max<uint32_t>(aKeySize, 1), 32);
+  return mTableCount == aTableCount && mKeySize == keySize && mProbeRadius == std::min(aProbeRadius, keySize);
+}
+
+std::vector<std::string> LshIndex::GetItemIds() const {
+  return mItemIds.ToVector();
+}
+
+uint32_t LshIndex::GetKey(const uint8_t *aDescriptor, uint32_t aTable) const {
+  const uint16_t *positions = &mBitPositions[aTable * mKeySize];
+
+  uint32_t key = 0;
+  for (uint32_t i = 0; i < mKeySize; ++i) {
+    key |= (uint32_t) ((aDescriptor[positions[i] >> 3] >> (positions[i] & 7)) & 1) << i;
+  }
+
+  return key;
+}
+
+void LshIndex::AddKeys(const uint32_t *aKeys) {
+  for (uint32_t table = 0; table < mTableCount; ++table) {
+    mTables[table].Add(aKeys[table] & (mTables[table].GetBucketCount() - 1));
+    if (mKeySize > kMaxBucketBits) {
+      mKeys[table].PushBack(aKeys[table]);
+    }
+  }
+}
+
+std::vector<uint32_t> LshIndex::GetKeys(uint32_t aTable) const {
+  if (mKeySize > kMaxBucketBits) {
+    return mKeys[aTable].ToVector();
+  }
+
+  std::vector<uint32_t> keys(mTables[aTable].Size());
+  for (uint32_t bucket = 0; bucket < mTables[aTable].GetBucketCount(); ++bucket) {
+    mTables[aTable].ForEach(bucket, [&](uint32_t aDescriptorIndex) {
+      keys[aDescriptorIndex] = bucket;
+    });
+  }
+
+  return keys;
+}
+
+void LshIndex::Clear() {
+  mTables.assign(mTableCount, AppendOnlyBuckets(1u << (mKeySize < kMaxBucketBits ? mKeySize : kMaxBucketBits)));
+  mKeys.assign(mTableCount, AppendOnlyVector<uint32_t>());
+  mItemIds.Clear();
+  mItemOffsets.Clear();
+  mItemOffsets.PushBack(0);
+}
+
+/*static*/ uint32_t LshIndex::ComputeMaxDistance(uint32_t aTableCount, uint32_t aKeySize, uint32_t aProbeRadius) {
+  const uint32_t descriptorBits = DescriptorArena::kDescriptorBytes * 8;
+
+  uint32_t maxDistance = 0;
+  for (uint32_t distance = 0; distance <= descriptorBits; ++distance) {
+    // Sampled bit differs from the query's one with probability q, the key is probed if at most `aProbeRadius` of its
+    // bits differ.
+    const double q = (double) distance / descriptorBits;
+    double tableProbability = 0, combinationCount = 1;
+    for (uint32_t flippedBits = 0; flippedBits <= aProbeRadius; ++flippedBits) {
+      tableProbability += combinationCount * std::pow(q, flippedBits) * std::pow(1 - q, aKeySize - flippedBits);
+      combinationCount = combinationCount * (aKeySize - flippedBits) / (flippedBits + 1);
+    }
+
+    if (1 - std::pow(1 - tableProbability, aTableCount) < 0.5) {
+      break;
+    }
+    maxDistance = distance;
+  }
+
+  return maxDistance;
+}
+
+/*static*/ std::vector<uint32_t> LshIndex::BuildFlipMasks(uint32_t aKeySize, uint32_t aProbeRadius) {
+  // Masks with n + 1 bits set are made out of the ones with n bits set by setting a bit above the highest one, so that
+  // every combination is generated exactly once and masks come out ordered by the number of bits set.
+  std::vector<uint32_t> flipMasks(1, 0);
+  size_t levelStart = 0;
+  for (uint32_t bitCount = 1; bitCount <= aProbeRadius; ++bitCount) {
+    const size_t levelEnd = flipMasks.size();
+    for (size_t i = levelStart; i < levelEnd; ++i) {
+      const uint32_t mask = flipMasks[i];
+      for (uint32_t bit = mask == 0 ? 0 : 32 - __builtin_clz(mask); bit < aKeySize; ++bit) {
+        flipMasks.push_back(mask | (1u << bit));
+      }
+    }
+    levelStart = levelEnd;
+  }
+
+  return flipMasks;
+}
+
+/*static*/ void LshIndex::Save(const LshIndex &aIndex, const std::string &aPath) {
+  // Tables are saved as the key of every descriptor, they're linked again on load.
+  std::vector<std::vector<uint32_t>> keys;
+  for (uint32_t table = 0; table < aIndex.mTableCount; ++table) {
+    keys.push_back(aIndex.GetKeys(table));
+  }
+
+  // Written aside and then swapped in, so that a crash never leaves a torn index behind.
+  const std::string temporaryPath = aPath + ".tmp";
+  {
+    std::ofstream outputStream(temporaryPath, std::ios::binary | std::ios::trunc);
+    cereal::BinaryOutputArchive archive(outputStream);
+
+    archive(kFormatMagic, kFormatVersion);
+    archive(aIndex.mTableCount, aIndex.mKeySize, aIndex.mProbeRadius);
+    archive(aIndex.mBitPositions, keys);
+    archive(aIndex.mItemIds.ToVector(), aIndex.mItemOffsets.ToVector());
+
+    outputStream.flush();
+    if (!outputStream.good()) {
+      throw std::runtime_error("Couldn't write LSH index to " + temporaryPath + "!");
+    }
+  }
+
+  FileSync::Replace(temporaryPath, aPath);
+}
+
+/*static*/ LshIndex LshIndex::Load(const std::string &aPath) {
+  std::ifstream inputStream(aPath, std::ios::binary);
+  cereal::BinaryInputArchive archive(inputStream);
+
+  uint32_t magic = 0, version = 0;
+  archive(magic, version);
+  if (magic != kFormatMagic || version != kFormatVersion) {
+    throw cereal::Exception("LSH index has been saved in an unsupported format!");
+  }
+
+  uint32_t tableCount = 0, keySize = 0, probeRadius = 0;
+  std::vector<uint16_t> bitPositions;
+  std::vector<std::vector<uint32_t>> keys;
+  std::vector<std::string> itemIds;
+  std::vector<uint32_t> itemOffsets;
+  archive(tableCount, keySize, probeRadius);
+  archive(bitPositions, keys);
+  archive(itemIds, itemOffsets);
+
+  if (keySize == 0 || keySize > 32 || probeRadius > keySize || bitPositions.size() != tableCount * keySize ||
+      keys.size() != tableCount || itemOffsets.size() != itemIds.size() + 1 || itemOffsets[0] != 0) {
+    throw cereal::Exception("LSH index is corrupted!");
+  }
+
+  for (const uint16_t position : bitPositions) {
+    if (position >= DescriptorArena::kDescriptorBytes * 8) {
+      throw cereal::Exception("LSH index is corrupted!");
+    }
+  }
+
+  for (size_t item = 0; item < itemIds.size(); ++item) {
+    if (itemOffsets[item + 1] < itemOffsets[item]) {
+      throw cereal::Exception("LSH index is corrupted!");
+    }
+  }
+
+  for (const std::vector<uint32_t> &tableKeys : keys) {
+    if (tableKeys.size() != itemOffsets.back()) {
+      throw cereal::Exception("LSH index is corrupted!");
+    }
+    for (const uint32_t key : tableKeys) {
+      if (keySize < 32 && key >> keySize != 0) {
+        throw cereal::Exception("LSH index is corrupted!");
+      }
+    }
+  }
+
+  LshIndex index(tableCount, keySize, probeRadius);
+  index.mBitPositions = bitPositions;
+
+  std::vector<uint32_t> descriptorKeys(tableCount);
+  for (uint32_t descriptorIndex = 0; descriptorIndex < itemOffsets.back(); ++descriptorIndex) {
+    for (uint32_t table = 0; table < tableCount; ++table) {
+      descriptorKeys[table] = keys[table][descriptorIndex];
+    }
+    index.AddKeys(descriptorKeys.data());
+  }
+
+  for (size_t item = 0; item < itemIds.size(); ++item) {
+    index.mItemIds.PushBack(itemIds[item]);
+    index.mItemOffsets.PushBack(itemOffsets[item + 1]);
+  }
+
+  return index;
+}
+
+} // namespace lighthouse
@@ -0,0 +1,108 @@
+//
+//  lsh_index.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef lsh_index_hpp
+#define lsh_index_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "append_only_vector.hpp"
+#include "descriptor_arena.hpp"
+
+namespace lighthouse {
+
+// Locality-sensitive hashing over all 256-bit ORB descriptors stored in the DB (bit sampling, Indyk and Motwani, with
+// multi-probing). Every table hashes a descriptor into a key made of `aKeySize` bits sampled at fixed random positions,
+// so descriptors that are close in Hamming space likely share a key in at least one of the tables. Unlike the
+// multi-index hash nothing is guaranteed to be found, but the number of candidates per query doesn't explode with the
+// search distance. Descriptors themselves live in the `DescriptorArena`, the index stores only arena positions, and it
+// can be saved and loaded together with the list of items it has indexed, so that it doesn't have to be rebuilt.
+// Tables are append-only and shared between copies the same way the arena is, so every DB snapshot has its own copy.
+class LshIndex {
+public:
+  // Key size is clamped to [1, 32] bits, every table is probed at all keys within `aProbeRadius` bits from the query's
+  // key.
+  LshIndex(uint32_t aTableCount, uint32_t aKeySize, uint32_t aProbeRadius);
+
+  // Brings the index in line with the arena: indexes items that have been appended to the arena since the last call.
+  // If indexed items don't match the arena (e.g. the index has been loaded from disk and the DB has changed since
+  // then) the index is rebuilt from scratch.
+  void Sync(const DescriptorArena &aArena);
+
+  // For every row of `aQueryDescriptors` finds indexed descriptors that share a (probed) key with the query in any of
+  // the tables and returns k-NN lists made of the ones within `GetMaxDistance()`, same as `MultiIndexHash::KnnMatch`
+  // does (see `CandidateCollector::KnnMatch`), only here descriptors within the distance are likely rather than
+  // guaranteed to be found. Query rows are spread over the thread pool if one is given, items that have 0 in
+  // `aItemFilter` (if it's given) are skipped.
+  CandidateMatches KnnMatch(const DescriptorArena &aArena, const cv::Mat &aQueryDescriptors,
+      ThreadPool *aThreadPool = nullptr, const std::vector<uint8_t> *aItemFilter = nullptr) const;
+
+  // Max Hamming distance at which a descriptor is still more likely to be found than not.
+  uint32_t GetMaxDistance() const;
+
+  // Returns true if the index has been built with the specified parameters.
+  bool HasParameters(uint32_t aTableCount, uint32_t aKeySize, uint32_t aProbeRadius) const;
+
+  // Ids of the indexed items, in arena order.
+  std::vector<std::string> GetItemIds() const;
+
+  // Replaces the file at the path atomically and durably (see `FileSync::Replace`). Throws `std::runtime_error` if
+  // the index can't be written.
+  static void Save(const LshIndex &aIndex, const std::string &aPath);
+
+  // Throws `cereal::Exception` if the file can't be decoded, is malformed or has been saved in another format.
+  static LshIndex Load(const std::string &aPath);
+
+private:
+  // Every table has at most 2^kMaxBucketBits buckets.
+  static const uint32_t kMaxBucketBits = 16;
+
+  // Returns key of the descriptor in the specified table.
+  uint32_t GetKey(const uint8_t *aDescriptor, uint32_t aTable) const;
+
+  // Indexes the next descriptor (its index is the number of indexed descriptors) with the specified key per table.
+  void AddKeys(const uint32_t *aKeys);
+
+  // Returns keys of all indexed descriptors in the specified table, in arena order.
+  std::vector<uint32_t> GetKeys(uint32_t aTable) const;
+
+  // Drops all indexed descriptors and items.
+  void Clear();
+
+  // Returns max distance at which the probability that a descriptor shares a probed key with the query in at least one
+  // table is 1/2 or more.
+  static uint32_t ComputeMaxDistance(uint32_t aTableCount, uint32_t aKeySize, uint32_t aProbeRadius);
+
+  // Returns all key flip masks with at most `aProbeRadius` bits set, ordered by the number of bits set.
+  static std::vector<uint32_t> BuildFlipMasks(uint32_t aKeySize, uint32_t aProbeRadius);
+
+  uint32_t mTableCount;
+  uint32_t mKeySize;
+  uint32_t mProbeRadius;
+  uint32_t mMaxDistance;
+  std::vector<uint32_t> mFlipMasks;
+
+  // Sampled descriptor bit positions, `mKeySize` per table.
+  std::vector<uint16_t> mBitPositions;
+  // One table per hash function, every key has a bucket of arena descriptor indices that have it. Keys longer than
+  // `kMaxBucketBits` share buckets, their full keys are kept in `mKeys` (per table, by descriptor index) to tell them
+  // apart, shorter keys are the bucket itself.
+  std::vector<AppendOnlyBuckets> mTables;
+  std::vector<AppendOnlyVector<uint32_t>> mKeys;
+
+  // Ids of the indexed items and arena index of the first descriptor of every item (plus one past the last descriptor).
+  AppendOnlyVector<std::string> mItemIds;
+  AppendOnlyVector<uint32_t> mItemOffsets;
+};
+
+} // namespace lighthouse
+
+#endif /* lsh_index_hpp */
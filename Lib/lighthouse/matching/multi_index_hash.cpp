@@ -0,0 +1,79 @@
+//
+//  multi_index_hash.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+
+#include "candidate_collector.hpp"
+#include "multi_index_hash.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Returns 16-bit substring with the specified index.
+inline uint16_t GetSubstring(const uint8_t *aDescriptor, uint32_t aIndex) {
+  return (uint16_t) (aDescriptor[2 * aIndex] | (aDescriptor[2 * aIndex + 1] << 8));
+}
+
+} // namespace
+
+MultiIndexHash::MultiIndexHash(uint32_t aSearchRadius)
+    : mSearchRadius(std::min<uint32_t>(aSearchRadius, 16)), mFlipMasks(BuildFlipMasks(mSearchRadius)),
+      mTables(kSubstringCount, AppendOnlyBuckets(UINT16_MAX + 1)) {
+}
+
+void MultiIndexHash::Add(const DescriptorArena &aArena) {
+  // Entries of every table are arena descriptor indices, so descriptors are added in arena order.
+  for (uint32_t descriptorIndex = mTables[0].Size(); descriptorIndex < aArena.Size(); ++descriptorIndex) {
+    const uint8_t *descriptor = aArena.GetDescriptor(descriptorIndex);
+    for (uint32_t substringIndex = 0; substringIndex < kSubstringCount; ++substringIndex) {
+      mTables[substringIndex].Add(GetSubstring(descriptor, substringIndex));
+    }
+  }
+}
+
+CandidateMatches MultiIndexHash::KnnMatch(const DescriptorArena &aArena, const cv::Mat &aQueryDescriptors,
+    ThreadPool *aThreadPool, const std::vector<uint8_t> *aItemFilter) const {
+  auto enumerate = [this](const uint8_t *aQuery, std::vector<uint32_t> &aCandidates) {
+    for (uint32_t substringIndex = 0; substringIndex < kSubstringCount; ++substringIndex) {
+      const AppendOnlyBuckets &table = mTables[substringIndex];
+      const uint16_t substring = GetSubstring(aQuery, substringIndex);
+
+      for (const uint16_t flipMask : mFlipMasks) {
+        table.ForEach(substring ^ flipMask, [&aCandidates](uint32_t aDescriptorIndex) {
+          aCandidates.push_back(aDescriptorIndex);
+        });
+      }
+    }
+  };
+
+  return CandidateCollector::KnnMatch(aArena, aQueryDescriptors, GetMaxDistance(), enumerate, aThreadPool,
+      aItemFilter);
+}
+
+uint32_t MultiIndexHash::GetMaxDistance() const {
+  return kSubstringCount * (mSearchRadius + 1) - 1;
+}
+
+/*static*/ std::vector<uint16_t> MultiIndexHash::BuildFlipMasks(uint32_t aSearchRadius) {
+  std::vector<uint16_t> flipMasks;
+  for (uint32_t mask = 0; mask <= UINT16_MAX; ++mask) {
+    if ((uint32_t) __builtin_popcount(mask) <= aSearchRadius) {
+      flipMasks.push_back((uint16_t) mask);
+    }
+  }
+
+  // Probe closest buckets first.
+  std::stable_sort(flipMasks.begin(), flipMasks.end(), [](uint16_t a, uint16_t b) {
+    return __builtin_popcount(a) < __builtin_popcount(b);
+  });
+
+  return flipMasks;
+}
+
+} // namespace lighthouse
@@ -0,0 +1,64 @@
+//
+//  multi_index_hash.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef multi_index_hash_hpp
+#define multi_index_hash_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "append_only_vector.hpp"
+#include "descriptor_arena.hpp"
+
+namespace lighthouse {
+
+// Multi-index hashing (Norouzi et al.) over all 256-bit ORB descriptors stored in the DB. Every descriptor is split
+// into 16 disjoint 16-bit substrings and each substring is indexed in its own hash table. By the pigeonhole principle
+// any descriptor that is closer than 16 * (r + 1) bits to the query has at least one substring that differs from the
+// query's one by at most r bits, so probing every table within radius r finds all of them without a linear scan.
+// Descriptors themselves live in the `DescriptorArena`, the index stores only arena positions. Tables are append-only
+// and shared between copies the same way the arena is, so every DB snapshot has its own copy of the index.
+class MultiIndexHash {
+public:
+  // Number of disjoint substrings (and hash tables) every descriptor is split into.
+  static const uint32_t kSubstringCount = 16;
+
+  MultiIndexHash(uint32_t aSearchRadius);
+
+  // Indexes all arena descriptors that have been appended since the last call.
+  void Add(const DescriptorArena &aArena);
+
+  // For every row of `aQueryDescriptors` finds all indexed descriptors that are within the guaranteed search distance
+  // and returns k-NN lists made of them (see `CandidateCollector::KnnMatch`): every item that has at least one of them
+  // gets exactly the neighbours `knnMatch(..., 2)` against that item would return for the row. Rows that have no
+  // descriptor of an item within the distance get none for it and count as bad matches, while `knnMatch` could still
+  // pass them through the ratio test: that's where the index is approximate, `Benchmark::CompareWithExhaustive`
+  // measures the recall it costs. Query rows are spread over the thread pool if one is given, items that have 0 in
+  // `aItemFilter` (if it's given) are skipped.
+  CandidateMatches KnnMatch(const DescriptorArena &aArena, const cv::Mat &aQueryDescriptors,
+      ThreadPool *aThreadPool = nullptr, const std::vector<uint8_t> *aItemFilter = nullptr) const;
+
+  // Max Hamming distance within which all descriptors are guaranteed to be found.
+  uint32_t GetMaxDistance() const;
+
+private:
+  // Returns all 16-bit substring flip masks with at most `mSearchRadius` bits set, ordered by the number of bits set.
+  static std::vector<uint16_t> BuildFlipMasks(uint32_t aSearchRadius);
+
+  uint32_t mSearchRadius;
+  std::vector<uint16_t> mFlipMasks;
+
+  // One table per substring, every substring value has a bucket of arena descriptor indices that have it.
+  std::vector<AppendOnlyBuckets> mTables;
+};
+
+} // namespace lighthouse
+
+#endif /* multi_index_hash_hpp */
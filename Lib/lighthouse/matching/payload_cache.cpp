@@ -0,0 +1,243 @@
+//
+//  payload_cache.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+
+#include "description_database.hpp"
+#include "mapped_file.hpp"
+#include "payload_cache.hpp"
+
+namespace lighthouse {
+
+PayloadCache::PayloadCache(size_t aByteBudget)
+    : mByteBudget(aByteBudget), mPageSize(MappedFile::GetPageSize()), mEntries(), mEntryIndex(), mPageUseCounts(),
+      mChecksums(), mCorruptIds(), mStats(), mMutex() {
+}
+
+void PayloadCache::AddChecksums(const std::unordered_map<std::string, uint32_t> &aChecksums) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mChecksums.insert(aChecksums.begin(), aChecksums.end());
+}
+
+bool PayloadCache::Touch(const ImageDescription &aDescription) {
+  const Entry entry = GetEntry(aDescription);
+  if (entry.mDescriptors == nullptr && entry.mKeypoints == nullptr) {
+    return true;
+  }
+
+  if (!Check(aDescription, false)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  const auto entryIterator = mEntryIndex.find(entry.mId);
+  if (entryIterator != mEntryIndex.end()) {
+    mEntries.splice(mEntries.begin(), mEntries, entryIterator->second);
+    mStats.mHitCount++;
+    return true;
+  }
+
+  mStats.mMissCount++;
+  MappedFile::Prefetch(entry.mDescriptors, entry.mDescriptorBytes);
+  MappedFile::Prefetch(entry.mKeypoints, entry.mKeypointBytes);
+  mEntries.push_front(entry);
+  mEntryIndex[entry.mId] = mEntries.begin();
+  for (const uintptr_t page : GetPages(entry)) {
+    if (mPageUseCounts[page]++ == 0) {
+      mStats.mResidentBytes += mPageSize;
+    }
+  }
+
+  // The payload that has just been touched stays, even if it alone is over the budget.
+  while (mByteBudget > 0 && mStats.mResidentBytes > mByteBudget && mEntries.size() > 1) {
+    const Entry oldestEntry = mEntries.back();
+    mEntryIndex.erase(oldestEntry.mId);
+    mEntries.pop_back();
+    RemoveEntry(oldestEntry);
+    mStats.mEvictionCount++;
+  }
+
+  return true;
+}
+
+bool PayloadCache::Check(const ImageDescription &aDescription) {
+  return Check(aDescription, true);
+}
+
+bool PayloadCache::Check(const ImageDescription &aDescription, bool aReleasesPages) {
+  uint32_t checksum;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mCorruptIds.count(aDescription.GetId()) > 0) {
+      return false;
+    }
+
+    const auto checksumIterator = mChecksums.find(aDescription.GetId());
+    if (checksumIterator == mChecksums.end()) {
+      return true;
+    }
+    checksum = checksumIterator->second;
+  }
+
+  // Payload is read without holding the lock, the same payload may be checked by several threads meanwhile.
+  const bool isIntact = DescriptionDatabase::GetPayloadChecksum(aDescription) == checksum;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  // Corrupt payload is never resident.
+  if ((aReleasesPages || !isIntact) && mEntryIndex.find(aDescription.GetId()) == mEntryIndex.end()) {
+    ReleaseUnusedPages(GetEntry(aDescription));
+  }
+  mChecksums.erase(aDescription.GetId());
+  if (!isIntact && mCorruptIds.insert(aDescription.GetId()).second) {
+    mStats.mCorruptCount++;
+    fprintf(stderr, "PayloadCache::Check() payload of %s is corrupt.\n", aDescription.GetId().c_str());
+  }
+
+  return isIntact;
+}
+
+void PayloadCache::Evict(const ImageDescription &aDescription) {
+  const Entry entry = GetEntry(aDescription);
+  if (entry.mDescriptors == nullptr && entry.mKeypoints == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  const auto entryIterator = mEntryIndex.find(entry.mId);
+  if (entryIterator != mEntryIndex.end()) {
+    mEntries.erase(entryIterator->second);
+    mEntryIndex.erase(entryIterator);
+    RemoveEntry(entry);
+    mStats.mEvictionCount++;
+  } else {
+    // Payload may be resident even if the cache doesn't know of it (e.g. it has just been read to build the indexes).
+    ReleaseUnusedPages(entry);
+  }
+}
+
+void PayloadCache::Release(const ImageDescription &aDescription) {
+  const Entry entry = GetEntry(aDescription);
+  if (entry.mDescriptors == nullptr && entry.mKeypoints == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mEntryIndex.find(entry.mId) == mEntryIndex.end()) {
+    ReleaseUnusedPages(entry);
+  }
+}
+
+void PayloadCache::Clear() {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  std::vector<uintptr_t> pages;
+  pages.reserve(mPageUseCounts.size());
+  for (const auto &pageUseCount : mPageUseCounts) {
+    pages.push_back(pageUseCount.first);
+  }
+  ReleasePages(pages);
+
+  mStats.mEvictionCount += mEntries.size();
+  mStats.mResidentBytes = 0;
+  mEntries.clear();
+  mEntryIndex.clear();
+  mPageUseCounts.clear();
+}
+
+PayloadCacheStats PayloadCache::GetStats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
+
+/*static*/ PayloadCache::Entry PayloadCache::GetEntry(const ImageDescription &aDescription) {
+  Entry entry = {aDescription.GetId(), nullptr, 0, nullptr, 0};
+
+  // Only views into the memory-mapped DB can be read again, the storage is what keeps them alive.
+  if (!aDescription.GetStorage()) {
+    return entry;
+  }
+
+  const OrbDescriptorSet &descriptors = aDescription.GetDescriptorSet();
+  if (descriptors.IsView()) {
+    entry.mDescriptors = descriptors.GetData();
+    entry.mDescriptorBytes = descriptors.Size() * sizeof(OrbDescriptorSet::Row);
+  }
+
+  const KeypointSet &keypoints = aDescription.GetKeypoints();
+  if (keypoints.IsView()) {
+    entry.mKeypoints = reinterpret_cast<const uint8_t *>(keypoints.GetX());
+    entry.mKeypointBytes = KeypointSet::GetPackedSize(keypoints.Size());
+  }
+
+  return entry;
+}
+
+std::vector<uintptr_t> PayloadCache::GetPages(const Entry &aEntry) const {
+  std::vector<uintptr_t> pages;
+  const std::pair<const uint8_t *, size_t> ranges[] = {
+    std::make_pair(aEntry.mDescriptors, aEntry.mDescriptorBytes),
+    std::make_pair(aEntry.mKeypoints, aEntry.mKeypointBytes),
+  };
+  for (const auto &range : ranges) {
+    if (range.first == nullptr || range.second == 0) {
+      continue;
+    }
+
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(range.first);
+    for (uintptr_t page = begin / mPageSize * mPageSize; page < begin + range.second; page += mPageSize) {
+      pages.push_back(page);
+    }
+  }
+
+  return pages;
+}
+
+void PayloadCache::RemoveEntry(const Entry &aEntry) {
+  std::vector<uintptr_t> unusedPages;
+  for (const uintptr_t page : GetPages(aEntry)) {
+    const auto pageUseCount = mPageUseCounts.find(page);
+    if (--pageUseCount->second == 0) {
+      mPageUseCounts.erase(pageUseCount);
+      mStats.mResidentBytes -= mPageSize;
+      unusedPages.push_back(page);
+    }
+  }
+
+  ReleasePages(unusedPages);
+}
+
+void PayloadCache::ReleaseUnusedPages(const Entry &aEntry) const {
+  // Pages shared with resident payloads stay.
+  std::vector<uintptr_t> unusedPages;
+  for (const uintptr_t page : GetPages(aEntry)) {
+    if (mPageUseCounts.find(page) == mPageUseCounts.end()) {
+      unusedPages.push_back(page);
+    }
+  }
+  ReleasePages(unusedPages);
+}
+
+void PayloadCache::ReleasePages(std::vector<uintptr_t> &aPages) const {
+  // Runs of adjacent pages are dropped with a single call.
+  std::sort(aPages.begin(), aPages.end());
+  aPages.erase(std::unique(aPages.begin(), aPages.end()), aPages.end());
+  size_t first = 0;
+  while (first < aPages.size()) {
+    size_t last = first + 1;
+    while (last < aPages.size() && aPages[last] == aPages[last - 1] + mPageSize) {
+      ++last;
+    }
+
+    MappedFile::Release(reinterpret_cast<const void *>(aPages[first]), (last - first) * mPageSize);
+    first = last;
+  }
+}
+
+} // namespace lighthouse
@@ -0,0 +1,134 @@
+//
+//  payload_cache.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef payload_cache_hpp
+#define payload_cache_hpp
+
+#include <stdio.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "image_description.hpp"
+
+namespace lighthouse {
+
+// Counters of `PayloadCache`, since it has been created.
+struct PayloadCacheStats {
+  // Payloads that were resident when they were needed for one to one matching, and the ones that had to be read from
+  // disk. Checks and other reads outside the cache aren't counted.
+  uint64_t mHitCount;
+  uint64_t mMissCount;
+  // Payloads dropped from memory to stay within the budget or because memory was needed elsewhere.
+  uint64_t mEvictionCount;
+  // Bytes of the pages the resident payloads are on. Pages are whole, so with payloads that don't start and end at page
+  // boundaries they include bits of the neighbouring items.
+  size_t mResidentBytes;
+  // Payloads that didn't match their checksums.
+  uint64_t mCorruptCount;
+
+  // Fraction of the payloads that were resident when they were needed, 0 if none was needed yet.
+  float GetHitRate() const {
+    return mHitCount + mMissCount > 0 ? (float) mHitCount / (mHitCount + mMissCount) : 0;
+  }
+};
+
+// Keeps the heavy part of the DB items, their keypoints and descriptors (payload), in memory only while they're in use
+// for one to one matching (`ImageMatcher::Match`, geometric verification). Candidates are selected by the DB's own
+// indexes (descriptor arena, inverted file, histograms), which have their own resident copies of what they need, so
+// that's the only use the payloads are kept resident for. Payloads of the items loaded from the memory-mapped
+// description DB are read from disk the first time they're touched and then kept in least recently used order, the
+// oldest ones are dropped once the pages they're on exceed the budget. Pages are counted by the payloads on them, so
+// dropping a payload drops only the pages no other resident payload is on. Descriptions that own their payload (e.g.
+// the ones recorded since the DB has been loaded) aren't managed.
+//
+// The budget covers the resident payloads only. Payloads that are read once outside of one to one matching (checked,
+// indexed, saved) don't count towards it, their pages are dropped (see `Release`) right after the read instead, so
+// they stay resident only as long as that read takes.
+//
+// Payloads aren't checked when the DB is loaded, the cache checks every one against its checksum (see
+// `DescriptionDatabase::GetPayloadChecksum`) the first time it's touched or checked. Payload that doesn't match is
+// corrupt, it's never resident and its item should be neither matched nor saved again. Thread-safe.
+class PayloadCache {
+public:
+  // Budget is in bytes, 0 means there is no limit.
+  explicit PayloadCache(size_t aByteBudget);
+
+  // Payloads of the items with the specified ids are checked against the checksums the first time they're touched.
+  void AddChecksums(const std::unordered_map<std::string, uint32_t> &aChecksums);
+
+  // Marks the payload of the description as used, reading it ahead if it isn't resident. Returns false if the payload
+  // is corrupt.
+  bool Touch(const ImageDescription &aDescription);
+
+  // Checks the payload of the description against its checksum unless it has been checked already, without making it
+  // resident: pages read for the check are released. Returns false if the payload is corrupt.
+  bool Check(const ImageDescription &aDescription);
+
+  // Drops the payload of the description from memory, e.g. once it has been indexed.
+  void Evict(const ImageDescription &aDescription);
+
+  // Drops the pages of the payload no resident payload is on, e.g. once it has been read outside of the cache. The
+  // payload stays resident if it is.
+  void Release(const ImageDescription &aDescription);
+
+  // Drops all resident payloads from memory, e.g. when the system is low on memory. Together with the payloads read
+  // outside of the cache, which are released right away, that's every payload page the matcher has read.
+  void Clear();
+
+  PayloadCacheStats GetStats() const;
+
+private:
+  struct Entry {
+    std::string mId;
+    const uint8_t *mDescriptors;
+    size_t mDescriptorBytes;
+    const uint8_t *mKeypoints;
+    size_t mKeypointBytes;
+  };
+
+  // `Check` that releases the pages read for the check (unless the payload is resident) only if `aReleasesPages` is
+  // true or the payload is corrupt, `Touch` keeps the ones it's about to make resident.
+  bool Check(const ImageDescription &aDescription, bool aReleasesPages);
+
+  // Payload of the description, empty if the description owns its payload.
+  static Entry GetEntry(const ImageDescription &aDescription);
+
+  // Addresses of the pages the entry's payload is on.
+  std::vector<uintptr_t> GetPages(const Entry &aEntry) const;
+
+  // Takes the entry (already removed from the list) off its pages and drops the pages no resident payload is on.
+  void RemoveEntry(const Entry &aEntry);
+
+  // Drops the pages of the entry (not a resident one) no resident payload is on. Must be called with the lock held.
+  void ReleaseUnusedPages(const Entry &aEntry) const;
+
+  // Drops the pages from memory, the list is sorted meanwhile.
+  void ReleasePages(std::vector<uintptr_t> &aPages) const;
+
+  size_t mByteBudget;
+  size_t mPageSize;
+
+  // Resident payloads, the most recently used first.
+  std::list<Entry> mEntries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> mEntryIndex;
+  // Number of resident payloads on every page they're on, by page address.
+  std::unordered_map<uintptr_t, uint32_t> mPageUseCounts;
+  // Checksums of the payloads that haven't been checked yet and ids of the ones that didn't match.
+  std::unordered_map<std::string, uint32_t> mChecksums;
+  std::unordered_set<std::string> mCorruptIds;
+  PayloadCacheStats mStats;
+  mutable std::mutex mMutex;
+};
+
+} // namespace lighthouse
+
+#endif /* payload_cache_hpp */
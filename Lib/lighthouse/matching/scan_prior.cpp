@@ -0,0 +1,58 @@
+//
+//  scan_prior.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "scan_prior.hpp"
+
+namespace lighthouse {
+
+RecentMatchesPrior::RecentMatchesPrior(uint32_t aCapacity) : mCapacity(aCapacity), mRecentIds(), mMutex() {
+}
+
+void RecentMatchesPrior::Order(std::vector<std::string> &aItemIds) const {
+  std::unordered_map<std::string, size_t> recencyRanks;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (size_t rank = 0; rank < mRecentIds.size(); ++rank) {
+      recencyRanks.insert(std::make_pair(mRecentIds[rank], rank));
+    }
+  }
+
+  if (recencyRanks.empty()) {
+    return;
+  }
+
+  // Items that haven't been matched recently rank after all the ones that have.
+  const size_t unrankedRank = recencyRanks.size();
+  auto getRank = [&recencyRanks, unrankedRank](const std::string &aItemId) {
+    const auto rank = recencyRanks.find(aItemId);
+    return rank != recencyRanks.end() ? rank->second : unrankedRank;
+  };
+
+  std::stable_sort(aItemIds.begin(), aItemIds.end(), [&getRank](const std::string &a, const std::string &b) {
+    return getRank(a) < getRank(b);
+  });
+}
+
+void RecentMatchesPrior::OnMatched(const std::string &aItemId) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  const auto previous = std::find(mRecentIds.begin(), mRecentIds.end(), aItemId);
+  if (previous != mRecentIds.end()) {
+    mRecentIds.erase(previous);
+  }
+
+  mRecentIds.push_front(aItemId);
+  if (mRecentIds.size() > mCapacity) {
+    mRecentIds.pop_back();
+  }
+}
+
+} // namespace lighthouse
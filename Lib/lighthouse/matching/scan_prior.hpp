@@ -0,0 +1,54 @@
+//
+//  scan_prior.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef scan_prior_hpp
+#define scan_prior_hpp
+
+#include <stdio.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lighthouse {
+
+// Decides in which order `ImageMatcher::FindTopMatches` visits candidates. The earlier the true match is visited, the
+// sooner the scan can stop, so priors put the items that are most likely to be looked at first. Priors are shared
+// between queries that may run concurrently, so implementations must be thread-safe.
+class ScanPrior {
+public:
+  virtual ~ScanPrior() {}
+
+  // Reorders candidate ids, most likely match first.
+  virtual void Order(std::vector<std::string> &aItemIds) const = 0;
+
+  // Notifies prior that the item has been the best match of a query.
+  virtual void OnMatched(const std::string &aItemId) = 0;
+};
+
+// Visits the most recently matched items first (the user tends to come back to the same few objects), the rest keep
+// their original order.
+class RecentMatchesPrior : public ScanPrior {
+public:
+  // Remembers up to `aCapacity` last matched items.
+  explicit RecentMatchesPrior(uint32_t aCapacity);
+
+  void Order(std::vector<std::string> &aItemIds) const override;
+
+  void OnMatched(const std::string &aItemId) override;
+
+private:
+  uint32_t mCapacity;
+  // Ids of the last matched items, the most recent first.
+  std::deque<std::string> mRecentIds;
+  mutable std::mutex mMutex;
+};
+
+} // namespace lighthouse
+
+#endif /* scan_prior_hpp */
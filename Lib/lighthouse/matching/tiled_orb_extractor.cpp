@@ -0,0 +1,330 @@
+//
+//  tiled_orb_extractor.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <set>
+#include <tuple>
+
+#include "tiled_orb_extractor.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Every tile extracts this many times its even share of the budget, so that there is something to give to the cells
+// whose neighbours don't use up their shares.
+const uint32_t kOversampling = 2;
+
+} // namespace
+
+TiledOrbExtractor::TiledOrbExtractor(const cv::Ptr<cv::ORB> &aDetector, uint32_t aGridSize)
+    : mDetector(aDetector), mGridSize(aGridSize),
+      mMargin((int) std::ceil(std::max(aDetector->getEdgeThreshold(), aDetector->getPatchSize()) *
+          std::pow(aDetector->getScaleFactor(), aDetector->getNLevels() - 1)) + 1) {
+}
+
+void TiledOrbExtractor::DetectAndCompute(const cv::Mat &aImage, const cv::Mat &aMask,
+    std::vector<cv::KeyPoint> &aKeypoints, cv::Mat &aDescriptors, ThreadPool *aThreadPool) const {
+  if (!IsTiled(aImage.size())) {
+    mDetector->detectAndCompute(aImage, aMask, aKeypoints, aDescriptors);
+    return;
+  }
+
+  std::vector<Tile> tiles;
+  const std::vector<std::pair<uint32_t, uint32_t>> selected = ExtractTiles(aImage, aMask, true, tiles, aThreadPool);
+
+  aKeypoints.clear();
+  aDescriptors.release();
+  if (selected.empty()) {
+    return;
+  }
+
+  aKeypoints.reserve(selected.size());
+  aDescriptors.create(selected.size(), mDetector->descriptorSize(), CV_8U);
+  for (const auto &keypoint : selected) {
+    const Tile &tile = tiles[keypoint.first];
+    memcpy(aDescriptors.ptr<uint8_t>(aKeypoints.size()), tile.mDescriptors.ptr<uint8_t>(keypoint.second),
+        aDescriptors.cols);
+    aKeypoints.push_back(tile.mKeypoints[keypoint.second]);
+  }
+}
+
+void TiledOrbExtractor::Detect(const cv::Mat &aImage, const cv::Mat &aMask, std::vector<cv::KeyPoint> &aKeypoints,
+    ThreadPool *aThreadPool) const {
+  aKeypoints.clear();
+  if (!IsTiled(aImage.size())) {
+    mDetector->detect(aImage, aKeypoints, aMask);
+    std::stable_sort(aKeypoints.begin(), aKeypoints.end(), [](const cv::KeyPoint &aFirst, const cv::KeyPoint &aSecond) {
+      return aFirst.response > aSecond.response;
+    });
+    return;
+  }
+
+  std::vector<Tile> tiles;
+  for (const auto &keypoint : ExtractTiles(aImage, aMask, false, tiles, aThreadPool)) {
+    aKeypoints.push_back(tiles[keypoint.first].mKeypoints[keypoint.second]);
+  }
+}
+
+void TiledOrbExtractor::Compute(const cv::Mat &aImage, std::vector<cv::KeyPoint> &aKeypoints, cv::Mat &aDescriptors,
+    ThreadPool *aThreadPool) const {
+  if (!IsTiled(aImage.size())) {
+    mDetector->compute(aImage, aKeypoints, aDescriptors);
+    return;
+  }
+
+  // Every keypoint is computed in the tile of the cell it's in.
+  std::vector<Tile> tiles = GetTiles(aImage.size());
+  std::vector<std::vector<uint32_t>> tileKeypoints(tiles.size());
+  for (uint32_t keypoint = 0; keypoint < aKeypoints.size(); ++keypoint) {
+    const cv::Point2f &point = aKeypoints[keypoint].pt;
+    for (size_t tile = 0; tile < tiles.size(); ++tile) {
+      const cv::Rect &cell = tiles[tile].mCell;
+      if (point.x < cell.x + cell.width && point.y < cell.y + cell.height) {
+        tileKeypoints[tile].push_back(keypoint);
+        break;
+      }
+    }
+  }
+
+  // Row of every keypoint's descriptor in its tile's descriptors, -1 if ORB couldn't compute it.
+  std::vector<int> rows(aKeypoints.size(), -1);
+  std::vector<uint32_t> tileIndices(aKeypoints.size(), 0);
+  auto computeTiles = [&](size_t aBegin, size_t aEnd) {
+    for (size_t tileIndex = aBegin; tileIndex < aEnd; ++tileIndex) {
+      Tile &tile = tiles[tileIndex];
+      if (tileKeypoints[tileIndex].empty()) {
+        continue;
+      }
+
+      // ORB drops keypoints it can't compute descriptors for and, unless the rest are sorted by octave, regroups them
+      // by octave, so every keypoint carries its index in the tile's list to be matched back by.
+      for (uint32_t i = 0; i < tileKeypoints[tileIndex].size(); ++i) {
+        cv::KeyPoint tileKeypoint = aKeypoints[tileKeypoints[tileIndex][i]];
+        tileKeypoint.pt.x -= tile.mRect.x;
+        tileKeypoint.pt.y -= tile.mRect.y;
+        tileKeypoint.class_id = (int) i;
+        tile.mKeypoints.push_back(tileKeypoint);
+      }
+
+      CreateDetector(mDetector->getMaxFeatures())->compute(aImage(tile.mRect), tile.mKeypoints, tile.mDescriptors);
+
+      for (size_t row = 0; row < tile.mKeypoints.size(); ++row) {
+        const uint32_t keypoint = tileKeypoints[tileIndex][tile.mKeypoints[row].class_id];
+        rows[keypoint] = (int) row;
+        tileIndices[keypoint] = tileIndex;
+      }
+    }
+  };
+
+  if (aThreadPool != nullptr) {
+    aThreadPool->ParallelFor(tiles.size(), 1, computeTiles);
+  } else {
+    computeTiles(0, tiles.size());
+  }
+
+  const size_t computedCount = rows.size() - std::count(rows.begin(), rows.end(), -1);
+  std::vector<cv::KeyPoint> keypoints;
+  keypoints.reserve(computedCount);
+  aDescriptors.release();
+  if (computedCount > 0) {
+    aDescriptors.create(computedCount, mDetector->descriptorSize(), CV_8U);
+  }
+
+  for (size_t keypoint = 0; keypoint < aKeypoints.size(); ++keypoint) {
+    if (rows[keypoint] < 0) {
+      continue;
+    }
+
+    memcpy(aDescriptors.ptr<uint8_t>(keypoints.size()),
+        tiles[tileIndices[keypoint]].mDescriptors.ptr<uint8_t>(rows[keypoint]), aDescriptors.cols);
+    keypoints.push_back(aKeypoints[keypoint]);
+  }
+  aKeypoints.swap(keypoints);
+}
+
+bool TiledOrbExtractor::IsTiled(const cv::Size &aSize) const {
+  const int gridSize = (int) mGridSize;
+  return gridSize > 1 && aSize.width / gridSize >= mMargin && aSize.height / gridSize >= mMargin;
+}
+
+std::vector<TiledOrbExtractor::Tile> TiledOrbExtractor::GetTiles(const cv::Size &aSize) const {
+  const int gridSize = (int) mGridSize;
+  std::vector<Tile> tiles(gridSize * gridSize);
+  for (int row = 0; row < gridSize; ++row) {
+    for (int col = 0; col < gridSize; ++col) {
+      Tile &tile = tiles[row * gridSize + col];
+      const int top = aSize.height * row / gridSize, left = aSize.width * col / gridSize;
+      tile.mCell = cv::Rect(left, top, aSize.width * (col + 1) / gridSize - left,
+          aSize.height * (row + 1) / gridSize - top);
+
+      const int tileLeft = std::max(left - mMargin, 0), tileTop = std::max(top - mMargin, 0);
+      tile.mRect = cv::Rect(tileLeft, tileTop,
+          std::min(tile.mCell.x + tile.mCell.width + mMargin, aSize.width) - tileLeft,
+          std::min(tile.mCell.y + tile.mCell.height + mMargin, aSize.height) - tileTop);
+    }
+  }
+
+  return tiles;
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> TiledOrbExtractor::ExtractTiles(const cv::Mat &aImage,
+    const cv::Mat &aMask, bool aComputeDescriptors, std::vector<Tile> &aTiles, ThreadPool *aThreadPool) const {
+  // Nothing to extract from cells that are masked out completely.
+  aTiles.clear();
+  for (const Tile &tile : GetTiles(aImage.size())) {
+    if (aMask.empty() || cv::countNonZero(aMask(tile.mCell)) > 0) {
+      aTiles.push_back(tile);
+    }
+  }
+
+  if (aTiles.empty()) {
+    return std::vector<std::pair<uint32_t, uint32_t>>();
+  }
+
+  const uint32_t featureCount = (uint32_t) mDetector->getMaxFeatures();
+  const uint32_t tileFeatureCount = kOversampling * ((featureCount + aTiles.size() - 1) / aTiles.size());
+  auto extractTiles = [&](size_t aBegin, size_t aEnd) {
+    for (size_t tile = aBegin; tile < aEnd; ++tile) {
+      ExtractTile(aImage, aMask, tileFeatureCount, aComputeDescriptors, aTiles[tile]);
+    }
+  };
+
+  if (aThreadPool != nullptr) {
+    aThreadPool->ParallelFor(aTiles.size(), 1, extractTiles);
+  } else {
+    extractTiles(0, aTiles.size());
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> candidates;
+  for (uint32_t tile = 0; tile < aTiles.size(); ++tile) {
+    for (uint32_t keypoint = 0; keypoint < aTiles[tile].mKeypoints.size(); ++keypoint) {
+      candidates.push_back(std::make_pair(tile, keypoint));
+    }
+  }
+
+  auto isStronger = [&](const std::pair<uint32_t, uint32_t> &aFirst, const std::pair<uint32_t, uint32_t> &aSecond) {
+    return aTiles[aFirst.first].mKeypoints[aFirst.second].response >
+        aTiles[aSecond.first].mKeypoints[aSecond.second].response;
+  };
+  std::stable_sort(candidates.begin(), candidates.end(), isStronger);
+
+  // Keypoints right at the cell borders can be found by both neighbours with slightly different coordinates, the
+  // strongest one of every octave at the same (rounded) position is kept.
+  std::set<std::tuple<int, long, long>> positions;
+  std::vector<std::vector<uint32_t>> tileCandidates(aTiles.size());
+  for (const auto &candidate : candidates) {
+    const cv::KeyPoint &keypoint = aTiles[candidate.first].mKeypoints[candidate.second];
+    if (positions.insert(std::make_tuple(keypoint.octave, std::lround(keypoint.pt.x), std::lround(keypoint.pt.y)))
+        .second) {
+      tileCandidates[candidate.first].push_back(candidate.second);
+    }
+  }
+
+  std::vector<uint32_t> keypointCounts(aTiles.size());
+  for (size_t tile = 0; tile < aTiles.size(); ++tile) {
+    keypointCounts[tile] = tileCandidates[tile].size();
+  }
+  const std::vector<uint32_t> budgets = SplitBudget(keypointCounts, featureCount);
+
+  // Candidates of every tile are ordered by response, so the budget takes the strongest ones.
+  std::vector<std::pair<uint32_t, uint32_t>> selected;
+  for (uint32_t tile = 0; tile < aTiles.size(); ++tile) {
+    for (uint32_t i = 0; i < budgets[tile]; ++i) {
+      selected.push_back(std::make_pair(tile, tileCandidates[tile][i]));
+    }
+  }
+  std::stable_sort(selected.begin(), selected.end(), isStronger);
+
+  return selected;
+}
+
+void TiledOrbExtractor::ExtractTile(const cv::Mat &aImage, const cv::Mat &aMask, uint32_t aFeatureCount,
+    bool aComputeDescriptors, Tile &aTile) const {
+  // Margins only give keypoints of the cell their patches, keypoints are detected within the cell only, otherwise
+  // strong keypoints of the neighbours would eat up the budget.
+  const cv::Rect cell(aTile.mCell.x - aTile.mRect.x, aTile.mCell.y - aTile.mRect.y, aTile.mCell.width,
+      aTile.mCell.height);
+  cv::Mat mask(aTile.mRect.height, aTile.mRect.width, CV_8U, cv::Scalar(0));
+  cv::Mat cellMask = mask(cell);
+  if (aMask.empty()) {
+    cellMask.setTo(cv::Scalar(255));
+  } else {
+    aMask(aTile.mCell).copyTo(cellMask);
+  }
+
+  std::vector<cv::KeyPoint> keypoints;
+  cv::Mat descriptors;
+  if (aComputeDescriptors) {
+    CreateDetector(aFeatureCount)->detectAndCompute(aImage(aTile.mRect), mask, keypoints, descriptors);
+  } else {
+    CreateDetector(aFeatureCount)->detect(aImage(aTile.mRect), keypoints, mask);
+  }
+
+  // Keypoints of coarser levels may still land just outside of the cell once scaled back, those are dropped.
+  const float left = (float) aTile.mCell.x, right = (float) (aTile.mCell.x + aTile.mCell.width);
+  const float top = (float) aTile.mCell.y, bottom = (float) (aTile.mCell.y + aTile.mCell.height);
+  aTile.mKeypoints.clear();
+  if (aComputeDescriptors) {
+    aTile.mDescriptors.create(keypoints.size(), descriptors.cols, CV_8U);
+  }
+
+  for (size_t i = 0; i < keypoints.size(); ++i) {
+    cv::KeyPoint keypoint = keypoints[i];
+    keypoint.pt.x += aTile.mRect.x;
+    keypoint.pt.y += aTile.mRect.y;
+    if (keypoint.pt.x < left || keypoint.pt.x >= right || keypoint.pt.y < top || keypoint.pt.y >= bottom) {
+      continue;
+    }
+
+    if (aComputeDescriptors) {
+      memcpy(aTile.mDescriptors.ptr<uint8_t>(aTile.mKeypoints.size()), descriptors.ptr<uint8_t>(i),
+          descriptors.cols);
+    }
+    aTile.mKeypoints.push_back(keypoint);
+  }
+}
+
+cv::Ptr<cv::ORB> TiledOrbExtractor::CreateDetector(uint32_t aFeatureCount) const {
+  return cv::ORB::create(aFeatureCount, mDetector->getScaleFactor(), mDetector->getNLevels(),
+      mDetector->getEdgeThreshold(), mDetector->getFirstLevel(), mDetector->getWTA_K(), mDetector->getScoreType(),
+      mDetector->getPatchSize(), mDetector->getFastThreshold());
+}
+
+/*static*/ std::vector<uint32_t> TiledOrbExtractor::SplitBudget(const std::vector<uint32_t> &aKeypointCounts,
+    uint32_t aBudget) {
+  std::vector<uint32_t> budgets(aKeypointCounts.size(), 0);
+  std::vector<size_t> hungryCells;
+  for (size_t cell = 0; cell < aKeypointCounts.size(); ++cell) {
+    if (aKeypointCounts[cell] > 0) {
+      hungryCells.push_back(cell);
+    }
+  }
+
+  while (aBudget > 0 && !hungryCells.empty()) {
+    const uint32_t share = std::max<uint32_t>(aBudget / hungryCells.size(), 1);
+    std::vector<size_t> stillHungryCells;
+    for (size_t cell : hungryCells) {
+      const uint32_t extra = std::min(std::min(share, aKeypointCounts[cell] - budgets[cell]), aBudget);
+      budgets[cell] += extra;
+      aBudget -= extra;
+
+      if (budgets[cell] < aKeypointCounts[cell]) {
+        stillHungryCells.push_back(cell);
+      }
+    }
+    hungryCells.swap(stillHungryCells);
+  }
+
+  return budgets;
+}
+
+} // namespace lighthouse
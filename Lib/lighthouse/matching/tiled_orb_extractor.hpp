@@ -0,0 +1,88 @@
+//
+//  tiled_orb_extractor.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef tiled_orb_extractor_hpp
+#define tiled_orb_extractor_hpp
+
+#include <stdio.h>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <opencv2/features2d.hpp>
+
+#include "thread_pool.hpp"
+
+namespace lighthouse {
+
+// Runs ORB over a grid of overlapping tiles in parallel instead of over the whole image at once. Every tile is extended
+// by a margin wide enough for the whole pyramid (edge threshold at the coarsest level), so keypoints in the tile's own
+// cell get exactly the patches they would get in the full image, but keypoints are detected only within the cell, the
+// margins belong to the neighbours. Cells share the feature budget: every cell gets an even share of it, the share of
+// cells that don't have enough keypoints (e.g. masked out background) goes to the others, and within a cell the
+// strongest keypoints win. That spreads keypoints more evenly over the image than a single global budget would.
+class TiledOrbExtractor {
+public:
+  // Tiles are extracted with the parameters of `aDetector`, `aGridSize` tiles per side. With 1 tile per side (or an
+  // image too small to be split) `aDetector` runs on the whole image.
+  TiledOrbExtractor(const cv::Ptr<cv::ORB> &aDetector, uint32_t aGridSize);
+
+  // Same as `cv::Feature2D::detectAndCompute`, tiles are spread over the thread pool if one is given.
+  void DetectAndCompute(const cv::Mat &aImage, const cv::Mat &aMask, std::vector<cv::KeyPoint> &aKeypoints,
+      cv::Mat &aDescriptors, ThreadPool *aThreadPool = nullptr) const;
+
+  // Detects the same keypoints `DetectAndCompute` would, strongest first, without computing their descriptors.
+  void Detect(const cv::Mat &aImage, const cv::Mat &aMask, std::vector<cv::KeyPoint> &aKeypoints,
+      ThreadPool *aThreadPool = nullptr) const;
+
+  // Computes descriptors of the keypoints found by `Detect`, any subset of them in any order (e.g. the strongest ones
+  // first and the rest later), and gives the same descriptors `DetectAndCompute` would. Same as
+  // `cv::Feature2D::compute`, keypoints that don't get a descriptor are removed.
+  void Compute(const cv::Mat &aImage, std::vector<cv::KeyPoint> &aKeypoints, cv::Mat &aDescriptors,
+      ThreadPool *aThreadPool = nullptr) const;
+
+private:
+  // Grid cell and the tile (cell with margins, clipped to the image) it's extracted from.
+  struct Tile {
+    cv::Rect mCell;
+    cv::Rect mRect;
+    std::vector<cv::KeyPoint> mKeypoints;
+    cv::Mat mDescriptors;
+  };
+
+  // Returns true if images of that size are split into tiles.
+  bool IsTiled(const cv::Size &aSize) const;
+
+  // Returns tiles of all grid cells, row by row.
+  std::vector<Tile> GetTiles(const cv::Size &aSize) const;
+
+  // Extracts features from the tiles of all cells that aren't masked out completely and selects the ones within the
+  // budget. Returns (index in `aTiles`, index in the tile's keypoints) pairs, strongest keypoint first.
+  std::vector<std::pair<uint32_t, uint32_t>> ExtractTiles(const cv::Mat &aImage, const cv::Mat &aMask,
+      bool aComputeDescriptors, std::vector<Tile> &aTiles, ThreadPool *aThreadPool) const;
+
+  // Extracts up to `aFeatureCount` features within the tile's cell, keypoints are in image coordinates.
+  void ExtractTile(const cv::Mat &aImage, const cv::Mat &aMask, uint32_t aFeatureCount, bool aComputeDescriptors,
+      Tile &aTile) const;
+
+  // Creates ORB with the same parameters as `mDetector`, but the feature count. Detectors aren't shared between
+  // threads.
+  cv::Ptr<cv::ORB> CreateDetector(uint32_t aFeatureCount) const;
+
+  // Splits `aBudget` between cells that have the specified numbers of keypoints: evenly, but no cell gets more than
+  // it has and whatever is left goes to the cells that still have keypoints.
+  static std::vector<uint32_t> SplitBudget(const std::vector<uint32_t> &aKeypointCounts, uint32_t aBudget);
+
+  cv::Ptr<cv::ORB> mDetector;
+  uint32_t mGridSize;
+  // Margin tiles extend their cells by, in pixels.
+  int mMargin;
+};
+
+} // namespace lighthouse
+
+#endif /* tiled_orb_extractor_hpp */
@@ -0,0 +1,313 @@
+//
+//  vocabulary.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+
+#include <cereal/archives/binary.hpp>
+
+#include "file_sync.hpp"
+#include "hamming.hpp"
+#include "vocabulary.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Number of bytes in the only descriptor type we support (ORB).
+const uint32_t kDescriptorBytes = 32;
+
+// Max number of k-majority iterations per node.
+const uint32_t kMaxClusteringIterations = 10;
+
+} // namespace
+
+Vocabulary::Vocabulary()
+    : mBranchingFactor(0), mDepth(0), mCentroids(), mFirstChild(), mChildCount(), mWordIds(), mWeights() {
+}
+
+/*static*/ Vocabulary Vocabulary::Train(const std::vector<cv::Mat> &aImageDescriptors, uint32_t aBranchingFactor,
+    uint32_t aDepth) {
+  if (aBranchingFactor < 2 || aDepth == 0) {
+    throw std::invalid_argument("Vocabulary tree should have at least two branches and one level!");
+  }
+
+  Vocabulary vocabulary;
+  vocabulary.mBranchingFactor = aBranchingFactor;
+  vocabulary.mDepth = aDepth;
+
+  cv::Mat descriptors;
+  for (const cv::Mat &imageDescriptors : aImageDescriptors) {
+    if (imageDescriptors.empty()) {
+      continue;
+    }
+
+    if (imageDescriptors.type() != CV_8U || imageDescriptors.cols != kDescriptorBytes) {
+      throw std::invalid_argument("Vocabulary can only be trained on 32-byte binary descriptors!");
+    }
+
+    descriptors.push_back(imageDescriptors);
+  }
+
+  if (descriptors.empty()) {
+    return vocabulary;
+  }
+
+  std::vector<uint32_t> rows(descriptors.rows);
+  std::iota(rows.begin(), rows.end(), 0);
+
+  // Root node doesn't need a centroid, but we keep it to have the same layout for all nodes.
+  vocabulary.mCentroids.assign(kDescriptorBytes, 0);
+  vocabulary.mFirstChild.push_back(0);
+  vocabulary.mChildCount.push_back(0);
+  vocabulary.mWordIds.push_back(-1);
+  vocabulary.Cluster(descriptors, rows, 0, 0);
+
+  // Weight words with their inverse document frequency: words that appear in every image aren't discriminative.
+  std::vector<uint32_t> documentFrequencies(vocabulary.mWeights.size(), 0);
+  uint32_t imageCount = 0;
+  for (const cv::Mat &imageDescriptors : aImageDescriptors) {
+    if (imageDescriptors.empty()) {
+      continue;
+    }
+
+    std::set<uint32_t> imageWords;
+    for (int row = 0; row < imageDescriptors.rows; ++row) {
+      imageWords.insert(vocabulary.mWordIds[vocabulary.GetLeaf(imageDescriptors.ptr<uint8_t>(row))]);
+    }
+
+    for (const uint32_t word : imageWords) {
+      documentFrequencies[word]++;
+    }
+    imageCount++;
+  }
+
+  for (size_t word = 0; word < vocabulary.mWeights.size(); ++word) {
+    vocabulary.mWeights[word] = documentFrequencies[word] > 0 ?
+        (float) std::log((double) imageCount / documentFrequencies[word]) : 0;
+  }
+
+  fprintf(stderr, "Vocabulary::Train() built %u words out of %i descriptors from %u images.\n",
+      vocabulary.GetWordCount(), descriptors.rows, imageCount);
+
+  return vocabulary;
+}
+
+void Vocabulary::Cluster(const cv::Mat &aDescriptors, const std::vector<uint32_t> &aRows, uint32_t aNode,
+    uint32_t aLevel) {
+  if (aLevel == mDepth || aRows.size() <= mBranchingFactor) {
+    mWordIds[aNode] = mWeights.size();
+    mWeights.push_back(0);
+    return;
+  }
+
+  // Seed centroids with evenly spaced members so that training is deterministic.
+  std::vector<uint8_t> centroids(mBranchingFactor * kDescriptorBytes);
+  for (uint32_t cluster = 0; cluster < mBranchingFactor; ++cluster) {
+    const uint8_t *seed = aDescriptors.ptr<uint8_t>(aRows[cluster * aRows.size() / mBranchingFactor]);
+    std::copy(seed, seed + kDescriptorBytes, centroids.begin() + cluster * kDescriptorBytes);
+  }
+
+  std::vector<uint32_t> assignments(aRows.size(), mBranchingFactor);
+  for (uint32_t iteration = 0; iteration < kMaxClusteringIterations; ++iteration) {
+    bool isChanged = false;
+    for (size_t i = 0; i < aRows.size(); ++i) {
+      const uint8_t *descriptor = aDescriptors.ptr<uint8_t>(aRows[i]);
+
+      HammingTop2 top2;
+      HammingMatcher<kDescriptorBytes>::FindTop2(descriptor, &centroids[0], mBranchingFactor, kDescriptorBytes, top2);
+      const uint32_t bestCluster = top2.mIndices[0];
+
+      isChanged |= assignments[i] != bestCluster;
+      assignments[i] = bestCluster;
+    }
+
+    if (!isChanged) {
+      break;
+    }
+
+    // Every centroid bit is set if it's set in the majority of cluster members.
+    std::vector<uint32_t> bitCounts(mBranchingFactor * kDescriptorBytes * 8, 0);
+    std::vector<uint32_t> clusterSizes(mBranchingFactor, 0);
+    for (size_t i = 0; i < aRows.size(); ++i) {
+      const uint8_t *descriptor = aDescriptors.ptr<uint8_t>(aRows[i]);
+      uint32_t *clusterBitCounts = &bitCounts[assignments[i] * kDescriptorBytes * 8];
+      for (uint32_t bit = 0; bit < kDescriptorBytes * 8; ++bit) {
+        clusterBitCounts[bit] += (descriptor[bit / 8] >> (bit % 8)) & 1;
+      }
+      clusterSizes[assignments[i]]++;
+    }
+
+    for (uint32_t cluster = 0; cluster < mBranchingFactor; ++cluster) {
+      // Keep the previous centroid for the empty clusters.
+      if (clusterSizes[cluster] == 0) {
+        continue;
+      }
+
+      uint8_t *centroid = &centroids[cluster * kDescriptorBytes];
+      const uint32_t *clusterBitCounts = &bitCounts[cluster * kDescriptorBytes * 8];
+      memset(centroid, 0, kDescriptorBytes);
+      for (uint32_t bit = 0; bit < kDescriptorBytes * 8; ++bit) {
+        if (clusterBitCounts[bit] * 2 > clusterSizes[cluster]) {
+          centroid[bit / 8] |= 1 << (bit % 8);
+        }
+      }
+    }
+  }
+
+  std::vector<std::vector<uint32_t>> clusterRows(mBranchingFactor);
+  for (size_t i = 0; i < aRows.size(); ++i) {
+    clusterRows[assignments[i]].push_back(aRows[i]);
+  }
+
+  // Allocate all children first so that they are contiguous, then descend into every one of them.
+  const uint32_t firstChild = mFirstChild.size();
+  mFirstChild[aNode] = firstChild;
+  mChildCount[aNode] = mBranchingFactor;
+  for (uint32_t cluster = 0; cluster < mBranchingFactor; ++cluster) {
+    mCentroids.insert(mCentroids.end(), centroids.begin() + cluster * kDescriptorBytes,
+        centroids.begin() + (cluster + 1) * kDescriptorBytes);
+    mFirstChild.push_back(0);
+    mChildCount.push_back(0);
+    mWordIds.push_back(-1);
+  }
+
+  for (uint32_t cluster = 0; cluster < mBranchingFactor; ++cluster) {
+    Cluster(aDescriptors, clusterRows[cluster], firstChild + cluster, aLevel + 1);
+  }
+}
+
+uint32_t Vocabulary::GetLeaf(const uint8_t *aDescriptor) const {
+  uint32_t node = 0;
+  while (mChildCount[node] > 0) {
+    const uint32_t firstChild = mFirstChild[node];
+
+    HammingTop2 top2;
+    HammingMatcher<kDescriptorBytes>::FindTop2(aDescriptor, &mCentroids[firstChild * kDescriptorBytes],
+        mChildCount[node], kDescriptorBytes, top2);
+    const uint32_t bestChild = firstChild + top2.mIndices[0];
+
+    node = bestChild;
+  }
+
+  return node;
+}
+
+BowVector Vocabulary::Transform(const cv::Mat &aDescriptors) const {
+  BowVector bowVector;
+  if (IsEmpty() || aDescriptors.empty()) {
+    return bowVector;
+  }
+
+  for (int row = 0; row < aDescriptors.rows; ++row) {
+    const uint32_t word = mWordIds[GetLeaf(aDescriptors.ptr<uint8_t>(row))];
+    if (mWeights[word] > 0) {
+      bowVector[word] += mWeights[word];
+    }
+  }
+
+  float norm = 0;
+  for (const auto &entry : bowVector) {
+    norm += entry.second;
+  }
+
+  if (norm > 0) {
+    for (auto &entry : bowVector) {
+      entry.second /= norm;
+    }
+  }
+
+  return bowVector;
+}
+
+/*static*/ float Vocabulary::Score(const BowVector &aFirstVector, const BowVector &aSecondVector) {
+  // For L1 normalized vectors |a - b| = 2 + sum(|a_i - b_i| - |a_i| - |b_i|) over the words both vectors have, so
+  // only common words contribute to the score 1 - |a - b| / 2.
+  float score = 0;
+  auto first = aFirstVector.begin(), second = aSecondVector.begin();
+  while (first != aFirstVector.end() && second != aSecondVector.end()) {
+    if (first->first < second->first) {
+      ++first;
+    } else if (second->first < first->first) {
+      ++second;
+    } else {
+      score += std::fabs(first->second) + std::fabs(second->second) - std::fabs(first->second - second->second);
+      ++first;
+      ++second;
+    }
+  }
+
+  return score / 2;
+}
+
+bool Vocabulary::IsEmpty() const {
+  return mWeights.empty();
+}
+
+uint32_t Vocabulary::GetWordCount() const {
+  return mWeights.size();
+}
+
+/*static*/ void Vocabulary::Save(const Vocabulary &aVocabulary, const std::string &aPath) {
+  // Written aside and then swapped in, so that a crash never leaves a torn vocabulary behind.
+  const std::string temporaryPath = aPath + ".tmp";
+  {
+    std::ofstream outputStream(temporaryPath, std::ios::binary | std::ios::trunc);
+    cereal::BinaryOutputArchive archive(outputStream);
+    archive(aVocabulary);
+
+    outputStream.flush();
+    if (!outputStream.good()) {
+      throw std::runtime_error("Couldn't write vocabulary to " + temporaryPath + "!");
+    }
+  }
+
+  FileSync::Replace(temporaryPath, aPath);
+}
+
+/*static*/ Vocabulary Vocabulary::Load(const std::string &aPath) {
+  std::ifstream inputStream(aPath, std::ios::binary);
+  cereal::BinaryInputArchive archive(inputStream);
+
+  Vocabulary vocabulary;
+  archive(vocabulary);
+
+  // Tree is walked without any bounds checks, so whatever has been decoded must be a well-formed tree: every inner
+  // node's children are within the tree and after the node itself (so that every walk ends), every leaf has a word.
+  const size_t nodeCount = vocabulary.mFirstChild.size();
+  if (vocabulary.mChildCount.size() != nodeCount || vocabulary.mWordIds.size() != nodeCount ||
+      vocabulary.mCentroids.size() != nodeCount * kDescriptorBytes ||
+      (nodeCount == 0 && !vocabulary.mWeights.empty())) {
+    throw cereal::Exception("Vocabulary is corrupted!");
+  }
+
+  for (size_t node = 0; node < nodeCount; ++node) {
+    const uint32_t firstChild = vocabulary.mFirstChild[node], childCount = vocabulary.mChildCount[node];
+    const bool isValidNode = childCount > 0 ?
+        firstChild > node && firstChild <= nodeCount && childCount <= nodeCount - firstChild &&
+            vocabulary.mWordIds[node] == -1 :
+        vocabulary.mWordIds[node] >= 0 && (size_t) vocabulary.mWordIds[node] < vocabulary.mWeights.size();
+    if (!isValidNode) {
+      throw cereal::Exception("Vocabulary is corrupted!");
+    }
+  }
+
+  for (const float weight : vocabulary.mWeights) {
+    if (!std::isfinite(weight) || weight < 0) {
+      throw cereal::Exception("Vocabulary is corrupted!");
+    }
+  }
+
+  return vocabulary;
+}
+
+} // namespace lighthouse
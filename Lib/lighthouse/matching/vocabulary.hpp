@@ -0,0 +1,84 @@
+//
+//  vocabulary.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef vocabulary_hpp
+#define vocabulary_hpp
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <cereal/access.hpp>
+#include <cereal/types/vector.hpp>
+
+namespace lighthouse {
+
+// Sparse TF-IDF weighted bag-of-words vector: visual word id -> L1 normalized weight.
+typedef std::map<uint32_t, float> BowVector;
+
+// Hierarchical k-majority vocabulary tree over binary (ORB) descriptors (Gálvez-López and Tardós, DBoW2). Every inner
+// node splits descriptors into `mBranchingFactor` clusters whose centroids are bitwise majorities of their members,
+// leaves are visual words weighted by their inverse document frequency in the training set.
+class Vocabulary {
+public:
+  Vocabulary();
+
+  // Builds the vocabulary out of descriptors of the training images, one matrix per image.
+  static Vocabulary Train(const std::vector<cv::Mat> &aImageDescriptors, uint32_t aBranchingFactor, uint32_t aDepth);
+
+  // Converts descriptors into a TF-IDF bag-of-words vector. Returns empty vector if vocabulary is empty.
+  BowVector Transform(const cv::Mat &aDescriptors) const;
+
+  // Returns similarity between two bag-of-words vectors in [0, 1] range (L1 score), 1 means the vectors are the same.
+  static float Score(const BowVector &aFirstVector, const BowVector &aSecondVector);
+
+  bool IsEmpty() const;
+
+  uint32_t GetWordCount() const;
+
+  // Writes the vocabulary into a temporary file that then durably replaces the one at the path. Throws
+  // `std::runtime_error` if it can't be written.
+  static void Save(const Vocabulary &aVocabulary, const std::string &aPath);
+
+  // Throws `cereal::Exception` if the file can't be decoded or isn't a well-formed tree.
+  static Vocabulary Load(const std::string &aPath);
+
+private:
+  // Returns index of the leaf node that descriptor falls into.
+  uint32_t GetLeaf(const uint8_t *aDescriptor) const;
+
+  // Recursively clusters descriptors (rows of `aDescriptors` referenced by `aRows`) under the node `aNode`.
+  void Cluster(const cv::Mat &aDescriptors, const std::vector<uint32_t> &aRows, uint32_t aNode, uint32_t aLevel);
+
+  uint32_t mBranchingFactor;
+  uint32_t mDepth;
+
+  // Flat tree, node 0 is the root. For every node: its centroid (`kDescriptorBytes` per node), index of the first
+  // child (children are stored contiguously, 0 - node is a leaf), number of children, word id of the leaf (or -1).
+  std::vector<uint8_t> mCentroids;
+  std::vector<uint32_t> mFirstChild;
+  std::vector<uint32_t> mChildCount;
+  std::vector<int32_t> mWordIds;
+
+  // IDF weight for every word.
+  std::vector<float> mWeights;
+
+  friend class cereal::access;
+
+  template<class Archive>
+  void serialize(Archive &aArchive) {
+    aArchive(mBranchingFactor, mDepth);
+    aArchive(mCentroids, mFirstChild, mChildCount, mWordIds);
+    aArchive(mWeights);
+  };
+};
+
+} // namespace lighthouse
+
+#endif /* vocabulary_hpp */
@@ -0,0 +1,64 @@
+//
+//  aligned_allocator.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef aligned_allocator_hpp
+#define aligned_allocator_hpp
+
+#include <stdlib.h>
+#include <cstddef>
+#include <new>
+
+namespace lighthouse {
+
+// Standard allocator that aligns every allocation to `Alignment` bytes (must be a power of two and a multiple of
+// `sizeof(void *)`), e.g. to keep descriptor rows on cache line boundaries: `new` isn't required to honour `alignas`
+// greater than `alignof(std::max_align_t)` before C++17.
+template<class T, size_t Alignment>
+class AlignedAllocator {
+public:
+  typedef T value_type;
+
+  template<class U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {
+  }
+
+  template<class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {
+  }
+
+  T *allocate(size_t aCount) {
+    void *pointer = nullptr;
+    if (posix_memalign(&pointer, Alignment, aCount * sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+
+    return static_cast<T *>(pointer);
+  }
+
+  void deallocate(T *aPointer, size_t) {
+    free(aPointer);
+  }
+
+  template<class U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const {
+    return true;
+  }
+
+  template<class U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const {
+    return false;
+  }
+};
+
+} // namespace lighthouse
+
+#endif /* aligned_allocator_hpp */
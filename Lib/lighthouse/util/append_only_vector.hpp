@@ -0,0 +1,242 @@
+//
+//  append_only_vector.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef append_only_vector_hpp
+#define append_only_vector_hpp
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lighthouse {
+
+// Vector that only grows at the end and whose copies share their elements, so that copying it costs a few pointers
+// no matter how large it is. Elements are stored in fixed-size chunks that never move: appending to a copy writes past
+// the end of every other copy, which none of them ever reads, so a copy that's being read (e.g. by a published DB
+// snapshot) stays valid while the one it has been made of keeps growing. The last chunk is claimed by the first copy
+// that appends to it, any other copy that appends there later gets its own copy of that chunk. Appending isn't
+// thread-safe, reading a copy while another one grows is. Chunks are allocated with `Allocator`, e.g. to align them.
+template<class T, size_t ChunkSize = 4096, class Allocator = std::allocator<T>>
+class AppendOnlyVector {
+public:
+  AppendOnlyVector() : mChunks(std::make_shared<ChunkList>()), mSize(0) {
+  }
+
+  size_t Size() const {
+    return mSize;
+  }
+
+  bool Empty() const {
+    return mSize == 0;
+  }
+
+  const T &operator[](size_t aIndex) const {
+    return (*mChunks)[aIndex / ChunkSize]->mElements[aIndex % ChunkSize];
+  }
+
+  // Elements are shared with all copies, so this one is for the elements that are changed in place on purpose (atomic
+  // links, see `AppendOnlyBuckets`).
+  T &operator[](size_t aIndex) {
+    return (*mChunks)[aIndex / ChunkSize]->mElements[aIndex % ChunkSize];
+  }
+
+  const T &Back() const {
+    return (*this)[mSize - 1];
+  }
+
+  // Number of elements stored right after each other from the index on, up to the end of its chunk or of the vector.
+  size_t GetRunLength(size_t aIndex) const {
+    return std::min(ChunkSize - aIndex % ChunkSize, mSize - aIndex);
+  }
+
+  void PushBack(const T &aValue) {
+    const size_t slot = mSize % ChunkSize;
+    if (slot == 0) {
+      // Chunk list is shared too, so it's extended in a copy: one pointer per `ChunkSize` elements.
+      std::shared_ptr<ChunkList> chunks = std::make_shared<ChunkList>(*mChunks);
+      chunks->push_back(std::make_shared<Chunk>());
+      chunks->back()->mClaimed = 1;
+      mChunks = chunks;
+    } else {
+      size_t claimed = slot;
+      if (!mChunks->back()->mClaimed.compare_exchange_strong(claimed, slot + 1)) {
+        // Another copy has already appended past our end, the rest of this chunk is its.
+        std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+        std::copy(mChunks->back()->mElements.begin(), mChunks->back()->mElements.begin() + slot,
+            chunk->mElements.begin());
+        chunk->mClaimed = slot + 1;
+
+        std::shared_ptr<ChunkList> chunks = std::make_shared<ChunkList>(*mChunks);
+        chunks->back() = chunk;
+        mChunks = chunks;
+      }
+    }
+
+    mChunks->back()->mElements[slot] = aValue;
+    mSize++;
+  }
+
+  void Clear() {
+    mChunks = std::make_shared<ChunkList>();
+    mSize = 0;
+  }
+
+  // Copies the elements out, e.g. for serialization.
+  std::vector<T> ToVector() const {
+    std::vector<T> elements;
+    elements.reserve(mSize);
+    for (size_t i = 0; i < mSize; ++i) {
+      elements.push_back((*this)[i]);
+    }
+    return elements;
+  }
+
+private:
+  struct Chunk {
+    Chunk() : mElements(ChunkSize), mClaimed(0) {
+    }
+
+    std::vector<T, Allocator> mElements;
+    // Number of leading elements that some copy has appended.
+    std::atomic<size_t> mClaimed;
+  };
+
+  typedef std::vector<std::shared_ptr<Chunk>> ChunkList;
+
+  std::shared_ptr<const ChunkList> mChunks;
+  size_t mSize;
+};
+
+// Entries (numbered in the order they're added) grouped into a fixed number of buckets, e.g. descriptor indices by
+// their hash. Every bucket is a chain of entries in the order they've been added, linked through the entries, so adding
+// one costs O(1) and copies share all of it, same as `AppendOnlyVector` does. Every copy walks the chains only up to
+// its own size, so adding to one copy never changes what the others see. A branch (a copy that adds entries after
+// another one has) can't link into the shared chains and rebuilds its own ones first, that's the only O(size) add.
+class AppendOnlyBuckets {
+public:
+  // Marks the end of a chain.
+  static const uint32_t kNone = UINT32_MAX;
+
+  explicit AppendOnlyBuckets(uint32_t aBucketCount = 1) : mBucketCount(aBucketCount), mState(), mLinks(), mSize(0) {
+  }
+
+  uint32_t GetBucketCount() const {
+    return mBucketCount;
+  }
+
+  // Number of entries added.
+  size_t Size() const {
+    return mSize;
+  }
+
+  // Adds entry `Size()` to the bucket (must be less than the bucket count).
+  void Add(uint32_t aBucket) {
+    size_t claimed = mSize;
+    if (!mState || !mState->mClaimed.compare_exchange_strong(claimed, mSize + 1)) {
+      Detach();
+      mState->mClaimed = mSize + 1;
+    }
+
+    const uint32_t entry = (uint32_t) mSize;
+    mLinks.PushBack(Link());
+
+    Bucket &bucket = mState->mBuckets[aBucket];
+    if (bucket.mLast == kNone) {
+      bucket.mFirst.store(entry, std::memory_order_release);
+    } else {
+      mLinks[bucket.mLast].mNext.store(entry, std::memory_order_release);
+    }
+    bucket.mLast = entry;
+    mSize++;
+  }
+
+  // Calls `aVisitor(entry)` for every entry of the bucket, in the order they've been added.
+  template<class Visitor>
+  void ForEach(uint32_t aBucket, Visitor aVisitor) const {
+    if (!mState) {
+      return;
+    }
+
+    for (uint32_t entry = mState->mBuckets[aBucket].mFirst.load(std::memory_order_acquire); entry < mSize;
+        entry = mLinks[entry].mNext.load(std::memory_order_acquire)) {
+      aVisitor(entry);
+    }
+  }
+
+private:
+  struct Bucket {
+    Bucket() : mFirst(kNone), mLast(kNone) {
+    }
+
+    std::atomic<uint32_t> mFirst;
+    // Only the copy that has claimed the buckets touches it.
+    uint32_t mLast;
+  };
+
+  struct State {
+    explicit State(uint32_t aBucketCount) : mBuckets(new Bucket[aBucketCount]), mClaimed(0) {
+    }
+
+    std::unique_ptr<Bucket[]> mBuckets;
+    // Number of entries the copy that may link new entries into the chains has.
+    std::atomic<size_t> mClaimed;
+  };
+
+  struct Link {
+    Link() : mNext(kNone) {
+    }
+
+    Link &operator=(const Link &aOther) {
+      mNext.store(aOther.mNext.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      return *this;
+    }
+
+    std::atomic<uint32_t> mNext;
+  };
+
+  // Rebuilds the chains of this copy's entries into buckets and links of its own.
+  void Detach() {
+    std::shared_ptr<State> state = std::make_shared<State>(mBucketCount);
+    AppendOnlyVector<Link> links;
+    for (size_t entry = 0; entry < mSize; ++entry) {
+      links.PushBack(Link());
+    }
+
+    if (mState) {
+      for (uint32_t bucket = 0; bucket < mBucketCount; ++bucket) {
+        Bucket &newBucket = state->mBuckets[bucket];
+        ForEach(bucket, [&](uint32_t aEntry) {
+          if (newBucket.mLast == kNone) {
+            newBucket.mFirst.store(aEntry, std::memory_order_relaxed);
+          } else {
+            links[newBucket.mLast].mNext.store(aEntry, std::memory_order_relaxed);
+          }
+          newBucket.mLast = aEntry;
+        });
+      }
+    }
+
+    state->mClaimed = mSize;
+    mState = state;
+    mLinks = links;
+  }
+
+  uint32_t mBucketCount;
+  // Allocated once the first entry is added, so that empty copies cost nothing.
+  std::shared_ptr<State> mState;
+  AppendOnlyVector<Link> mLinks;
+  size_t mSize;
+};
+
+} // namespace lighthouse
+
+#endif /* append_only_vector_hpp */
@@ -0,0 +1,67 @@
+//
+//  crc32c.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <array>
+#include <cstring>
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include "crc32c.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Reversed Castagnoli polynomial.
+const uint32_t kPolynomial = 0x82F63B78;
+
+std::array<uint32_t, 256> CreateTable() {
+  std::array<uint32_t, 256> table;
+  for (uint32_t byte = 0; byte < table.size(); ++byte) {
+    uint32_t crc = byte;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+    }
+    table[byte] = crc;
+  }
+  return table;
+}
+
+const std::array<uint32_t, 256> kTable = CreateTable();
+
+} // namespace
+
+/*static*/ uint32_t Crc32c::Update(uint32_t aCrc, const void *aData, size_t aSize) {
+  const uint8_t *data = static_cast<const uint8_t *>(aData);
+  uint32_t crc = ~aCrc;
+
+  // Whole DB sections are checked at load, so the CPU's CRC-32C instructions are used where there are any: they do
+  // 8 bytes at a time, many times faster than the table.
+#if defined(__ARM_FEATURE_CRC32) || (defined(__SSE4_2__) && defined(__x86_64__))
+  for (; aSize >= sizeof(uint64_t); aSize -= sizeof(uint64_t), data += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+#if defined(__ARM_FEATURE_CRC32)
+    crc = __crc32cd(crc, word);
+#else
+    crc = (uint32_t) _mm_crc32_u64(crc, word);
+#endif
+  }
+#endif
+
+  for (size_t i = 0; i < aSize; ++i) {
+    crc = kTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+} // namespace lighthouse
@@ -0,0 +1,33 @@
+//
+//  crc32c.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef crc32c_hpp
+#define crc32c_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace lighthouse {
+
+// CRC-32C (Castagnoli), the checksum of the records and headers Lighthouse writes to disk. It detects all burst errors
+// up to 32 bits, so a torn or partially overwritten write doesn't go unnoticed.
+class Crc32c {
+public:
+  // Checksum of the data.
+  static uint32_t Compute(const void *aData, size_t aSize) {
+    return Update(0, aData, aSize);
+  }
+
+  // Checksum of the data that `aCrc` is the checksum of, followed by `aData`.
+  static uint32_t Update(uint32_t aCrc, const void *aData, size_t aSize);
+};
+
+} // namespace lighthouse
+
+#endif /* crc32c_hpp */
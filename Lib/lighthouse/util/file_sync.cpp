@@ -0,0 +1,57 @@
+//
+//  file_sync.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <stdexcept>
+
+#include "file_sync.hpp"
+
+namespace lighthouse {
+
+/*static*/ void FileSync::Sync(int aFile) {
+#ifdef F_FULLFSYNC
+  // Not every file system supports it, plain `fsync` is the best we can do then.
+  if (fcntl(aFile, F_FULLFSYNC) == 0) {
+    return;
+  }
+#endif
+  if (fsync(aFile) != 0) {
+    throw std::runtime_error("Couldn't flush file!");
+  }
+}
+
+/*static*/ void FileSync::Sync(const std::string &aPath) {
+  const int file = open(aPath.c_str(), O_RDONLY);
+  if (file < 0) {
+    throw std::runtime_error("Couldn't open " + aPath + "!");
+  }
+
+  try {
+    Sync(file);
+  } catch (const std::runtime_error &e) {
+    close(file);
+    throw std::runtime_error("Couldn't flush " + aPath + "!");
+  }
+  close(file);
+}
+
+/*static*/ void FileSync::Replace(const std::string &aTemporaryPath, const std::string &aPath) {
+  Sync(aTemporaryPath);
+
+  if (std::rename(aTemporaryPath.c_str(), aPath.c_str()) != 0) {
+    throw std::runtime_error("Couldn't replace " + aPath + "!");
+  }
+
+  // Rename is an entry in the directory, it's durable only once the directory is.
+  const size_t separator = aPath.find_last_of('/');
+  Sync(separator == std::string::npos ? std::string(".") : aPath.substr(0, separator + 1));
+}
+
+} // namespace lighthouse
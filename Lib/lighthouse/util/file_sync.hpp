@@ -0,0 +1,35 @@
+//
+//  file_sync.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef file_sync_hpp
+#define file_sync_hpp
+
+#include <stdio.h>
+#include <string>
+
+namespace lighthouse {
+
+// Makes writes durable: once these return, the data survives a crash or a power loss. Where the system allows it
+// (`F_FULLFSYNC` on Apple platforms) the drive is asked to flush its own cache too, plain `fsync` doesn't do that
+// there.
+class FileSync {
+public:
+  // Flushes the open file. Throws `std::runtime_error` if it fails.
+  static void Sync(int aFile);
+
+  // Flushes the file at the path. Throws `std::runtime_error` if it can't be opened or flushed.
+  static void Sync(const std::string &aPath);
+
+  // Atomically replaces the file at `aPath` with the one at `aTemporaryPath`, durably: the temporary file is flushed
+  // before the rename and the directory after it. Throws `std::runtime_error` if anything fails.
+  static void Replace(const std::string &aTemporaryPath, const std::string &aPath);
+};
+
+} // namespace lighthouse
+
+#endif /* file_sync_hpp */
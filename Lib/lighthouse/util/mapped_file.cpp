@@ -0,0 +1,74 @@
+//
+//  mapped_file.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdexcept>
+
+#include "mapped_file.hpp"
+
+namespace lighthouse {
+
+MappedFile::MappedFile(const std::string &aPath) : mData(nullptr), mSize(0) {
+  const int file = open(aPath.c_str(), O_RDONLY);
+  if (file < 0) {
+    throw std::runtime_error("Couldn't open " + aPath + "!");
+  }
+
+  struct stat status;
+  if (fstat(file, &status) != 0) {
+    close(file);
+    throw std::runtime_error("Couldn't get size of " + aPath + "!");
+  }
+
+  mSize = (size_t) status.st_size;
+  if (mSize > 0) {
+    void *data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, file, 0);
+    if (data == MAP_FAILED) {
+      close(file);
+      throw std::runtime_error("Couldn't map " + aPath + "!");
+    }
+    mData = static_cast<const uint8_t *>(data);
+  }
+
+  // Mapping keeps its own reference to the file.
+  close(file);
+}
+
+MappedFile::~MappedFile() {
+  if (mData != nullptr) {
+    munmap(const_cast<uint8_t *>(mData), mSize);
+  }
+}
+
+/*static*/ size_t MappedFile::GetPageSize() {
+  return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+/*static*/ void MappedFile::Prefetch(const void *aData, size_t aSize) {
+  Advise(aData, aSize, MADV_WILLNEED);
+}
+
+/*static*/ void MappedFile::Release(const void *aData, size_t aSize) {
+  Advise(aData, aSize, MADV_DONTNEED);
+}
+
+/*static*/ void MappedFile::Advise(const void *aData, size_t aSize, int aAdvice) {
+  if (aData == nullptr || aSize == 0) {
+    return;
+  }
+
+  const uintptr_t pageSize = GetPageSize();
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(aData) / pageSize * pageSize;
+  const uintptr_t end = reinterpret_cast<uintptr_t>(aData) + aSize;
+  madvise(reinterpret_cast<void *>(begin), end - begin, aAdvice);
+}
+
+} // namespace lighthouse
@@ -0,0 +1,60 @@
+//
+//  mapped_file.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef mapped_file_hpp
+#define mapped_file_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace lighthouse {
+
+// Whole file mapped read-only into memory. Pages are read only once they're touched, and the mapping stays valid even
+// if the file is replaced or removed meanwhile.
+class MappedFile {
+public:
+  // Throws `std::runtime_error` if the file can't be opened or mapped.
+  explicit MappedFile(const std::string &aPath);
+
+  ~MappedFile();
+
+  // Start of the mapping (page aligned), `nullptr` for an empty file.
+  const uint8_t *GetData() const {
+    return mData;
+  }
+
+  size_t GetSize() const {
+    return mSize;
+  }
+
+  // Size of the pages mappings are made of.
+  static size_t GetPageSize();
+
+  // Hints that the mapped range is about to be read, so that its pages are read ahead.
+  static void Prefetch(const void *aData, size_t aSize);
+
+  // Drops the pages of the mapped range from memory, they're read from the file again once they're touched. Pages are
+  // whole, so parts of the neighbouring data may be dropped as well.
+  static void Release(const void *aData, size_t aSize);
+
+private:
+  // Page aligned `madvise`, errors are ignored: it's only a hint.
+  static void Advise(const void *aData, size_t aSize, int aAdvice);
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *mData;
+  size_t mSize;
+};
+
+} // namespace lighthouse
+
+#endif /* mapped_file_hpp */
@@ -0,0 +1,180 @@
+//
+//  thread_pool.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <exception>
+
+#include "thread_pool.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Completion state of a single `ParallelFor` call shared by all of its chunks.
+struct Batch {
+  Batch(size_t aChunkCount) : mRemainingChunkCount(aChunkCount), mError(nullptr) {}
+
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  size_t mRemainingChunkCount;
+  std::exception_ptr mError;
+};
+
+} // namespace
+
+ThreadPool::ThreadPool(uint32_t aThreadCount)
+    : mQueues(), mWorkers(), mQueuedTaskCount(0), mMutex(), mCondition(), mIsStopping(false) {
+  const uint32_t threadCount = aThreadCount > 0 ? aThreadCount : std::max(std::thread::hardware_concurrency(), 1u);
+
+  // Calling thread doesn't need a worker, but it gets a queue to push its chunks to.
+  for (uint32_t i = 0; i < threadCount; ++i) {
+    mQueues.push_back(std::unique_ptr<Queue>(new Queue()));
+  }
+
+  for (uint32_t i = 1; i < threadCount; ++i) {
+    mWorkers.push_back(std::thread(&ThreadPool::RunWorker, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIsStopping = true;
+  }
+  mCondition.notify_all();
+
+  for (std::thread &worker : mWorkers) {
+    worker.join();
+  }
+}
+
+uint32_t ThreadPool::GetThreadCount() const {
+  return mQueues.size();
+}
+
+void ThreadPool::ParallelFor(size_t aCount, size_t aChunkSize, const std::function<void(size_t, size_t)> &aBody) {
+  if (aCount == 0) {
+    return;
+  }
+
+  const size_t chunkSize = std::max<size_t>(aChunkSize, 1);
+  const size_t chunkCount = (aCount + chunkSize - 1) / chunkSize;
+
+  // Nothing to share, don't pay for the synchronization.
+  if (mWorkers.empty() || chunkCount == 1) {
+    for (size_t begin = 0; begin < aCount; begin += chunkSize) {
+      aBody(begin, std::min(begin + chunkSize, aCount));
+    }
+    return;
+  }
+
+  std::shared_ptr<Batch> batch = std::make_shared<Batch>(chunkCount);
+
+  // Deal chunks round-robin, so every worker starts with its own share and steals only once it runs out.
+  for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+    const size_t begin = chunk * chunkSize, end = std::min(begin + chunkSize, aCount);
+    std::function<void()> task = [batch, &aBody, begin, end]() {
+      try {
+        aBody(begin, end);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(batch->mMutex);
+        if (batch->mError == nullptr) {
+          batch->mError = std::current_exception();
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(batch->mMutex);
+      if (--batch->mRemainingChunkCount == 0) {
+        batch->mCondition.notify_all();
+      }
+    };
+
+    // Counted under the queue's mutex, same as `Pop` and `Steal` take it off, so the count is never behind the queues
+    // (it's unsigned, a take that came first would wrap it around).
+    Queue &queue = *mQueues[chunk % mQueues.size()];
+    std::lock_guard<std::mutex> lock(queue.mMutex);
+    queue.mTasks.push_back(std::move(task));
+    mQueuedTaskCount++;
+  }
+
+  // Workers check the count under `mMutex` before they go to sleep, so once we've held it they either see the tasks or
+  // are waiting for the notification.
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+  }
+  mCondition.notify_all();
+
+  // Help until there is nothing left to take, then wait for the chunks other threads are still busy with. Tasks of
+  // other concurrent loops may be picked up too, that's fine as long as we eventually see our batch complete.
+  std::function<void()> task;
+  while (Pop(0, task) || Steal(0, task)) {
+    task();
+    task = nullptr;
+
+    std::lock_guard<std::mutex> lock(batch->mMutex);
+    if (batch->mRemainingChunkCount == 0) {
+      break;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(batch->mMutex);
+  batch->mCondition.wait(lock, [&batch]() { return batch->mRemainingChunkCount == 0; });
+
+  if (batch->mError != nullptr) {
+    std::rethrow_exception(batch->mError);
+  }
+}
+
+bool ThreadPool::Pop(uint32_t aQueueIndex, std::function<void()> &aTask) {
+  Queue &queue = *mQueues[aQueueIndex];
+  std::lock_guard<std::mutex> lock(queue.mMutex);
+  if (queue.mTasks.empty()) {
+    return false;
+  }
+
+  aTask = std::move(queue.mTasks.back());
+  queue.mTasks.pop_back();
+  mQueuedTaskCount--;
+  return true;
+}
+
+bool ThreadPool::Steal(uint32_t aQueueIndex, std::function<void()> &aTask) {
+  for (size_t offset = 1; offset < mQueues.size(); ++offset) {
+    Queue &queue = *mQueues[(aQueueIndex + offset) % mQueues.size()];
+    std::lock_guard<std::mutex> lock(queue.mMutex);
+    if (queue.mTasks.empty()) {
+      continue;
+    }
+
+    aTask = std::move(queue.mTasks.front());
+    queue.mTasks.pop_front();
+    mQueuedTaskCount--;
+    return true;
+  }
+
+  return false;
+}
+
+void ThreadPool::RunWorker(uint32_t aQueueIndex) {
+  std::function<void()> task;
+  while (true) {
+    if (Pop(aQueueIndex, task) || Steal(aQueueIndex, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this]() { return mIsStopping || mQueuedTaskCount > 0; });
+    if (mIsStopping) {
+      return;
+    }
+  }
+}
+
+} // namespace lighthouse
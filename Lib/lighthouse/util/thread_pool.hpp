@@ -0,0 +1,72 @@
+//
+//  thread_pool.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef thread_pool_hpp
+#define thread_pool_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lighthouse {
+
+// Work-stealing thread pool for data-parallel loops. Every worker has its own task queue: the owner takes tasks from
+// the back, idle workers steal from the front of the other queues, so a worker that got unlucky with slow chunks gets
+// help instead of keeping the whole loop waiting. The thread that runs the loop works on it too.
+class ThreadPool {
+public:
+  // Creates a pool that runs loops on `aThreadCount` threads including the calling one, 0 means one thread per core.
+  explicit ThreadPool(uint32_t aThreadCount);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool &operator=(const ThreadPool&) = delete;
+
+  // Number of threads loops run on, including the calling one.
+  uint32_t GetThreadCount() const;
+
+  // Splits [0, aCount) into chunks of at most `aChunkSize` elements and runs `aBody(begin, end)` for every chunk, in
+  // no particular order. Returns once all chunks are done, rethrowing the first exception any of them has thrown. Safe
+  // to call from several threads at once.
+  void ParallelFor(size_t aCount, size_t aChunkSize, const std::function<void(size_t, size_t)> &aBody);
+
+private:
+  struct Queue {
+    std::mutex mMutex;
+    std::deque<std::function<void()>> mTasks;
+  };
+
+  // Takes the newest task of the queue with the specified index.
+  bool Pop(uint32_t aQueueIndex, std::function<void()> &aTask);
+
+  // Takes the oldest task from any queue, starting with the one after `aQueueIndex`.
+  bool Steal(uint32_t aQueueIndex, std::function<void()> &aTask);
+
+  void RunWorker(uint32_t aQueueIndex);
+
+  std::vector<std::unique_ptr<Queue>> mQueues;
+  std::vector<std::thread> mWorkers;
+
+  // Number of queued tasks that nobody has taken yet, workers sleep on `mCondition` while it's 0. Changes together
+  // with the queues, under the mutex of the queue.
+  std::atomic<size_t> mQueuedTaskCount;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mIsStopping;
+};
+
+} // namespace lighthouse
+
+#endif /* thread_pool_hpp */
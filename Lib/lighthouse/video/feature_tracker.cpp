@@ -0,0 +1,187 @@
+//
+//  feature_tracker.cpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "exceptions.hpp"
+#include "feature_tracker.hpp"
+
+namespace lighthouse {
+
+namespace {
+
+// Lucas-Kanade search window at every pyramid level and index of the coarsest level, the window covers motion of up
+// to about 21 * 2^3 px between frames.
+const cv::Size kWindowSize(21, 21);
+const int kPyramidLevels = 3;
+// Newly detected keypoint replaces a queried one that's still tracked only if it's at most that far (in px).
+const float kMaxSuccessorDistance = 4;
+
+} // namespace
+
+FeatureTracker::FeatureTracker(const ImageMatcher &aImageMatcher, const TopMatchesOptions &aOptions,
+    float aMinCoverage, float aRequeryCoverage)
+    : mImageMatcher(aImageMatcher), mOptions(aOptions), mMinCoverage(aMinCoverage),
+      mRequeryCoverage(aRequeryCoverage), mPreviousPyramid(), mPoints(), mIsQueried(), mDetectedCount(0),
+      mQueriedCount(0), mMatch(), mScore(0) {
+  if (aMinCoverage < 0 || aMinCoverage > 1 || aRequeryCoverage <= 0 || aRequeryCoverage > 1) {
+    throw std::invalid_argument("Tracking coverage thresholds should be within (0, 1]!");
+  }
+}
+
+TrackingUpdate FeatureTracker::Process(const cv::Mat &aFrame) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  cv::Mat gray;
+  if (aFrame.channels() == 4) {
+    cv::cvtColor(aFrame, gray, cv::COLOR_BGRA2GRAY);
+  } else if (aFrame.channels() == 3) {
+    cv::cvtColor(aFrame, gray, cv::COLOR_BGR2GRAY);
+  } else {
+    gray = aFrame;
+  }
+
+  // Pyramid is built once per frame, the next frame tracks points out of it.
+  std::vector<cv::Mat> pyramid;
+  cv::buildOpticalFlowPyramid(gray, pyramid, kWindowSize, kPyramidLevels);
+
+  if (!mPoints.empty()) {
+    Track(pyramid);
+  }
+
+  TrackingUpdate update = {};
+  const auto getCoverage = [this](float &aCoverage, float &aQueriedCoverage) {
+    aCoverage = mDetectedCount > 0 ? (float) mPoints.size() / mDetectedCount : 0;
+    aQueriedCoverage = mQueriedCount > 0 ?
+        (float) std::count(mIsQueried.begin(), mIsQueried.end(), 1) / mQueriedCount : 0;
+  };
+  getCoverage(update.mCoverage, update.mQueriedCoverage);
+
+  update.mIsQueried = update.mQueriedCoverage < mRequeryCoverage;
+  update.mIsDetected = update.mIsQueried || update.mCoverage < mMinCoverage;
+  if (update.mIsDetected) {
+    // Detection and the DB work with BGRA frames, where alpha is the mask.
+    cv::Mat frame = aFrame;
+    if (aFrame.channels() == 3) {
+      cv::cvtColor(aFrame, frame, cv::COLOR_BGR2BGRA);
+    } else if (aFrame.channels() == 1) {
+      cv::cvtColor(aFrame, frame, cv::COLOR_GRAY2BGRA);
+    }
+
+    try {
+      Detect(frame, update.mIsQueried);
+    } catch (const ImageQualityException &e) {
+      // Nothing to track and nothing to identify in the frame.
+      fprintf(stderr, "FeatureTracker::Process() couldn't detect keypoints: %s\n", e.what());
+      Reset();
+    }
+    getCoverage(update.mCoverage, update.mQueriedCoverage);
+  }
+
+  mPreviousPyramid.swap(pyramid);
+
+  update.mTrackedCount = mPoints.size();
+  update.mMatch = mMatch;
+  update.mScore = mScore;
+  update.mTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  return update;
+}
+
+void FeatureTracker::Reset() {
+  mPreviousPyramid.clear();
+  mPoints.clear();
+  mIsQueried.clear();
+  mDetectedCount = 0;
+  mQueriedCount = 0;
+  mMatch = nullptr;
+  mScore = 0;
+}
+
+void FeatureTracker::Track(const std::vector<cv::Mat> &aPyramid) {
+  std::vector<cv::Point2f> points;
+  std::vector<uint8_t> status;
+  std::vector<float> errors;
+  cv::calcOpticalFlowPyrLK(mPreviousPyramid, aPyramid, mPoints, points, status, errors, kWindowSize, kPyramidLevels);
+
+  // Points that have left the frame are lost as well, even if the flow has been found for them.
+  const cv::Size frameSize = aPyramid[0].size();
+  size_t tracked = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    const cv::Point2f &point = points[i];
+    if (status[i] && point.x >= 0 && point.y >= 0 && point.x < frameSize.width && point.y < frameSize.height) {
+      mPoints[tracked] = point;
+      mIsQueried[tracked] = mIsQueried[i];
+      tracked++;
+    }
+  }
+
+  mPoints.resize(tracked);
+  mIsQueried.resize(tracked);
+}
+
+void FeatureTracker::Detect(const cv::Mat &aFrame, bool aIsRequery) {
+  // Keypoints are tracked in the full resolution frame, not in the working resolution one they've been detected in.
+  std::vector<cv::Point2f> points;
+  if (aIsRequery) {
+    ImageDescription description;
+    const std::vector<std::tuple<float, ImageDescriptionPtr>> matches = mImageMatcher.Identify(aFrame, 1, mOptions,
+        description);
+    mMatch = matches.empty() ? nullptr : std::get<1>(matches[0]);
+    mScore = matches.empty() ? 0 : std::get<0>(matches[0]);
+
+    const KeypointSet &keypoints = description.GetKeypoints();
+    for (size_t i = 0; i < keypoints.Size(); ++i) {
+      points.push_back(keypoints.GetPoint(i) * (1 / description.GetScale()));
+    }
+  } else {
+    // Only positions are tracked, so nothing but the keypoints is computed.
+    float scale;
+    for (const cv::KeyPoint &keypoint : mImageMatcher.DetectKeypoints(aFrame, scale)) {
+      points.push_back(keypoint.pt * (1 / scale));
+    }
+  }
+
+  std::vector<uint8_t> isQueried(points.size(), aIsRequery);
+  if (aIsRequery) {
+    mQueriedCount = points.size();
+  } else {
+    // Every queried point that's still tracked hands its place over to the closest new keypoint, if there is one.
+    const float maxDistance = kMaxSuccessorDistance * kMaxSuccessorDistance;
+    for (size_t i = 0; i < mPoints.size(); ++i) {
+      if (!mIsQueried[i]) {
+        continue;
+      }
+
+      int successor = -1;
+      float successorDistance = maxDistance;
+      for (size_t j = 0; j < points.size(); ++j) {
+        const cv::Point2f delta = points[j] - mPoints[i];
+        const float distance = delta.dot(delta);
+        if (!isQueried[j] && distance <= successorDistance) {
+          successor = j;
+          successorDistance = distance;
+        }
+      }
+
+      if (successor >= 0) {
+        isQueried[successor] = 1;
+      }
+    }
+  }
+
+  mPoints.swap(points);
+  mIsQueried.swap(isQueried);
+  mDetectedCount = mPoints.size();
+
+  fprintf(stderr, "FeatureTracker::Detect() detected %u keypoint(s)%s.\n", mDetectedCount,
+      aIsRequery ? " and queried the DB" : "");
+}
+
+} // namespace lighthouse
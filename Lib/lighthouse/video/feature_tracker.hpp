@@ -0,0 +1,81 @@
+//
+//  feature_tracker.hpp
+//  Lighthouse Camera
+//
+//  Created by Lighthouse on 17/10/2026.
+//  Copyright © 2026 Lighthouse. All rights reserved.
+//
+
+#ifndef feature_tracker_hpp
+#define feature_tracker_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "image_matcher.hpp"
+
+namespace lighthouse {
+
+// What `FeatureTracker::Process` has done with one video frame and what is identified there.
+struct TrackingUpdate {
+  // Whether keypoints have been detected on this frame rather than tracked from the previous one.
+  bool mIsDetected;
+  // Whether the DB has been queried for this frame.
+  bool mIsQueried;
+  // Number of keypoints tracked after this frame, and fractions of the latest detected and the latest queried ones
+  // that are still among them.
+  uint32_t mTrackedCount;
+  float mCoverage;
+  float mQueriedCoverage;
+  // Time (in ms) spent on the frame.
+  double mTime;
+  // Best match of the latest query (`nullptr` if nothing has matched) and its score.
+  ImageDescriptionPtr mMatch;
+  float mScore;
+};
+
+// Continuous identification over a video stream. Keypoints are detected on the first frame only and then followed with
+// pyramidal Lucas-Kanade optical flow, which costs a fraction of feature extraction. They are detected again once fewer
+// than `aMinCoverage` of the detected ones are still tracked, and the DB is queried again only once fewer than
+// `aRequeryCoverage` of the keypoints the DB was queried with are still in view: until then the tracked set is assumed
+// to show the same object, so the latest match stands.
+class FeatureTracker {
+public:
+  FeatureTracker(const ImageMatcher &aImageMatcher, const TopMatchesOptions &aOptions, float aMinCoverage,
+      float aRequeryCoverage);
+
+  // Tracks keypoints into the next frame (BGR, BGRA or grayscale), detecting them and querying the DB when needed.
+  TrackingUpdate Process(const cv::Mat &aFrame);
+
+  // Forgets all tracked keypoints and the match, the next frame is treated as the first one.
+  void Reset();
+
+private:
+  // Moves tracked points into the frame described by the pyramid, drops the ones that are lost.
+  void Track(const std::vector<cv::Mat> &aPyramid);
+
+  // Detects keypoints on the BGRA frame and, if `aIsRequery` is set, queries the DB with them. Otherwise new keypoints
+  // close to the queried points that are still tracked take their place in the queried set.
+  void Detect(const cv::Mat &aFrame, bool aIsRequery);
+
+  const ImageMatcher &mImageMatcher;
+  TopMatchesOptions mOptions;
+  float mMinCoverage;
+  float mRequeryCoverage;
+
+  // Image pyramid of the previous frame, tracked points are located there.
+  std::vector<cv::Mat> mPreviousPyramid;
+  std::vector<cv::Point2f> mPoints;
+  // Whether the point at the same position in `mPoints` is (a successor of) one the DB has been queried with.
+  std::vector<uint8_t> mIsQueried;
+  uint32_t mDetectedCount;
+  uint32_t mQueriedCount;
+
+  ImageDescriptionPtr mMatch;
+  float mScore;
+};
+
+} // namespace lighthouse
+
+#endif /* feature_tracker_hpp */
@@ -280,6 +280,9 @@ NowYouSeeMeNowYouDont(const std::chrono::duration<Rep, Period>& sleepDuration, c
   const float DOWNSAMPLE_FACTOR = .5f;
   const double BLUR = .5;
   const double MIN_SIZE = .05;
+  // ORB doesn't detect keypoints closer than its edge threshold (31 px) to the image border, so the object crop keeps
+  // that much background around the object.
+  const int OBJECT_PADDING = 32;
   Mat imageMask(imageWithObject.rows, imageWithObject.cols, imageWithObject.type());
   if (!GetImageDelta(imageWithObject, imageBackground, DOWNSAMPLE_FACTOR, BLUR, MIN_SIZE, imageMask)) {
     return false;
@@ -310,6 +313,19 @@ NowYouSeeMeNowYouDont(const std::chrono::duration<Rep, Period>& sleepDuration, c
   aResult = cv::Mat(imageWithObject.size(), CV_8UC4);
   cv::merge(channels, aResult);
 
+  // Only the object matters from now on, so only its bounding box (with some background around it) is passed on, as a
+  // view into the frame, so that keypoints can still be placed into the frame.
+  std::vector<Point> objectPixels;
+  cv::findNonZero(imageMask, objectPixels);
+  if (!objectPixels.empty()) {
+    Rect objectBox = cv::boundingRect(objectPixels);
+    objectBox = Rect(objectBox.x - OBJECT_PADDING, objectBox.y - OBJECT_PADDING, objectBox.width + 2 * OBJECT_PADDING,
+        objectBox.height + 2 * OBJECT_PADDING) & Rect(0, 0, aResult.cols, aResult.rows);
+    fprintf(stderr, "NowYouSeeMeNowYouDont: cropping to (%d, %d) %d x %d\n", objectBox.x, objectBox.y, objectBox.width,
+        objectBox.height);
+    aResult = aResult(objectBox);
+  }
+
   fprintf(stderr, "NowYouSeeMeNowYouDont: Done\n");
   return true;
 }
@@ -334,3 +350,29 @@ Camera::CaptureForRecord(std::atomic_int *aState, cv::Mat& aResult) {
   Feedback::ReceivedFrame("CaptureForRecord", aResult);
   return true;
 }
+
+bool
+Camera::CaptureForTracking(std::atomic_int *aState, const std::function<void(const cv::Mat&)>& aOnFrame) {
+  auto capture = OpenCamera();
+  if (!capture) {
+    Feedback::CannotTakePicture();
+    return false;
+  }
+
+  Mat frame;
+  while (aState->load() == (int)Task::TRACK) {
+    if (!capture->read(frame)) {
+      // Nothing more to capture.
+      fprintf(stderr, "Camera::CaptureForTracking: no more video...\n");
+      break;
+    }
+
+    // Normalize all frames to have an alpha, same as pictures.
+    if (frame.channels() == 3) {
+      cv::cvtColor(frame, frame, cv::COLOR_BGR2BGRA);
+    }
+    aOnFrame(frame);
+  }
+
+  return true;
+}
@@ -11,6 +11,7 @@
 
 #include <stdio.h>
 #include <atomic>
+#include <functional>
 
 namespace cv {
   struct Mat;
@@ -28,6 +29,10 @@ public:
   // Capture a video stream for the purpose of identifying an already-known object.
   bool CaptureForIdentification(std::atomic_int* aState, cv::Mat& aResult);
 
+  // Capture a video stream for the purpose of tracking and identifying objects continuously. Every frame (BGRA) is
+  // passed to `aOnFrame` until the video stream ends or the state stops being `Task::TRACK`.
+  bool CaptureForTracking(std::atomic_int* aState, const std::function<void(const cv::Mat&)>& aOnFrame);
+
 private:
   Camera(const Camera& rhs) = delete;
   Camera& operator=(const Camera& rhs ) = delete;
@@ -23,12 +23,28 @@ extern NSObject *sViewController;
 
 - (void)PlaySound:(NSString *)aSoundResourceName;
 
+// Ids of the recorded items that have been lost with a damaged DB and have to be recorded again, waits for the DB to
+// be loaded.
+- (NSArray<NSString *> *)GetLostItemIds;
+
 // Trigger C++ code to start recording new object.
 - (void)onRecordObject;
 
 // Trigger C++ code to start identifying an object.
 - (void)onIdentifyObject;
 
-// Trigger C++ code to stop an ongoing Record/Identify operation.
+// Trigger C++ code to start identifying objects continuously, until capture is stopped.
+- (void)onTrackObjects;
+
+// Trigger C++ code to stop an ongoing Record/Identify/Track operation.
 - (void)onStopCapture;
+
+// Let C++ code drop whatever it can re-read from disk, the system is low on memory.
+- (void)onMemoryWarning;
+
+// Trigger C++ code to train the vocabulary over all recorded items (developer-only).
+- (void)onTrainVocabulary;
+
+// Trigger C++ code to run matching benchmarks over all recorded items (developer-only).
+- (void)onRunBenchmarks;
 @end
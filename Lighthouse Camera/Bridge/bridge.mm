@@ -18,9 +18,27 @@ lighthouse::ImageMatchingSettings matchingSettings = {
   .mMatchingScoreThreshold = 10.0,
   .mRatioTestK = 0.8,
   .mHistogramWeight = 5.0,
+  .mIndexSearchRadius = 2,
+  .mShortlistSize = 20,
+  .mThreadCount = 0,
+  .mHistogramShortlistSize = 0,
+  .mMatcherBackend = lighthouse::MatcherBackend::MULTI_INDEX_HASH,
+  .mLshTableCount = 12,
+  .mLshKeySize = 20,
+  .mLshProbeRadius = 1,
+  .mVerificationCount = 0,
+  .mVerificationModel = lighthouse::GeometricModel::HOMOGRAPHY,
+  .mVerificationReprojectionError = 5.0,
+  .mExtractionGridSize = 2,
+  .mProgressiveFeatureCount = 200,
+  .mProgressiveCertaintyScore = 40.0,
+  .mProgressiveCertaintyMargin = 20.0,
+  .mWorkingMaxSide = 960,
+  .mWorkingMegapixels = 0,
+  .mPayloadCacheMegabytes = 32,
 };
 
-lighthouse::Lighthouse lighthouseInstance(matchingSettings);
+lighthouse::Lighthouse lighthouseInstance(matchingSettings, lighthouse::EarlyQueryPolicy::WAIT);
 
 - (UIImage *)DrawKeypoints:(UIImage *)aSource {
   cv::Mat outputMatrix;
@@ -34,11 +52,25 @@ lighthouse::Lighthouse lighthouseInstance(matchingSettings);
 }
 
 - (void)PlayVoiceLabel:(NSString *)aId {
-  lighthouseInstance.PlayVoiceLabel(lighthouseInstance.GetDescription([aId UTF8String]));
+  const lighthouse::ImageDescriptionPtr description = lighthouseInstance.GetDescription([aId UTF8String]);
+  if (description) {
+    lighthouseInstance.PlayVoiceLabel(*description);
+  }
 }
 
 - (void)RecordVoiceLabel:(NSString *)aId {
-  lighthouseInstance.RecordVoiceLabel(lighthouseInstance.GetDescription([aId UTF8String]));
+  const lighthouse::ImageDescriptionPtr description = lighthouseInstance.GetDescription([aId UTF8String]);
+  if (description) {
+    lighthouseInstance.RecordVoiceLabel(*description);
+  }
+}
+
+- (NSArray<NSString *> *)GetLostItemIds {
+  NSMutableArray<NSString *> *ids = [NSMutableArray array];
+  for (const std::string &id : lighthouseInstance.GetLostItemIds()) {
+    [ids addObject:[NSString stringWithUTF8String:id.c_str()]];
+  }
+  return ids;
 }
 
 - (void)PlaySound:(NSString *)aSoundResourceName {
@@ -53,6 +85,22 @@ lighthouse::Lighthouse lighthouseInstance(matchingSettings);
   lighthouseInstance.OnIdentifyObject();
 }
 
+- (void)onMemoryWarning {
+  lighthouseInstance.OnMemoryWarning();
+}
+
+- (void)onTrackObjects {
+  lighthouseInstance.OnTrackObjects();
+}
+
+- (void)onTrainVocabulary {
+  lighthouseInstance.OnTrainVocabulary();
+}
+
+- (void)onRunBenchmarks {
+  lighthouseInstance.OnRunBenchmarks();
+}
+
 - (void)onStopCapture {
   fprintf(stderr, "onStopCapture %s", "start");
   lighthouseInstance.StopRecord();
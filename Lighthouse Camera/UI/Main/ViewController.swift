@@ -12,6 +12,8 @@ import AVFoundation
 class ViewController: UIViewController, PreviewViewDelegate {
   var bridge: Bridge!
   var isBusy: Bool
+  // Kept alive until it has finished speaking.
+  let speechSynthesizer = AVSpeechSynthesizer()
 
   required init?(coder aCoder: NSCoder) {
     isBusy = false
@@ -70,6 +72,46 @@ class ViewController: UIViewController, PreviewViewDelegate {
     }
   }
 
+  // Invoked when the user has clicked on "track": items are identified continuously in the live preview until the user
+  // clicks again.
+  @IBAction func onTrackClick(_ sender: Any) {
+    checkCameraAuthorization { authorized in
+      if authorized {
+        if self.isBusy {
+          self.bridge.onStopCapture()
+          self.isBusy = false
+          self.resetView()
+        } else {
+          // Tracking doesn't show frames, matches are only announced, so the preview stays in view.
+          self.bridge.onTrackObjects();
+          self.isBusy = true
+        }
+      }
+    }
+  }
+
+  // Invoked on a long press on the preview in debug builds: offers the developer actions that work on the whole item
+  // database, vocabulary training and benchmarks. Both are queued like any other operation and end with
+  // `operationComplete`.
+  @objc func onDeveloperPress(_ recognizer: UILongPressGestureRecognizer) {
+    if recognizer.state != .began || isBusy {
+      return
+    }
+
+    let sheet = UIAlertController(title: "Developer", message: nil, preferredStyle: .actionSheet)
+    sheet.addAction(UIAlertAction(title: "Train Vocabulary", style: .default) { _ in
+      self.isBusy = true
+      self.bridge.onTrainVocabulary()
+    })
+    sheet.addAction(UIAlertAction(title: "Run Benchmarks", style: .default) { _ in
+      self.isBusy = true
+      self.bridge.onRunBenchmarks()
+    })
+    sheet.addAction(UIAlertAction(title: "Cancel", style: .cancel, handler: nil))
+    sheet.popoverPresentationController?.sourceView = previewView
+    present(sheet, animated: true, completion: nil)
+  }
+
   @objc(operationComplete)
   public dynamic func operationComplete() {
     NSLog("operation complete \n");
@@ -116,6 +158,11 @@ class ViewController: UIViewController, PreviewViewDelegate {
     // PreviewViewDelegate class and will be deallocated
     previewView.delegate = self
 
+#if DEBUG
+    previewView.addGestureRecognizer(UILongPressGestureRecognizer(target: self,
+        action: #selector(onDeveloperPress(_:))))
+#endif
+
     registerSettingsBundle()
 
     // Establish audio session.
@@ -125,6 +172,8 @@ class ViewController: UIViewController, PreviewViewDelegate {
         with: AVAudioSessionCategoryOptions.defaultToSpeaker)
     try! session.setActive(true)
 
+    reportLostItems()
+
   }
 
   func displayPreviewSession() {
@@ -134,6 +183,7 @@ class ViewController: UIViewController, PreviewViewDelegate {
 
   override func didReceiveMemoryWarning() {
     super.didReceiveMemoryWarning()
+    bridge.onMemoryWarning()
   }
 
   override func viewWillAppear(_ animated: Bool) {
@@ -151,6 +201,28 @@ class ViewController: UIViewController, PreviewViewDelegate {
     }
   }
 
+  // Tells the user how many recorded items have been lost with a damaged item database, if any. The list is known only
+  // once the database is loaded, so it's waited for in the background.
+  private func reportLostItems() {
+    DispatchQueue.global(qos: .utility).async {
+      let lostItemIds = self.bridge.getLostItemIds()
+      if lostItemIds.isEmpty {
+        return
+      }
+
+      DispatchQueue.main.async {
+        let format = NSLocalizedString("Item database has been damaged, %d item(s) have to be recorded again.",
+            comment: "")
+        let message = String(format: format, lostItemIds.count)
+        self.label.text = message
+        self.label.isHidden = false
+        let utterance = AVSpeechUtterance(string: message)
+        utterance.rate = 0.55
+        self.speechSynthesizer.speak(utterance)
+      }
+    }
+  }
+
   private func resetView() {
     if isBusy {
       imageView.isHidden = false